@@ -38,6 +38,7 @@ static void tb_set_inputB(uint8_t _state_Bp, uint8_t _state_Bm);
 
 static _sindac_t _phaA = {0};
 static _sindac_t _phaB = {0};
+static uint16_t _out_scale = 1024;
 
 /**********************
  *   GLOBAL FUNCTIONS
@@ -122,6 +123,10 @@ void tb_foc_set_current_vector(uint32_t _dir_inCNT,
     /*Voltage-current relationship of 1:1 (sense resistance of 0.1 ohms)*/
     uint32_t bit12val = (uint32_t)(abs(_I_mA) * 1U);
 
+    /*Per-motor output scale measured by the phase resistance identification, 
+    replaces the coefficient that had to be hand-edited for high resistance motors*/
+    bit12val = (bit12val * _out_scale) >> 10;
+
     /*12-bit DAC scaling with 0.1 Ohm shunt mapping*/
 
     /**
@@ -166,6 +171,18 @@ void tb_foc_set_current_vector(uint32_t _dir_inCNT,
     else tb_set_inputB(true, true);
 }
 
+/**
+ * Sets the scaling applied to every FOC output current, it keeps the 
+ * commanded vector inside the current the supply can drive through the phase resistance.
+ * @param _scale Output scale factor (1024 means 1.0).
+ */
+void tb_foc_set_out_scale(uint16_t _scale)
+{
+    if (_scale > 1024) _scale = 1024;
+    if (_scale < 1) _scale = 1;
+    _out_scale = _scale;
+}
+
 /**
  * Deactivates motor driver outputs and enters standby mode, 
  * Zero current output via DAC registers, Disable H-bridge phase 
@@ -55,6 +55,13 @@ typedef struct {
 void tb_foc_set_current_vector(uint32_t _dir_inCNT, 
     int32_t _I_mA);
 
+/**
+ * Sets the scaling applied to every FOC output current, it keeps the 
+ * commanded vector inside the current the supply can drive through the phase resistance.
+ * @param _scale Output scale factor (1024 means 1.0).
+ */
+void tb_foc_set_out_scale(uint16_t _scale);
+
 /**
  * Initializes the GPIOx peripheral according to the specified parameters in the GPIO_Init.
  * @param GPIOx: where x can be (A..G depending on device used) to select the GPIO peripheral
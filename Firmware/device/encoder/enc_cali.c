@@ -11,6 +11,7 @@
 #include "tb67h450.h"
 #include "mt6816.h"
 #include "romf103cb.h"
+#include "setup.h"
 #include "log.h"
 
 /*********************
@@ -19,6 +20,8 @@
 
 #define AUTO_SPEED 2U
 #define FINE_SPEED 1U
+#define SAT_PROBE_TOL 3U /*Vector counts of lean treated as detent and friction*/
+#define SAT_MIN_SCALE 256U /*Lower bound of the identified output scale (0.25)*/
 
 /**********************
  *      TYPEDEFS
@@ -48,7 +51,10 @@ static void _state_fwd_start_execute(_cali_attr_t * cali_p);
 static void _state_bwd_return_execute(_cali_attr_t * cali_p);
 static void _state_bwd_gap_execute(_cali_attr_t * cali_p);
 static void _state_bwd_start_execute(_cali_attr_t * cali_p);
+static void _state_sat_align_execute(_cali_attr_t * cali_p);
+static void _state_sat_probe_execute(_cali_attr_t * cali_p);
 static void _enc_cali_verify();
+static void _enc_cali_sat_solve();
 
 /**********************
  *   GLOBAL FUNCTIONS
@@ -154,6 +160,9 @@ extern _angle_t _angle;
  */
 static void _state_idle_execute(_cali_attr_t * cali_p)
 {
+    /*Calibration and identification drive the coils unscaled*/
+    tb_foc_set_out_scale(1024);
+
     tb_foc_set_current_vector(cali_p->_target, 
         Current_Cali_Current);
 
@@ -286,6 +295,87 @@ static void _state_bwd_start_execute(_cali_attr_t * cali_p)
         Current_Cali_Current);
 
     if (cali_p->_target >= target) return;
+
+    cali_p->state = STATE_SAT_ALIGN;
+    cali_p->sat_tick = 0;
+    cali_p->sat_probe = 0;
+}
+
+/**
+ * State saturated current align callback function, the rotor is brought 
+ * back onto a pure phase A vector and its encoder reading recorded.
+ * @param cali_p pointer to an '_cali_attr_t' cali.
+ * @return next state.
+ */
+static void _state_sat_align_execute(_cali_attr_t * cali_p)
+{
+    /*Move_Pulse_NUM is a multiple of the 1024 counts 
+    electrical cycle, phase B current is zero there*/
+    uint32_t target = Move_Pulse_NUM;
+
+    if (cali_p->_target < target) {
+        cali_p->_target += FINE_SPEED;
+    } else if (cali_p->sat_tick < SAT_SETTLE_TICK) {
+        cali_p->sat_tick++;
+    } else {
+        cali_p->rawbuf[cali_p->raw_num] = _angle.raw;
+        cali_p->raw_num++;
+
+        if (cali_p->raw_num == READ_CNT) {
+            cali_p->sat_ref = \
+                _average(cali_p->rawbuf, READ_CNT, RESOLUTION);
+
+            cali_p->raw_num = 0;
+            cali_p->sat_tick = 0;
+            cali_p->state = STATE_SAT_PROBE;
+        }
+    }
+
+    tb_foc_set_current_vector(cali_p->_target, 
+        Current_Cali_Current);
+}
+
+/**
+ * State saturated current probe callback function, a vector leaning 
+ * SAT_PROBE_ANGLE off phase A is driven at rated current. While phase A 
+ * saturates at supply voltage / phase resistance the small phase B 
+ * current pulls the rotor further than the commanded angle.
+ * @param cali_p pointer to an '_cali_attr_t' cali.
+ * @return next state.
+ */
+static void _state_sat_probe_execute(_cali_attr_t * cali_p)
+{
+    uint32_t target = Move_Pulse_NUM;
+
+    /*Probing both sides cancels the detent and friction bias*/
+    if (cali_p->sat_probe == 0) target += SAT_PROBE_ANGLE;
+    else target -= SAT_PROBE_ANGLE;
+
+    tb_foc_set_current_vector(target, 
+        Current_Rated_Current);
+
+    if (cali_p->sat_tick < SAT_SETTLE_TICK) {
+        cali_p->sat_tick++;
+        return;
+    }
+
+    cali_p->rawbuf[cali_p->raw_num] = _angle.raw;
+    cali_p->raw_num++;
+
+    if (cali_p->raw_num != READ_CNT) return;
+
+    if (cali_p->sat_probe == 0)
+        cali_p->sat_pos = _average(cali_p->rawbuf, 
+            READ_CNT, RESOLUTION);
+    else
+        cali_p->sat_neg = _average(cali_p->rawbuf, 
+            READ_CNT, RESOLUTION);
+
+    cali_p->raw_num = 0;
+    cali_p->sat_tick = 0;
+    cali_p->sat_probe++;
+
+    if (cali_p->sat_probe < 2) return;
     cali_p->state = STATE_SOLVE;
 }
 
@@ -305,6 +395,8 @@ void _enc_cali_tick_work()
     case STATE_BWD_RETURN: _state_bwd_return_execute(&cali); break;
     case STATE_BWD_GAP: _state_bwd_gap_execute(&cali); break;
     case STATE_BWD_START: _state_bwd_start_execute(&cali); break;
+    case STATE_SAT_ALIGN: _state_sat_align_execute(&cali); break;
+    case STATE_SAT_PROBE: _state_sat_probe_execute(&cali); break;
     case STATE_SOLVE: tb_foc_set_current_vector(0, 0); break;
     }
 }
@@ -429,6 +521,42 @@ static void _enc_cali_verify()
     cali.errid = ERR_NO;
 }
 
+/**
+ * Solves the phase current ceiling from the probe readings, the rotor 
+ * settles where tan(angle) = Ib / Ia, with Ib = I * sin(probe) unsaturated 
+ * the real phase A current is I * sin(probe) / tan(angle). The ceiling gives 
+ * the output scale and is stored as it is, the rated current without 
+ * saturation. The phase resistance is not identified, the ceiling 
+ * depends on the supply voltage and the bridge drops as much as on it.
+ */
+static void _enc_cali_sat_solve()
+{
+    float k = 2.0f * 3.1415926f / 1024.0f;
+    float i_probe = (float)Current_Rated_Current;
+    float i_sat = i_probe;
+    float theta = 0.0f;
+    float phi = (float)SAT_PROBE_ANGLE;
+
+    int32_t d_pos = abs(_subtract(cali.sat_pos, 
+        cali.sat_ref, RESOLUTION));
+    int32_t d_neg = abs(_subtract(cali.sat_neg, 
+        cali.sat_ref, RESOLUTION));
+
+    /*Encoder counts to vector counts (1024 per electrical cycle)*/
+    theta = (float)(d_pos + d_neg) * 0.5f * 
+        (float)Move_Pulse_NUM / (float)RESOLUTION;
+
+    if ((theta > phi + SAT_PROBE_TOL) && (theta < 256.0f))
+        i_sat = i_probe * sinf(phi * k) / tanf(theta * k);
+    if (i_sat > i_probe) i_sat = i_probe;
+
+    uint32_t scale = (uint32_t)(i_sat * 1024.0f / i_probe);
+    if (scale < SAT_MIN_SCALE) scale = SAT_MIN_SCALE;
+
+    _setup.out_scale = (uint16_t)scale;
+    _setup.i_sat = (int32_t)i_sat;
+}
+
 /**
  * The collected 200 data (one data collected every 1.8°) are processed linearly interpolated, 
  * and the 200 data are interpolated to 16384 data, 
@@ -535,7 +663,12 @@ void _enc_cali_solve()
     if (cali.errid != ERR_NO) {
         _angle.rectify_valid = false;
         rom_data_clear(&_quick_cali);
-    } else _angle.rectify_valid = true;
+    } else {
+        _angle.rectify_valid = true;
+        /*Store the identified output scale with the settings*/
+        _enc_cali_sat_solve();
+        write_file();
+    }
 
     cali.state = STATE_IDLE;
     cali._start = false;
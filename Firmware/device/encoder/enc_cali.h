@@ -22,6 +22,8 @@
  *********************/
 
 #define READ_CNT 16U /*Data collection amount per hardware acquisition point*/
+#define SAT_PROBE_ANGLE 32U /*Saturated current probe vector offset (11.25° electrical)*/
+#define SAT_SETTLE_TICK 2000U /*Rotor settle time per probe point (100ms at 20kHz)*/
 
 /**********************
  *      TYPEDEFS
@@ -40,6 +42,11 @@ enum {
     STATE_BWD_GAP,
     /**< Backward acquisition of encoder measurements*/
     STATE_BWD_START,
+    /**< Align the rotor on a pure phase A vector*/
+    STATE_SAT_ALIGN,
+    /**< Probe the phase current ceiling with an 
+    asymmetric current vector*/
+    STATE_SAT_PROBE,
     /**< Solving the data*/
     STATE_SOLVE,
 };
@@ -110,6 +117,15 @@ typedef struct {
     int32_t rcd_x;
     int32_t rcd_y;
     uint32_t result_num;
+    /**< Saturated current identification settle 
+    counter and current probe point*/
+    uint16_t sat_tick;
+    uint8_t sat_probe;
+    /**< Encoder readings of the aligned rotor and 
+    of the positive and negative probe vectors*/
+    int32_t sat_ref;
+    int32_t sat_pos;
+    int32_t sat_neg;
 } _cali_attr_t;
 
 /**********************
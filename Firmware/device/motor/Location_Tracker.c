@@ -186,6 +186,53 @@ void Location_Tracker_NewTask(int32_t real_location, int32_t real_speed)
 	location_tck.course_speed_integral = location_tck.course_speed_integral % CONTROL_FREQ_HZ;	\
 }								//(C语言除法运算向0取整，直接取余即可)
 
+/**
+  * 位置跟踪器限位减速, by zhbi98
+  * (目标被限位时,刹停位移达到到限位的距离后以 v²/(2*距离) 减速,正好停在限位处,不越过限位)
+  * @param  location_sub	到限位的位置差
+  * @retval true:限位减速中 / false:按常规规划
+**/
+static bool Location_Tracker_Limit_Brake(int32_t location_sub)
+{
+	float		speed_square = (float)location_tck.course_speed * (float)location_tck.course_speed;
+	float		limit_acc;
+
+	//仅朝向限位运动且刹停位移达到到限位的距离时
+	if(!(((location_sub > 0) && (location_tck.course_speed > 0)) || ((location_sub < 0) && (location_tck.course_speed < 0))))
+		return false;
+	if(speed_square <= 2.0f * (float)location_tck.down_acc * (float)abs(location_sub))
+		return false;
+
+	//需要的减速度超出固件额定减速度(运动中开启限位)->立即停止
+	limit_acc = speed_square / (2.0f * (float)abs(location_sub));
+	if(limit_acc >= (float)_Move_Rated_DownAcc)
+	{
+		location_tck.course_acc_integral = 0;
+		location_tck.course_speed = 0;
+		return true;
+	}
+
+	if(location_tck.course_speed > 0)
+	{
+		Speed_Course_Integral(-(int32_t)limit_acc);
+		if(location_tck.course_speed <= 0)
+		{
+			location_tck.course_acc_integral = 0;
+			location_tck.course_speed = 0;
+		}
+	}
+	else
+	{
+		Speed_Course_Integral((int32_t)limit_acc);
+		if(location_tck.course_speed >= 0)
+		{
+			location_tck.course_acc_integral = 0;
+			location_tck.course_speed = 0;
+		}
+	}
+	return true;
+}
+
 /**
   * 位置跟踪器获得立即位置和立即速度
   * @param  tracker			位置跟踪器实例
@@ -194,11 +241,24 @@ void Location_Tracker_NewTask(int32_t real_location, int32_t real_speed)
 **/
 void Location_Tracker_Capture_Goal(int32_t goal_location)
 {
+	bool		limit_goal = false;		//目标被限位
+
+	//软件限位(目标限制在限位内)
+	if(Move_Limit_Enable)
+	{
+		if(goal_location > Move_Limit_Max + Move_Home_Offset)				{	goal_location = Move_Limit_Max + Move_Home_Offset;	limit_goal = true;	}
+		else if(goal_location < Move_Limit_Min + Move_Home_Offset)	{	goal_location = Move_Limit_Min + Move_Home_Offset;	limit_goal = true;	}
+	}
+
 	//整形位置差
 	int32_t location_sub = goal_location - location_tck.course_location;
 
+	/********************朝向限位减速********************/
+	if((limit_goal) && (Location_Tracker_Limit_Brake(location_sub)))
+	{
+	}
 	/********************到达目标********************/
-	if(location_sub == 0)
+	else if(location_sub == 0)
 	{
 		/******************** 速度小于刹停速度********************/
 		if((location_tck.course_speed >= -location_tck.speed_locking_stop) && (location_tck.course_speed <= location_tck.speed_locking_stop))
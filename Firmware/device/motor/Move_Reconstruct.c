@@ -166,6 +166,60 @@ void Move_Reconstruct_NewTask(int32_t real_location, int32_t real_speed)
 	move_reco.location_course_dec = move_reco.location_course_dec % CONTROL_FREQ_HZ;	\
 }								//(C语言除法运算向0取整，直接取余即可)
 
+/**
+  * 运动重构器软件限位, by zhbi98
+  * (刹停位移 v²/(2*down_acc) 达到到限位的距离后,以 v²/(2*距离) 减速,正好停在限位处)
+  * @param  NULL
+  * @retval true:限位减速中 / false:未触及限位
+**/
+static bool Move_Reconstruct_Limit(void)
+{
+	int32_t	distance;		//运动方向上到限位的距离
+	float		speed_square = (float)move_reco.speed_course * (float)move_reco.speed_course;
+	float		limit_acc;
+
+	if(!Move_Limit_Enable)
+		return false;
+
+	if(move_reco.speed_course > 0)				distance = Move_Limit_Max + Move_Home_Offset - move_reco.location_course;
+	else if(move_reco.speed_course < 0)		distance = move_reco.location_course - (Move_Limit_Min + Move_Home_Offset);
+	else																	return false;
+
+	//刹停位移未达到限位,正常运动
+	if((distance > 0) && (speed_square <= 2.0f * (float)move_reco.down_acc * (float)distance))
+		return false;
+
+	//需要的减速度超出固件额定减速度(限位处或限位外,或运动中开启限位)->立即停止
+	limit_acc = (distance > 0) ? (speed_square / (2.0f * (float)distance)) : (float)_Move_Rated_DownAcc;
+	if(limit_acc >= (float)_Move_Rated_DownAcc)
+	{
+		move_reco.speed_course_dec = 0;
+		move_reco.speed_course = 0;
+		move_reco.location_course_dec = 0;	//清除位置小积分,避免反复起步时越过限位
+		return true;
+	}
+
+	if(move_reco.speed_course > 0)
+	{
+		Speed_Course_Integral(-(int32_t)limit_acc);
+		if(move_reco.speed_course <= 0)
+		{
+			move_reco.speed_course_dec = 0;
+			move_reco.speed_course = 0;
+		}
+	}
+	else
+	{
+		Speed_Course_Integral((int32_t)limit_acc);
+		if(move_reco.speed_course >= 0)
+		{
+			move_reco.speed_course_dec = 0;
+			move_reco.speed_course = 0;
+		}
+	}
+	return true;
+}
+
 /**
   * 运动重构器获得立即位置和立即速度
   * @param  reconstruct		运动重构器实例
@@ -200,7 +254,10 @@ void Move_Reconstruct_Capture_Goal(int32_t goal_location, int32_t goal_speed)
 	}
 
 	//获得运动更改
-	if(move_reco.overtime_flag)
+	if(Move_Reconstruct_Limit())
+	{//软件限位->以正好停在限位处的减速度减速
+	}
+	else if(move_reco.overtime_flag)
 	{//超时->开始减速为0
 		if(move_reco.speed_course == 0)
 		{
@@ -87,6 +87,24 @@ void Speed_Tracker_Set_DownAcc(int32_t value)
 	}
 }
 
+/**
+  * 速度跟踪器设置快速停止减速度
+  * @param  value		减速度
+  * @retval NULL
+**/
+void Speed_Tracker_Set_QuickStopAcc(int32_t value)
+{
+	value = abs(value);
+	if((value > 0) && (value <= _Move_Rated_DownAcc))	//可以高于常规减速度,不超过固件额定减速度
+	{
+		speed_tck.qstop_acc = value;
+		speed_tck.valid_qstop_acc = true;
+	}
+	else{
+		speed_tck.valid_qstop_acc = false;
+	}
+}
+
 /**
   * 速度跟踪器参数恢复
   * @param  NULL
@@ -96,6 +114,7 @@ void Speed_Tracker_Set_Default(void)
 {
 	Speed_Tracker_Set_UpAcc(DE_UP_ACC);
 	Speed_Tracker_Set_DownAcc(DE_DOWN_ACC);
+	Speed_Tracker_Set_QuickStopAcc(DE_QSTOP_ACC);
 }
 
 /**
@@ -108,6 +127,7 @@ void Speed_Tracker_Init(void)
 	//前置配置无效时,加载默认配置
 	if(!speed_tck.valid_up_acc)			{	Speed_Tracker_Set_UpAcc(DE_UP_ACC);			}
 	if(!speed_tck.valid_down_acc)		{	Speed_Tracker_Set_DownAcc(DE_DOWN_ACC);	}
+	if(!speed_tck.valid_qstop_acc)	{	Speed_Tracker_Set_QuickStopAcc(DE_QSTOP_ACC);	}
 	
 	//计算过程数据
 	speed_tck.course_mut = 0;
@@ -205,3 +225,32 @@ void Speed_Tracker_Capture_Goal(int32_t goal_speed)
 	speed_tck.go_speed = (int32_t)speed_tck.course;
 }
 
+/**
+  * 速度跟踪器快速停止(以快速停止减速度从过程速度减到0)
+  * @param  NULL
+  * @retval NULL
+**/
+void Speed_Tracker_Capture_QuickStop(void)
+{
+	if(speed_tck.course > 0)
+	{
+		Speed_Course_Integral(-speed_tck.qstop_acc);
+		if(speed_tck.course <= 0)
+		{
+			speed_tck.course_mut = 0;
+			speed_tck.course = 0;
+		}
+	}
+	else if(speed_tck.course < 0)
+	{
+		Speed_Course_Integral(speed_tck.qstop_acc);
+		if(speed_tck.course >= 0)
+		{
+			speed_tck.course_mut = 0;
+			speed_tck.course = 0;
+		}
+	}
+
+	//输出
+	speed_tck.go_speed = (int32_t)speed_tck.course;
+}
@@ -67,6 +67,10 @@ typedef struct{
 	#define	DE_DOWN_ACC		(Move_Rated_DownAcc / 10)
 	bool		valid_down_acc;
 	int32_t	down_acc;
+	//配置(快速停止减速度)
+	#define	DE_QSTOP_ACC	(_Move_Rated_DownAcc / 4)
+	bool		valid_qstop_acc;
+	int32_t	qstop_acc;
 	//计算过程数据
 	int32_t		course_mut;	//过程加速度积分(放大CONTROL_FREQ_HZ倍)
 	int32_t		course;			//过程速度
@@ -77,11 +81,13 @@ extern Speed_Tracker_Typedef	speed_tck;
 
 void Speed_Tracker_Set_UpAcc(int32_t value);		//速度跟踪器设置加速加速度
 void Speed_Tracker_Set_DownAcc(int32_t value);	//速度跟踪器设置减速加速度
+void Speed_Tracker_Set_QuickStopAcc(int32_t value);	//速度跟踪器设置快速停止减速度
 void Speed_Tracker_Set_Default(void);						//速度跟踪器参数恢复
 
 void Speed_Tracker_Init(void);												//速度跟踪器初始化
 void Speed_Tracker_NewTask(int32_t real_speed);				//速度控制器开始新任务
 void Speed_Tracker_Capture_Goal(int32_t goal_speed);	//速度跟踪器获得立即速度
+void Speed_Tracker_Capture_QuickStop(void);						//速度跟踪器快速停止
 
 #ifdef __cplusplus
 }
@@ -51,6 +51,9 @@ int32_t Move_Rated_UpAcc = _Move_Rated_UpAcc;                     /**< (固件
 int32_t Move_Rated_DownAcc = _Move_Rated_DownAcc;                 /**< (固件额定减速加速度)(1000r/ss)*/
 int32_t Move_Rated_UpCurrentRate = _Move_Rated_UpCurrentRate;     /**< (固件额定增流梯度)(20倍额定/s)*/
 int32_t Move_Rated_DownCurrentRate = _Move_Rated_DownCurrentRate; /**< (固件额定减流梯度)(20倍额定/s)*/
+bool    Move_Limit_Enable = false;                                /**< 软件限位使能*/
+int32_t Move_Limit_Min = ((int32_t)(0));                          /**< 软件限位下限(用户位置,脉冲)*/
+int32_t Move_Limit_Max = ((int32_t)(0));                          /**< 软件限位上限(用户位置,脉冲)*/
 
 /**
  * @brief  控制静态配置
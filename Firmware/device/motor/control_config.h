@@ -52,6 +52,7 @@ extern "C" {
 /********************  硬件配置区  ********************/
 #define _Current_Rated_Current  (3000)  /**< 额定电流(mA)*/
 #define _Current_Cali_Current   (2000)  /**< 校准电流(mA)*/
+#define _Current_Out_Scale      (1024)  /**< 输出缩放系数(1024 即 1.0)*/
 
 /********************  运动参数配置区  ********************/
 #define Move_Step_NUM               ((int32_t)(200))  /**< (使用的电机单圈步数)(每步磁场旋转90°)*/
@@ -63,6 +64,24 @@ extern "C" {
 #define _Move_Rated_UpCurrentRate   ((int32_t)(20 * _Current_Rated_Current))	/**< (固件额定增流梯度)(20倍额定/s)*/
 #define _Move_Rated_DownCurrentRate	((int32_t)(20 * _Current_Rated_Current))	/**< (固件额定减流梯度)(20倍额定/s)*/
 
+/********************  超前角补偿表配置区  ********************/
+#define Lead_Table_NUM    (20)  /**< 超前角补偿表点数*/
+#define Lead_Speed_SHIFT  (17)  /**< 补偿表速度间隔位数(2^17 脉冲/s, 约2.56转/s)*/
+
+/********************  换向角超前配置区  ********************/
+#define Fw_Point_NUM      (4)   /**< 换向角超前断点数*/
+#define Fw_Angle_MAX      ((int16_t)(Move_Divide_NUM * 3 / 4))  /**< 最大超前角(67.5°电角度, 换向角最大157.5°)*/
+
+/********************  输出滤波器配置区  ********************/
+#define Out_Filter_NUM    (4)   /**< 输出双二阶滤波器级数*/
+
+/********************  周期遥测配置区  ********************/
+#define Telem_Frame_NUM   (4)   /**< 周期遥测帧数*/
+#define Telem_Map_NUM     (8)   /**< 每帧映射信号数(8字节内)*/
+
+/********************  抗积分饱和配置区  ********************/
+#define Anti_Windup_SHIFT (4)   /**< 反算增益位数(每周期回馈1/64限幅超出量, 时间常数约3.2ms)*/
+
 /****************************************  控制器频率配置区  ****************************************/
 #define CONTROL_FREQ_HZ   (20000)                     /**< 控制频率_hz*/
 #define CONTROL_PERIOD_US (1000000 / CONTROL_FREQ_HZ) /**< 控制周期_us*/
@@ -81,6 +100,9 @@ extern int32_t Move_Rated_UpAcc;           /**< (固件额定加速加速度)(10
 extern int32_t Move_Rated_DownAcc;         /**< (固件额定减速加速度)(1000r/ss)*/
 extern int32_t Move_Rated_UpCurrentRate;   /**< (固件额定增流梯度)(20倍额定/s)*/
 extern int32_t Move_Rated_DownCurrentRate; /**< (固件额定减流梯度)(20倍额定/s)*/
+extern bool    Move_Limit_Enable;          /**< 软件限位使能*/
+extern int32_t Move_Limit_Min;             /**< 软件限位下限(用户位置,脉冲)*/
+extern int32_t Move_Limit_Max;             /**< 软件限位上限(用户位置,脉冲)*/
 
 #ifdef __cplusplus
 }
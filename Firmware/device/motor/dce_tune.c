@@ -0,0 +1,322 @@
+/**
+ * @file dce_tune.c
+ *
+ * DCE autotune from a relay experiment. The axis is driven in 
+ * current mode by a relay on position: +relay until it passes 
+ * home + window, then -relay until it passes home - window, 
+ * the relay also switches at TUNE_SPEED_LIM for light axes. 
+ * Every 1ms segment gives one row of the regression
+ * 
+ *     m * dw + f * (sgn / 20000) + b * dth = sum_i / 20000
+ * 
+ * solved for the inertia m, Coulomb friction f and viscous 
+ * friction b. dw comes from the filtered est_speed, sum_i from 
+ * the current through the same filter, otherwise the filter lag 
+ * at each relay switch shows up as friction. The DCE gains then place the three closed loop 
+ * poles of m s^3 + (b + Kd) s^2 + Kp s + Ki at -wc.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "dce_tune.h"
+#include "motor_control.h"
+#include "inertia_est.h"
+#include "setup.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define TUNE_TICK_HZ 20000.0
+#define TUNE_MIN_SEG 50U /*Segments needed for a valid regression*/
+#define TUNE_SIG_Q 8U /*Filtered current format Q8 (mA)*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+_dce_tune_t dce_tune = {
+    ._start = false,
+    .state = TUNE_STATE_IDLE,
+};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void _state_ready_execute(_dce_tune_t * tune_p);
+static void _state_relay_execute(_dce_tune_t * tune_p);
+static void _tune_finish(_dce_tune_t * tune_p, _dce_tune_state_t _state);
+static void _seg_restart(_dce_tune_t * tune_p);
+static bool _regression_solve(_dce_tune_t * tune_p);
+static void _gain_design(_dce_tune_t * tune_p);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Start the autotune, the motor must be holding position 
+ * in DCE mode and is free to swing by TUNE_WINDOW_DEF 
+ * around that position.
+ * @param _relay Relay current (mA).
+ * @param _bw Target closed loop bandwidth (Hz), 0 for the default.
+ * @return Whether the autotune was started.
+ */
+bool dce_tune_start(int32_t _relay, uint8_t _bw)
+{
+    if (dce_tune._start) return false;
+    if (motor_control.mode_run != Motor_Mode_Digital_Location) 
+        return false;
+    if ((_relay <= 0) || (_relay > Current_Rated_Current)) 
+        return false;
+
+    dce_tune.relay = _relay;
+    dce_tune.window = TUNE_WINDOW_DEF;
+    dce_tune.bw = (_bw == 0) ? TUNE_BW_DEF : _bw;
+    dce_tune.home = motor_control.est_location;
+
+    for (uint8_t i = 0; i < 3; i++) {
+        for (uint8_t j = 0; j < 3; j++)
+            dce_tune.ata[i][j] = 0.0;
+        dce_tune.atb[i] = 0.0;
+    }
+    dce_tune.tick = 0;
+    dce_tune.seg_ready = false;
+
+    Motor_Control_SetMotorMode(Motor_Mode_Digital_Current);
+    dce_tune.state = TUNE_STATE_READY;
+    dce_tune._start = true;
+    return true;
+}
+
+/**
+ * Called at 20kHz after the motor control callback. In current 
+ * mode the output of the next tick is soft_current, the relay 
+ * overwrites it after the current tracker has run.
+ */
+void dce_tune_tick_work()
+{
+    if (!dce_tune._start) return;
+
+    switch (dce_tune.state) {
+    case TUNE_STATE_READY:
+        _state_ready_execute(&dce_tune);
+        break;
+    case TUNE_STATE_RELAY:
+        _state_relay_execute(&dce_tune);
+        break;
+    default: break;
+    }
+}
+
+/**
+ * The mode order is applied by the next control tick.
+ */
+static void _state_ready_execute(_dce_tune_t * tune_p)
+{
+    if (motor_control.mode_run != Motor_Mode_Digital_Current) 
+        return;
+
+    tune_p->dir = 1;
+    tune_p->cur_last = motor_control.foc_current;
+    tune_p->cur_f = motor_control.foc_current << TUNE_SIG_Q;
+    _seg_restart(tune_p);
+    motor_control.soft_current = tune_p->relay;
+    tune_p->state = TUNE_STATE_RELAY;
+}
+
+/**
+ * Relay on position, accumulate the regression segment 
+ * and hand it to the main loop every TUNE_SEG_TICK.
+ */
+static void _state_relay_execute(_dce_tune_t * tune_p)
+{
+    int32_t _pos = motor_control.est_location - tune_p->home;
+    int32_t _speed = motor_control.est_speed;
+
+    /*Runaway, the load drives the axis or the mode was changed*/
+    if ((motor_control.mode_run != Motor_Mode_Digital_Current) || 
+        (abs(_pos) > (tune_p->window * 4)) || 
+        (abs(_speed) > TUNE_SPEED_MAX)) {
+        _tune_finish(tune_p, TUNE_STATE_ABORT);
+        return;
+    }
+
+    /*est_speed is the position difference through a 1/32 low-pass, 
+    the current that drove it (the one of the previous tick) goes 
+    through the same filter so that dw and sum_i line up*/
+    tune_p->cur_f += ((tune_p->cur_last << TUNE_SIG_Q) - tune_p->cur_f) >> 5;
+    tune_p->cur_last = motor_control.foc_current;
+    tune_p->acc.sum_i += (tune_p->cur_f + (1 << (TUNE_SIG_Q - 1))) >> TUNE_SIG_Q;
+    if (_speed > 0) tune_p->acc.sgn++;
+    else if (_speed < 0) tune_p->acc.sgn--;
+
+    if (++tune_p->seg_tick >= TUNE_SEG_TICK) {
+        tune_p->acc.dw = _speed - tune_p->seg_w;
+        tune_p->acc.dth = motor_control.est_location - tune_p->seg_th;
+        if (!tune_p->seg_ready) {
+            tune_p->seg = tune_p->acc;
+            tune_p->seg_ready = true;
+        }
+        _seg_restart(tune_p);
+    }
+
+    if ((tune_p->dir > 0) && 
+        ((_pos > tune_p->window) || (_speed > TUNE_SPEED_LIM))) 
+        tune_p->dir = -1;
+    else if ((tune_p->dir < 0) && 
+        ((_pos < -tune_p->window) || (_speed < -TUNE_SPEED_LIM))) 
+        tune_p->dir = 1;
+    motor_control.soft_current = tune_p->dir * tune_p->relay;
+
+    if (++tune_p->tick >= TUNE_RUN_TICK) 
+        _tune_finish(tune_p, TUNE_STATE_SOLVE);
+}
+
+/**
+ * Go back to holding the start position in DCE mode, 
+ * the gains are designed later in the main loop.
+ */
+static void _tune_finish(_dce_tune_t * tune_p, _dce_tune_state_t _state)
+{
+    motor_control.soft_current = 0;
+    Motor_Control_Write_Goal_Current(0);
+    Motor_Control_Write_Goal_Location(tune_p->home - Move_Home_Offset);
+    Motor_Control_SetMotorMode(Motor_Mode_Digital_Location);
+
+    tune_p->state = _state;
+    if (_state != TUNE_STATE_SOLVE) tune_p->_start = false;
+}
+
+/**
+ * Start a new regression segment at the present speed and position.
+ */
+static void _seg_restart(_dce_tune_t * tune_p)
+{
+    tune_p->seg_tick = 0;
+    tune_p->seg_w = motor_control.est_speed;
+    tune_p->seg_th = motor_control.est_location;
+    tune_p->acc.sgn = 0;
+    tune_p->acc.sum_i = 0;
+}
+
+/**
+ * Main loop part, accumulate the normal equations from the 
+ * segments and design the gains once the relay has ended.
+ */
+void dce_tune_solve()
+{
+    if (!dce_tune._start) return;
+
+    if (dce_tune.seg_ready) {
+        double x[3], y;
+        x[0] = (double)dce_tune.seg.dw;
+        x[1] = (double)dce_tune.seg.sgn / TUNE_TICK_HZ;
+        x[2] = (double)dce_tune.seg.dth;
+        y = (double)dce_tune.seg.sum_i / TUNE_TICK_HZ;
+        dce_tune.seg_ready = false;
+
+        for (uint8_t i = 0; i < 3; i++) {
+            for (uint8_t j = 0; j < 3; j++)
+                dce_tune.ata[i][j] += x[i] * x[j];
+            dce_tune.atb[i] += x[i] * y;
+        }
+    }
+
+    if (dce_tune.state != TUNE_STATE_SOLVE) return;
+    if (dce_tune.seg_ready) return; /*Last segment first*/
+
+    if (_regression_solve(&dce_tune)) {
+        _gain_design(&dce_tune);
+        dce_tune.state = TUNE_STATE_DONE;
+    }
+    else {
+        dce_tune.state = TUNE_STATE_ABORT;
+    }
+    dce_tune._start = false;
+}
+
+/**
+ * Solve the 3x3 normal equations with Cramer's rule.
+ * @return Whether the estimate is physically valid.
+ */
+static bool _regression_solve(_dce_tune_t * tune_p)
+{
+    double (*a)[3] = tune_p->ata;
+    double * b = tune_p->atb;
+
+    /*Too few segments, the relay barely ran*/
+    if (a[1][1] * TUNE_TICK_HZ * TUNE_TICK_HZ < 
+        (double)TUNE_MIN_SEG * TUNE_SEG_TICK * TUNE_SEG_TICK * 0.5) 
+        return false;
+
+    double det = 
+        a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) - 
+        a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) + 
+        a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+    if (det == 0.0) return false;
+
+    double m = 
+        b[0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) - 
+        a[0][1] * (b[1] * a[2][2] - a[1][2] * b[2]) + 
+        a[0][2] * (b[1] * a[2][1] - a[1][1] * b[2]);
+    double f = 
+        a[0][0] * (b[1] * a[2][2] - a[1][2] * b[2]) - 
+        b[0] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) + 
+        a[0][2] * (a[1][0] * b[2] - b[1] * a[2][0]);
+    double v = 
+        a[0][0] * (a[1][1] * b[2] - b[1] * a[2][1]) - 
+        a[0][1] * (a[1][0] * b[2] - b[1] * a[2][0]) + 
+        b[0] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+
+    m /= det;
+    f /= det;
+    v /= det;
+
+    if (m <= 0.0) return false;
+    if (f < 0.0) f = 0.0;
+    if (v < 0.0) v = 0.0;
+
+    tune_p->inertia = (float)m;
+    tune_p->friction = (float)f;
+    tune_p->viscous = (float)v;
+    return true;
+}
+
+/**
+ * Place the three closed loop poles at -wc: 
+ * Kd = 3 m wc - b, Kp = 3 m wc^2, Ki = m wc^3 (mA, pulse, s), 
+ * converted to the DCE integer gains. The whole stiffness is 
+ * put in kp, kv (which integrates the speed error and so adds 
+ * to the stiffness) is cleared so the design maps one to one.
+ */
+static void _gain_design(_dce_tune_t * tune_p)
+{
+    float wc = 2.0f * 3.1415927f * (float)tune_p->bw;
+    float m = tune_p->inertia;
+
+    float kd_c = 3.0f * m * wc - tune_p->viscous;
+    float kp_c = 3.0f * m * wc * wc;
+    float ki_c = m * wc * wc * wc;
+    if (kd_c < 0.0f) kd_c = 0.0f;
+
+    /*out = (kp * e + kd * ev / 128 + oi) / 1024, 
+    oi += (ki * e) / 128 per tick*/
+    dce.kp = (int32_t)(kp_c * 1024.0f + 0.5f);
+    dce.kd = (int32_t)(kd_c * 131072.0f + 0.5f);
+    dce.ki = (int32_t)(ki_c * 131072.0f / (float)TUNE_TICK_HZ + 0.5f);
+    dce.kv = 0;
+
+    _setup.dce_kp = dce.kp;
+    _setup.dce_kv = dce.kv;
+    _setup.dce_ki = dce.ki;
+    _setup.dce_kd = dce.kd;
+
+    /*The gains fit this inertia, the scheduling refers to it*/
+    _setup.inertia_ref = (int32_t)(m * EST_INERTIA_SCALE);
+    inertia_est_set_ref(_setup.inertia_ref);
+    operate_file(0);
+}
@@ -0,0 +1,112 @@
+/**
+ * @file dce_tune.h
+ *
+ */
+
+#ifndef __DCE_TUNE_H__
+#define __DCE_TUNE_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "control_config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define TUNE_WINDOW_DEF (Move_Pulse_NUM / 16) /*Relay switching position window (22.5deg)*/
+#define TUNE_RUN_TICK 40000U /*Relay experiment length (2s at 20kHz)*/
+#define TUNE_SEG_TICK 20U /*Regression segment length (1ms at 20kHz)*/
+#define TUNE_BW_DEF 20U /*Default closed loop bandwidth (Hz)*/
+#define TUNE_SPEED_LIM (5 * Move_Pulse_NUM) /*Relay also switches above 5r/s*/
+#define TUNE_SPEED_MAX (10 * Move_Pulse_NUM) /*Abort above 10r/s*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+enum {
+    /**< The autotune is idle*/
+    TUNE_STATE_IDLE = 0x00,
+    /**< Wait for the current mode to take over*/
+    TUNE_STATE_READY,
+    /**< Relay experiment running*/
+    TUNE_STATE_RELAY,
+    /**< Regression and gain design pending in the main loop*/
+    TUNE_STATE_SOLVE,
+    /**< Gains computed and stored*/
+    TUNE_STATE_DONE,
+    /**< Aborted, runaway or bad estimate*/
+    TUNE_STATE_ABORT,
+};
+
+/**
+ * Describes the relay experiment and the estimated 
+ * mechanical parameters of the axis.
+ */
+typedef uint8_t _dce_tune_state_t;
+
+/**
+ * One regression segment, over the segment 
+ * m * dw + f * sgn + b * dth = sum_i.
+ */
+typedef struct {
+    int32_t dw; /*Speed change (pulse/s)*/
+    int32_t sgn; /*Ticks moving forward minus ticks moving backward*/
+    int32_t dth; /*Position change (pulse)*/
+    int32_t sum_i; /*Current integral (mA * tick)*/
+} _dce_tune_seg_t;
+
+/**
+ * Describes the relay experiment and the estimated 
+ * mechanical parameters of the axis.
+ */
+typedef struct {
+    /**< Whether to start autotune*/
+    uint8_t _start;
+    /**< Ongoing autotune steps*/
+    _dce_tune_state_t state;
+    /**< Relay current (mA), position window 
+    (pulse) and target bandwidth (Hz)*/
+    int32_t relay;
+    int32_t window;
+    uint8_t bw;
+    /**< Relay direction and position it oscillates around*/
+    int8_t dir;
+    int32_t home;
+    uint32_t tick;
+    /**< Segment being accumulated and the last 
+    completed one handed over to the main loop*/
+    uint16_t seg_tick;
+    int32_t seg_w;
+    int32_t seg_th;
+    _dce_tune_seg_t acc;
+    _dce_tune_seg_t seg;
+    volatile bool seg_ready;
+    /**< Current through the est_speed filter (Q8) 
+    and the current that drives the next tick*/
+    int32_t cur_f;
+    int32_t cur_last;
+    /**< Normal equations of the regression*/
+    double ata[3][3];
+    double atb[3];
+    /**< Inertia mA/(pulse/s^2), Coulomb friction 
+    mA and viscous friction mA/(pulse/s)*/
+    float inertia;
+    float friction;
+    float viscous;
+} _dce_tune_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+bool dce_tune_start(int32_t _relay, uint8_t _bw);
+void dce_tune_tick_work();
+void dce_tune_solve();
+
+#endif /*__DCE_TUNE_H__*/
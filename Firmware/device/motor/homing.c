@@ -0,0 +1,437 @@
+/**
+ * @file homing.c
+ *
+ * On-drive homing, the reference of the axis is found by one of:
+ * - Hard stop, drive into a mechanical stop in speed mode with the
+ *   current limit lowered, the stop is where the speed loop saturates
+ *   while the axis stands still.
+ * - Limit switch (PB0), search the switch, then back off at the latch
+ *   speed, the release edge is the reference.
+ * - Absolute angle, the location nearest to the present position with
+ *   the configured single-turn encoder angle is the reference.
+ * The reference is given the configured user position and the axis
+ * moves to user zero afterwards. The software position limits are
+ * suspended while searching.
+ *
+ * Position capture, PB0 and PB1 edges are timestamped in the EXTI
+ * interrupt with the cycle counter (DWT), the EXTI preempts the
+ * control tick so an edge during the tick is not stamped late. The
+ * next tick converts the stamp to its own time and interpolates the
+ * position back with the estimated speed, the capture does not depend
+ * on the 50us control period. The timestamps are on the control tick
+ * clock (clk_sync), the master's time once locked.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "homing.h"
+#include "motor_control.h"
+#include "Location_Tracker.h"
+#include "Speed_Tracker.h"
+#include "setup.h"
+#include "tim.h"
+#include "clk_sync.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+_homing_t homing = {
+    ._start = false,
+    .state = HOME_STATE_IDLE,
+    .homed = false,
+    .result = HOME_RESULT_NONE,
+};
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static const uint16_t cap_pin[HOME_CAP_NUM] = {
+    GPIO_PIN_0, GPIO_PIN_1,
+};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static bool _home_input(uint8_t _ch);
+static void _home_cap_convert(_home_cap_t * cap_p, uint32_t _tick_cyc, uint32_t _cyc_us);
+static void _home_speed(_homing_t * home_p, int32_t _speed);
+static void _home_restore(_homing_t * home_p);
+static bool _home_out_of_range(_homing_t * home_p);
+static bool _home_lost(_homing_t * home_p);
+static void _state_idle_execute(_homing_t * home_p);
+static void _state_search_execute(_homing_t * home_p);
+static void _state_latch_execute(_homing_t * home_p);
+static void _state_move_execute(_homing_t * home_p);
+static void _state_arrive_execute(_homing_t * home_p);
+static void _state_fail_execute(_homing_t * home_p);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Start homing with the stored parameters,
+ * a running homing is not restarted.
+ */
+void homing_start()
+{
+    if (homing._start) return;
+    homing.result = HOME_RESULT_NONE;
+    homing.state = HOME_STATE_IDLE;
+    homing._start = true;
+}
+
+/**
+ * Abort a running homing, the axis
+ * decelerates to rest.
+ */
+void homing_abort()
+{
+    if (!homing._start) return;
+    homing.result = HOME_RESULT_ABORT;
+    homing.state = HOME_STATE_FAIL;
+}
+
+/**
+ * Timestamp an input edge, called from the EXTI interrupt.
+ * The EXTI preempts the control tick, only the raw stamp
+ * is written here, the tick converts it.
+ * @param _ch Capture input (HOME_CAP_LIMIT or HOME_CAP_INDEX).
+ */
+void homing_capture(uint8_t _ch)
+{
+    if (_ch >= HOME_CAP_NUM) return;
+
+    _home_cap_t * cap_p = &homing.cap[_ch];
+    /*Stamp first, the count published after it*/
+    cap_p->raw_cyc = DWT->CYCCNT;
+    cap_p->raw_edges++;
+}
+
+/**
+ * Keep the capture time base and run the homing
+ * sequence, called at 20kHz after the motor
+ * control callback.
+ */
+void homing_tick_work()
+{
+    /*Cycle count of this tick's update, the TIM2 counter 
+    (1MHz) runs from the update*/
+    uint32_t _cyc_us = SystemCoreClock / 1000000U;
+    uint32_t _tick_cyc = DWT->CYCCNT - clk_sync_elapsed() * _cyc_us;
+
+    for (uint8_t i = 0; i < HOME_CAP_NUM; i++) {
+        homing.cap[i].active = _home_input(i);
+        _home_cap_convert(&homing.cap[i], _tick_cyc, _cyc_us);
+    }
+
+    if (!homing._start) return;
+
+    /*Without the output the hard stop is never detected (the 
+    current stays 0) and user zero never reached, fail instead 
+    of keeping the lowered current and the suspended limits*/
+    if (((homing.state == HOME_STATE_SEARCH) || 
+        (homing.state == HOME_STATE_LATCH) || 
+        (homing.state == HOME_STATE_ARRIVE)) && _home_lost(&homing)) {
+        homing.result = HOME_RESULT_MODE;
+        homing.state = HOME_STATE_FAIL;
+    }
+
+    switch (homing.state) {
+    case HOME_STATE_IDLE:
+        _state_idle_execute(&homing);
+        break;
+    case HOME_STATE_SEARCH:
+        _state_search_execute(&homing);
+        break;
+    case HOME_STATE_LATCH:
+        _state_latch_execute(&homing);
+        break;
+    case HOME_STATE_MOVE:
+        _state_move_execute(&homing);
+        break;
+    case HOME_STATE_ARRIVE:
+        _state_arrive_execute(&homing);
+        break;
+    case HOME_STATE_FAIL:
+        _state_fail_execute(&homing);
+        break;
+    }
+}
+
+/**
+ * Read a capture input.
+ * @param _ch Capture input.
+ * @return Whether the input is active.
+ */
+static bool _home_input(uint8_t _ch)
+{
+    bool _high = (HAL_GPIO_ReadPin(GPIOB,
+        cap_pin[_ch]) == GPIO_PIN_SET);
+    return _high == _setup.home_polarity;
+}
+
+/**
+ * Convert the raw edge stamp of a capture input to the
+ * time and the position, called from the control tick.
+ * @param _tick_cyc Cycle count of this tick's update.
+ * @param _cyc_us Cycles per microsecond.
+ */
+static void _home_cap_convert(_home_cap_t * cap_p, uint32_t _tick_cyc, uint32_t _cyc_us)
+{
+    uint16_t _edges;
+    uint32_t _cyc;
+
+    /*The EXTI preempts the tick, read again if 
+    an edge came between the two reads*/
+    do {
+        _edges = cap_p->raw_edges;
+        _cyc = cap_p->raw_cyc;
+    } while (_edges != cap_p->raw_edges);
+
+    if (_edges == cap_p->seen) return;
+    cap_p->edges += (uint16_t)(_edges - cap_p->seen);
+    cap_p->seen = _edges;
+
+    /*Negative, the edge came before this tick's update, 
+    the position is interpolated back from this tick*/
+    int32_t _dt = (int32_t)(_cyc - _tick_cyc) / (int32_t)_cyc_us;
+    cap_p->time_us = clk_sync.time_us + _dt;
+    cap_p->location = motor_control.real_location + 
+        (int32_t)((int64_t)motor_control.est_speed * _dt / 1000000);
+}
+
+/**
+ * Move at a constant speed in speed mode,
+ * bounded by the rated speed.
+ * @param _speed Speed (pulse/s).
+ */
+static void _home_speed(_homing_t * home_p, int32_t _speed)
+{
+    if (_speed > Move_Rated_Speed) _speed = Move_Rated_Speed;
+    else if (_speed < -Move_Rated_Speed) _speed = -Move_Rated_Speed;
+
+    home_p->speed = _speed;
+    home_p->start_loc = motor_control.real_location;
+    home_p->tick = 0;
+    home_p->mode = Motor_Mode_Digital_Speed;
+    Motor_Control_SetMotorMode(Motor_Mode_Digital_Speed);
+    Motor_Control_Write_Goal_Speed(_speed);
+}
+
+/**
+ * Restore the current limit lowered for hard stop
+ * homing and the software position limits.
+ */
+static void _home_restore(_homing_t * home_p)
+{
+    Motor_Control_SetPosLimit(_setup.pos_limit, 
+        _setup.pos_min, _setup.pos_max);
+
+    if (!home_p->current_set) return;
+    Current_Rated_Current = home_p->saved_current;
+    home_p->current_set = false;
+}
+
+/**
+ * Whether the axis moved further than the search
+ * range since the search or latch started.
+ */
+static bool _home_out_of_range(_homing_t * home_p)
+{
+    return abs(motor_control.real_location -
+        home_p->start_loc) > _setup.home_range;
+}
+
+/**
+ * Whether the axis no longer runs in the mode homing set, 
+ * the mode order of the previous state has been applied 
+ * by the control tick before this one.
+ */
+static bool _home_lost(_homing_t * home_p)
+{
+    return (motor_control.mode_order != home_p->mode) || 
+        (motor_control.mode_run != home_p->mode) || 
+        (!Motor_Control_OutputRunning()) || 
+        (motor_control.qstop_active);
+}
+
+/**
+ * Take the parameters and start the
+ * search of the selected method.
+ */
+static void _state_idle_execute(_homing_t * home_p)
+{
+    int32_t _d = 0;
+
+    /*The limits are user positions, not valid
+    before the reference is found*/
+    Motor_Control_SetPosLimit(false, 0, 0);
+
+    home_p->method = _setup.home_method;
+    home_p->dir = _setup.home_dir ? -1 : 1;
+    for (uint8_t i = 0; i < HOME_CAP_NUM; i++)
+        home_p->cap[i].edges = 0;
+
+    switch (home_p->method) {
+    case HOME_METHOD_HARD_STOP:
+        /*Lower the current limit so that
+        the stop is hit with a bounded force, 
+        a track mode limit (0x3C) is dropped first*/
+        Motor_Control_Write_Track_Current(0);
+        home_p->saved_current = Current_Rated_Current;
+        home_p->current_set = true;
+        if (_setup.home_current < Current_Rated_Current)
+            Current_Rated_Current = _setup.home_current;
+        _home_speed(home_p, home_p->dir * _setup.home_search);
+        home_p->state = HOME_STATE_SEARCH;
+        break;
+    case HOME_METHOD_SWITCH:
+        /*Already on the switch, only back off*/
+        if (_home_input(HOME_CAP_LIMIT)) {
+            _home_speed(home_p, -home_p->dir * _setup.home_latch);
+            home_p->state = HOME_STATE_LATCH;
+        } else {
+            _home_speed(home_p, home_p->dir * _setup.home_search);
+            home_p->state = HOME_STATE_SEARCH;
+        }
+        break;
+    case HOME_METHOD_ABS_ANGLE:
+        _d = motor_control.real_lap_location - _setup.home_angle;
+        _d %= Move_Pulse_NUM;
+        if (_d >= (Move_Pulse_NUM >> 1)) _d -= Move_Pulse_NUM;
+        else if (_d < -(Move_Pulse_NUM >> 1)) _d += Move_Pulse_NUM;
+        home_p->reference = motor_control.real_location - _d;
+        home_p->state = HOME_STATE_MOVE;
+        break;
+    default:
+        home_p->result = HOME_RESULT_METHOD;
+        home_p->state = HOME_STATE_FAIL;
+        break;
+    }
+}
+
+/**
+ * Search the reference at the search speed, a hard stop
+ * saturates the speed loop once the speed tracker has
+ * reached the search speed but the axis stands still.
+ */
+static void _state_search_execute(_homing_t * home_p)
+{
+    if (_home_out_of_range(home_p)) {
+        home_p->result = HOME_RESULT_RANGE;
+        home_p->state = HOME_STATE_FAIL;
+        return;
+    }
+
+    if (home_p->method == HOME_METHOD_SWITCH) {
+        /*The edge count also catches a
+        cam passed within one tick*/
+        if ((home_p->cap[HOME_CAP_LIMIT].edges == 0) &&
+            (!_home_input(HOME_CAP_LIMIT))) return;
+        home_p->cap[HOME_CAP_LIMIT].edges = 0;
+        _home_speed(home_p, -home_p->dir * _setup.home_latch);
+        home_p->state = HOME_STATE_LATCH;
+        return;
+    }
+
+    if ((speed_tck.go_speed == home_p->speed) &&
+        (abs(motor_control.foc_current) >= Current_Rated_Current) &&
+        (abs(motor_control.est_speed) < (abs(home_p->speed) >> 2))) {
+        if (++home_p->tick < HOME_STOP_TICK) return;
+        home_p->reference = motor_control.real_location;
+        home_p->state = HOME_STATE_MOVE;
+    } else {
+        home_p->tick = 0;
+    }
+}
+
+/**
+ * Back off the switch at the latch speed, the last
+ * edge is the release once the input stays inactive.
+ */
+static void _state_latch_execute(_homing_t * home_p)
+{
+    if (_home_out_of_range(home_p)) {
+        home_p->result = HOME_RESULT_RANGE;
+        home_p->state = HOME_STATE_FAIL;
+        return;
+    }
+
+    if ((home_p->cap[HOME_CAP_LIMIT].edges == 0) ||
+        (_home_input(HOME_CAP_LIMIT))) {
+        home_p->tick = 0;
+        return;
+    }
+    if (++home_p->tick < HOME_RELEASE_TICK) return;
+
+    home_p->reference = home_p->cap[HOME_CAP_LIMIT].location;
+    home_p->state = HOME_STATE_MOVE;
+}
+
+/**
+ * Give the reference the configured user
+ * position and move to user zero.
+ */
+static void _state_move_execute(_homing_t * home_p)
+{
+    _home_restore(home_p);
+
+    Move_Home_Offset = home_p->reference - _setup.home_pos;
+    home_p->homed = true;
+
+    home_p->mode = Motor_Mode_Digital_Location;
+    Motor_Control_SetMotorMode(Motor_Mode_Digital_Location);
+    Motor_Control_Write_Goal_Location(0);
+    home_p->tick = 0;
+    home_p->state = HOME_STATE_ARRIVE;
+}
+
+/**
+ * Homing is done once the position
+ * tracker has reached user zero.
+ */
+static void _state_arrive_execute(_homing_t * home_p)
+{
+    if (location_tck.go_location != motor_control.goal_location) {
+        home_p->tick = 0;
+        return;
+    }
+    if (++home_p->tick < HOME_ARRIVE_TICK) return;
+
+    /*With the multi-turn position kept over power
+    cycles the reference stays valid, store it*/
+    if (_setup.pos_keep) {
+        _setup.home_ofs = Move_Home_Offset;
+        operate_file(0);
+    }
+
+    home_p->result = HOME_RESULT_DONE;
+    home_p->report = true;
+    home_p->state = HOME_STATE_IDLE;
+    home_p->_start = false;
+}
+
+/**
+ * Restore the current limit and bring
+ * a searching axis to rest.
+ */
+static void _state_fail_execute(_homing_t * home_p)
+{
+    _home_restore(home_p);
+    if (motor_control.mode_order == Motor_Mode_Digital_Speed)
+        Motor_Control_Write_Goal_Speed(0);
+
+    home_p->report = true;
+    home_p->state = HOME_STATE_IDLE;
+    home_p->_start = false;
+}
@@ -0,0 +1,146 @@
+/**
+ * @file homing.h
+ *
+ */
+
+#ifndef __HOMING_H__
+#define __HOMING_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "control_config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define HOME_STOP_TICK 400U /*Hard stop confirmed after 20ms at the current limit*/
+#define HOME_RELEASE_TICK 20U /*Switch release debounce (1ms at 20kHz)*/
+#define HOME_ARRIVE_TICK 200U /*Settle at the reference position (10ms at 20kHz)*/
+
+#define HOME_CAP_NUM 2U /*Capture inputs*/
+#define HOME_CAP_LIMIT 0U /*PB0, limit (home) switch*/
+#define HOME_CAP_INDEX 1U /*PB1, index or probe input*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+enum {
+    /**< Drive into a mechanical stop at a reduced current*/
+    HOME_METHOD_HARD_STOP = 0x00,
+    /**< Search the limit switch, latch its release edge*/
+    HOME_METHOD_SWITCH,
+    /**< Take the nearest encoder angle as the reference*/
+    HOME_METHOD_ABS_ANGLE,
+};
+
+enum {
+    /**< Homing is idle*/
+    HOME_STATE_IDLE = 0x00,
+    /**< Move at the search speed towards the reference*/
+    HOME_STATE_SEARCH,
+    /**< Back off the switch at the latch speed*/
+    HOME_STATE_LATCH,
+    /**< Apply the reference and move to user zero*/
+    HOME_STATE_MOVE,
+    /**< Wait for the move to finish*/
+    HOME_STATE_ARRIVE,
+    /**< Homing aborted or the reference was not found*/
+    HOME_STATE_FAIL,
+};
+
+enum {
+    /**< No homing run finished yet*/
+    HOME_RESULT_NONE = 0x00,
+    /**< The reference was found*/
+    HOME_RESULT_DONE,
+    /**< Nothing found within the search range*/
+    HOME_RESULT_RANGE,
+    /**< Aborted by command*/
+    HOME_RESULT_ABORT,
+    /**< Unknown method*/
+    HOME_RESULT_METHOD,
+    /**< The output stopped (disable, stall) or 
+    another command changed the mode*/
+    HOME_RESULT_MODE,
+};
+
+/**
+ * Describes the homing sequence that
+ * finds the reference of the axis.
+ */
+typedef uint8_t _homing_state_t;
+
+/**
+ * Describes one position capture input, the edge is
+ * timestamped in the EXTI interrupt and converted to
+ * time and position by the next control tick.
+ */
+typedef struct {
+    /**< Input is active (after the polarity), 
+    sampled every control tick*/
+    bool active;
+    /**< Edges captured since the last clear*/
+    uint16_t edges;
+    /**< Time of the last edge (us)*/
+    uint32_t time_us;
+    /**< Position at the last edge (pulse)*/
+    int32_t location;
+    /**< Written by the EXTI interrupt only, edges seen 
+    and cycle count (DWT) of the last one, the count is 
+    the sequence the cycle count is read under*/
+    volatile uint16_t raw_edges;
+    volatile uint32_t raw_cyc;
+    /**< Raw edges already converted by the tick*/
+    uint16_t seen;
+} _home_cap_t;
+
+/**
+ * Describes the homing sequence that
+ * finds the reference of the axis.
+ */
+typedef struct {
+    /**< Whether to start homing*/
+    uint8_t _start;
+    /**< Ongoing homing steps*/
+    _homing_state_t state;
+    /**< Method and search direction (+1 or -1)*/
+    uint8_t method;
+    int8_t dir;
+    /**< Mode set by homing (Motor_Mode)*/
+    uint8_t mode;
+    /**< Commanded search or latch speed (pulse/s)*/
+    int32_t speed;
+    /**< Position the search started from*/
+    int32_t start_loc;
+    /**< Debounce and settle counter*/
+    uint16_t tick;
+    /**< Rated current restored after homing*/
+    int32_t saved_current;
+    bool current_set;
+    /**< Reference position found (pulse)*/
+    int32_t reference;
+    /**< A reference is applied since power-up*/
+    bool homed;
+    /**< Outcome of the last run*/
+    uint8_t result;
+    /**< Pending homing report (CAN async frame)*/
+    bool report;
+    _home_cap_t cap[HOME_CAP_NUM];
+} _homing_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void homing_start();
+void homing_abort();
+void homing_capture(uint8_t _ch);
+void homing_tick_work();
+
+#endif /*__HOMING_H__*/
@@ -0,0 +1,194 @@
+/**
+ * @file inertia_est.c
+ *
+ * Online inertia and friction estimate for the DCE gain scheduling. 
+ * Every 5ms segment the position second difference (the change of 
+ * the mean speed, free of the est_speed noise), the current integral 
+ * between the segment centres and the time spent moving in each 
+ * direction give one regression row, the 2x2 normal equations are 
+ * weighted with a forgetting factor (the information form of 
+ * recursive least squares) and solved in 64 bit fixed point. 
+ * The DCE gains scale linearly with the inertia for a fixed 
+ * bandwidth, so the DCE output is scaled by inertia / inertia_ref.
+ *
+ * ISR cost: a few adds per tick, about 400 cycles (two 64 bit 
+ * divisions) once per 5ms segment on excited segments only.
+ * Viscous friction is not modelled, it folds into the Coulomb term.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "inertia_est.h"
+#include "motor_control.h"
+#include <stdlib.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define SUM_SHIFT 6U /*Current integral regressor, mA * tick / 64*/
+#define DET_MIN ((int64_t)1 << 10) /*Minimum determinant / 2^16 for a valid solve*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+_inertia_est_t inertia_est = {
+    .sched = false,
+    .valid = false,
+    .gain = 1024,
+};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void _seg_restart(_inertia_est_t * est_p);
+static void _seg_update(_inertia_est_t * est_p, 
+    int32_t _d2, int32_t _sum_i, int32_t _sgn);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Set the inertia the DCE gains were designed for.
+ * @param _ref Inertia (Q16, see EST_INERTIA_SCALE), 0 disables the scheduling.
+ */
+void inertia_est_set_ref(int32_t _ref)
+{
+    inertia_est.inertia_ref = (_ref > 0) ? _ref : 0;
+}
+
+/**
+ * Switch the gain scheduling of the DCE output.
+ * @param _en Whether the DCE output follows the estimated inertia.
+ */
+void inertia_est_set_sched(bool _en)
+{
+    inertia_est.sched = _en;
+}
+
+/**
+ * Scheduled DCE output gain, 1.0 until the 
+ * estimate is valid or without a reference.
+ * @return Gain (1024 = 1.0).
+ */
+int32_t inertia_est_gain()
+{
+    return inertia_est.sched ? inertia_est.gain : 1024;
+}
+
+/**
+ * Called at 20kHz after the motor control callback.
+ */
+void inertia_est_tick_work()
+{
+    _inertia_est_t * est_p = &inertia_est;
+
+    /*Asleep (disable, stall, quick-stop done, overtemp) the current 
+    reads 0 while the axis may coast or fall, shorted windings brake 
+    the rotor, the model does not hold*/
+    if (!Motor_Control_OutputRunning()) {
+        _seg_restart(est_p);
+        return;
+    }
+
+    est_p->sum_i += motor_control.foc_current;
+    if (motor_control.est_speed > 0) est_p->sgn++;
+    else if (motor_control.est_speed < 0) est_p->sgn--;
+
+    ++est_p->seg_tick;
+    if (est_p->seg_tick == (EST_SEG_TICK / 2)) {
+        est_p->sum_i1 = est_p->sum_i;
+        est_p->sgn1 = est_p->sgn;
+        est_p->sum_i = 0;
+        est_p->sgn = 0;
+        return;
+    }
+    if (est_p->seg_tick < EST_SEG_TICK) return;
+
+    /*The mean speeds of two segments differ by d2 * 20000 / T, 
+    the current integral between the segment centres drives it*/
+    int32_t _dth = motor_control.est_location - est_p->seg_th;
+    if (est_p->dth_valid) {
+        int32_t d2 = _dth - est_p->dth;
+        if (abs(d2) >= EST_D2_MIN) 
+            _seg_update(est_p, d2, 
+                est_p->sum_i2 + est_p->sum_i1, 
+                est_p->sgn2 + est_p->sgn1);
+    }
+
+    est_p->dth = _dth;
+    est_p->dth_valid = true;
+    est_p->sum_i2 = est_p->sum_i;
+    est_p->sgn2 = est_p->sgn;
+    est_p->seg_th = motor_control.est_location;
+    est_p->seg_tick = 0;
+    est_p->sum_i = 0;
+    est_p->sgn = 0;
+}
+
+/**
+ * Drop the previous segment and start 
+ * a new one at the present position.
+ */
+static void _seg_restart(_inertia_est_t * est_p)
+{
+    est_p->seg_tick = 0;
+    est_p->seg_th = motor_control.est_location;
+    est_p->sum_i = 0;
+    est_p->sgn = 0;
+    est_p->dth_valid = false;
+}
+
+/**
+ * Add one row to the weighted normal equations and solve 
+ * them, over a segment T (ticks) the row reads 
+ * sum_i = m * 20000^2 / T * d2 + f * sgn, the regressors 
+ * are bounded so that every product stays within 64 bit 
+ * (|x1| <= 8191, |x2| <= 100, |y| <= 4700).
+ */
+static void _seg_update(_inertia_est_t * est_p, 
+    int32_t _d2, int32_t _sum_i, int32_t _sgn)
+{
+    int32_t x1 = _d2;
+    int32_t x2 = _sgn;
+    int32_t y = _sum_i >> SUM_SHIFT;
+
+    if (x1 > 8191) x1 = 8191;
+    else if (x1 < -8191) x1 = -8191;
+
+    est_p->r11 += (int64_t)x1 * x1 - (est_p->r11 >> EST_FORGET_BIT);
+    est_p->r12 += (int64_t)x1 * x2 - (est_p->r12 >> EST_FORGET_BIT);
+    est_p->r22 += (int64_t)x2 * x2 - (est_p->r22 >> EST_FORGET_BIT);
+    est_p->q1 += (int64_t)x1 * y - (est_p->q1 >> EST_FORGET_BIT);
+    est_p->q2 += (int64_t)x2 * y - (est_p->q2 >> EST_FORGET_BIT);
+
+    int64_t det = est_p->r11 * est_p->r22 - est_p->r12 * est_p->r12;
+    int64_t num1 = est_p->r22 * est_p->q1 - est_p->r12 * est_p->q2;
+    int64_t num2 = est_p->r11 * est_p->q2 - est_p->r12 * est_p->q1;
+
+    det >>= 16;
+    if (det < DET_MIN) return;
+
+    int64_t _inertia = num1 / det;
+    int64_t _friction = num2 / det; /*f / 64 in Q16*/
+    if (_inertia <= 0) return;
+
+    est_p->inertia = (int32_t)_inertia;
+    est_p->friction = (_friction > 0) ? (int32_t)(_friction >> 10) : 0;
+    est_p->valid = true;
+
+    if (est_p->inertia_ref == 0) {
+        est_p->gain = 1024;
+        return;
+    }
+
+    int64_t _gain = ((int64_t)est_p->inertia << 10) / est_p->inertia_ref;
+    if (_gain < EST_GAIN_MIN) _gain = EST_GAIN_MIN;
+    else if (_gain > EST_GAIN_MAX) _gain = EST_GAIN_MAX;
+    est_p->gain = (uint16_t)_gain;
+}
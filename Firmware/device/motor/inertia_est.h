@@ -0,0 +1,77 @@
+/**
+ * @file inertia_est.h
+ *
+ */
+
+#ifndef __INERTIA_EST_H__
+#define __INERTIA_EST_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "control_config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define EST_SEG_TICK 100U /*Regression segment length (5ms at 20kHz)*/
+#define EST_FORGET_BIT 8U /*Forgetting factor 1 - 1/256, about 256 excited segments*/
+#define EST_D2_MIN 5 /*Minimum position second difference (pulse), about 4r/s^2*/
+#define EST_GAIN_MIN 512U /*Scheduled gain range (1024 = 1.0)*/
+#define EST_GAIN_MAX 4096U
+#define EST_INERTIA_SCALE (62500.0f * 65536.0f) /*inertia = m(mA/(pulse/s^2)) * EST_INERTIA_SCALE*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * Describes the exponentially weighted least squares 
+ * estimate of the inertia and the Coulomb friction.
+ */
+typedef struct {
+    /**< Gain scheduling of the DCE output*/
+    bool sched;
+    /**< Enough excitation for a valid estimate*/
+    bool valid;
+    /**< Half segment being accumulated, current 
+    integral (mA * tick) and direction ticks*/
+    uint16_t seg_tick;
+    int32_t sum_i;
+    int32_t sgn;
+    /**< First half of this segment and 
+    second half of the previous one*/
+    int32_t sum_i1, sgn1;
+    int32_t sum_i2, sgn2;
+    /**< Segment start position and 
+    position change of the previous segment*/
+    int32_t seg_th;
+    int32_t dth;
+    bool dth_valid;
+    /**< Weighted normal equations*/
+    int64_t r11, r12, r22;
+    int64_t q1, q2;
+    /**< Inertia (Q16, see EST_INERTIA_SCALE) 
+    and Coulomb friction (mA)*/
+    int32_t inertia;
+    int32_t friction;
+    /**< Inertia the DCE gains were designed for*/
+    int32_t inertia_ref;
+    /**< Scheduled DCE output gain (1024 = 1.0)*/
+    uint16_t gain;
+} _inertia_est_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void inertia_est_set_ref(int32_t _ref);
+void inertia_est_set_sched(bool _en);
+int32_t inertia_est_gain();
+void inertia_est_tick_work();
+
+#endif /*__INERTIA_EST_H__*/
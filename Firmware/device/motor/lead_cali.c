@@ -0,0 +1,254 @@
+/**
+ * @file lead_cali.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "lead_cali.h"
+#include "motor_control.h"
+#include "setup.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+_lead_cali_t lead_cali = {
+    ._start = false,
+    .state = LEAD_STATE_IDLE,
+};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void _state_idle_execute(_lead_cali_t * lead_p);
+static void _state_speed_execute(_lead_cali_t * lead_p);
+static void _state_settle_execute(_lead_cali_t * lead_p);
+static void _state_measure_execute(_lead_cali_t * lead_p);
+static void _state_finish_execute(_lead_cali_t * lead_p);
+static void _state_stop_execute(_lead_cali_t * lead_p);
+static void _lead_restore(_lead_cali_t * lead_p);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Start the lead angle characterisation, the motor 
+ * must be free to spin up to the rated speed with a 
+ * constant (or no) load during the sweep.
+ */
+void lead_cali_start()
+{
+    if (lead_cali._start) return;
+    lead_cali.mode_prev = motor_control.mode_order;
+    lead_cali.state = LEAD_STATE_IDLE;
+    lead_cali._start = true;
+}
+
+/**
+ * Discard the measured lead angle table and 
+ * fall back to the built-in DPS table.
+ */
+void lead_cali_discard()
+{
+    if (lead_cali._start) return;
+    _setup.lead_valid = false;
+    Motor_Control_SetLeadTable(
+        _setup.lead_table, false);
+}
+
+/**
+ * The lead angle is swept at each speed breakpoint in 
+ * speed mode, at a steady speed the speed loop output 
+ * only balances the load torque, so the lead angle 
+ * with the lowest current vector magnitude is the 
+ * one that gives the most torque per ampere.
+ * Called at 20kHz after the motor control callback.
+ */
+void lead_cali_tick_work()
+{
+    if (!lead_cali._start) return;
+
+    /*The output was turned off (disable, stall, quick-stop) or 
+    another command changed the mode, the current no longer 
+    measures the lead angle*/
+    if ((lead_cali.state != LEAD_STATE_IDLE) && 
+        ((motor_control.mode_run != Motor_Mode_Digital_Speed) || 
+        (!Motor_Control_OutputRunning()) || (motor_control.qstop_active))) {
+        if (lead_cali.state != LEAD_STATE_STOP) {
+            /*The table is only stored by a complete sweep*/
+            mc_lead.probe = false;
+            lead_cali.state = LEAD_STATE_ABORT;
+        }
+        else lead_cali.state = LEAD_STATE_IDLE;
+        _lead_restore(&lead_cali);
+        return;
+    }
+
+    switch (lead_cali.state) {
+    case LEAD_STATE_IDLE:
+        _state_idle_execute(&lead_cali);
+        break;
+    case LEAD_STATE_SPEED:
+        _state_speed_execute(&lead_cali);
+        break;
+    case LEAD_STATE_SETTLE:
+        _state_settle_execute(&lead_cali);
+        break;
+    case LEAD_STATE_MEASURE:
+        _state_measure_execute(&lead_cali);
+        break;
+    case LEAD_STATE_FINISH:
+        _state_finish_execute(&lead_cali);
+        break;
+    case LEAD_STATE_STOP:
+        _state_stop_execute(&lead_cali);
+        break;
+    default: break;
+    }
+}
+
+/**
+ * The zero speed breakpoint needs no lead angle, 
+ * switch to speed mode and start from the first 
+ * non-zero breakpoint.
+ */
+static void _state_idle_execute(_lead_cali_t * lead_p)
+{
+    lead_p->table[0] = 0;
+    lead_p->point = 1;
+    mc_lead.probe_lead = 0;
+    mc_lead.probe = true;
+    Motor_Control_SetMotorMode(Motor_Mode_Digital_Speed);
+    lead_p->state = LEAD_STATE_SPEED;
+}
+
+/**
+ * Command the speed of the breakpoint under test, the 
+ * search starts from the optimum of the previous 
+ * breakpoint since the lead angle grows with speed.
+ */
+static void _state_speed_execute(_lead_cali_t * lead_p)
+{
+    int32_t _speed = (int32_t)lead_p->point << Lead_Speed_SHIFT;
+
+    if (_speed > Move_Rated_Speed) {
+        lead_p->state = LEAD_STATE_FINISH;
+        return;
+    }
+
+    Motor_Control_Write_Goal_Speed(_speed);
+    mc_lead.probe_lead = lead_p->table[lead_p->point - 1];
+    lead_p->best_lead = mc_lead.probe_lead;
+    lead_p->best_current = INT32_MAX;
+    lead_p->tick = 0;
+    lead_p->state = LEAD_STATE_SETTLE;
+}
+
+/**
+ * Wait for the speed tracker and 
+ * the speed loop to settle.
+ */
+static void _state_settle_execute(_lead_cali_t * lead_p)
+{
+    if (++lead_p->tick < LEAD_SETTLE_TICK) return;
+    lead_p->tick = 0;
+    lead_p->sum = 0;
+    lead_p->state = LEAD_STATE_MEASURE;
+}
+
+/**
+ * Average the current vector magnitude of this lead 
+ * angle candidate, then step to the next candidate 
+ * or record the optimum of this breakpoint.
+ */
+static void _state_measure_execute(_lead_cali_t * lead_p)
+{
+    lead_p->sum += abs(motor_control.foc_current);
+    if (++lead_p->tick < LEAD_MEAS_TICK) return;
+
+    int32_t _avg = lead_p->sum / (int32_t)LEAD_MEAS_TICK;
+    if (_avg < lead_p->best_current) {
+        lead_p->best_current = _avg;
+        lead_p->best_lead = mc_lead.probe_lead;
+    }
+
+    /*Speed loop saturated, the motor can not 
+    hold this speed, stop the sweep here*/
+    if (_avg >= Current_Rated_Current) {
+        lead_p->state = LEAD_STATE_FINISH;
+        return;
+    }
+
+    mc_lead.probe_lead += LEAD_SEARCH_STEP;
+    lead_p->tick = 0;
+    lead_p->state = LEAD_STATE_SETTLE;
+
+    if ((mc_lead.probe_lead > lead_p->table[lead_p->point - 1] + LEAD_SEARCH_SPAN) || 
+        (mc_lead.probe_lead > LEAD_MAX)) {
+        lead_p->table[lead_p->point] = lead_p->best_lead;
+        lead_p->point++;
+        lead_p->state = (lead_p->point < Lead_Table_NUM) ? 
+            LEAD_STATE_SPEED : LEAD_STATE_FINISH;
+    }
+}
+
+/**
+ * Breakpoints above the reachable speed hold the last 
+ * measured lead angle, store the table and spin down.
+ */
+static void _state_finish_execute(_lead_cali_t * lead_p)
+{
+    for (uint8_t i = lead_p->point; i < Lead_Table_NUM; i++)
+        lead_p->table[i] = lead_p->table[lead_p->point - 1];
+
+    for (uint8_t i = 0; i < Lead_Table_NUM; i++)
+        _setup.lead_table[i] = lead_p->table[i];
+    _setup.lead_valid = true;
+
+    Motor_Control_SetLeadTable(lead_p->table, true);
+    mc_lead.probe = false;
+    Motor_Control_Write_Goal_Speed(0);
+
+    operate_file(0);
+
+    lead_p->state = LEAD_STATE_STOP;
+}
+
+/**
+ * Wait for the speed tracker to reach 0, 
+ * then go back to the mode before the sweep.
+ */
+static void _state_stop_execute(_lead_cali_t * lead_p)
+{
+    if (motor_control.soft_speed != 0) return;
+
+    lead_p->state = LEAD_STATE_IDLE;
+    _lead_restore(lead_p);
+}
+
+/**
+ * End the sweep and go back to the mode before it, 
+ * holding the present position in a position mode. 
+ * A mode ordered by another command meanwhile (0x01 
+ * disable, heartbeat loss) stands.
+ */
+static void _lead_restore(_lead_cali_t * lead_p)
+{
+    lead_p->_start = false;
+    Motor_Control_Write_Goal_Speed(0);
+    if (motor_control.mode_order != Motor_Mode_Digital_Speed) return;
+
+    Motor_Control_Write_Goal_Current(0);
+    Motor_Control_Write_Goal_Location(
+        motor_control.est_location - Move_Home_Offset);
+    Motor_Control_SetMotorMode((Motor_Mode)lead_p->mode_prev);
+}
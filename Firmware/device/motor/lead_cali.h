@@ -0,0 +1,87 @@
+/**
+ * @file lead_cali.h
+ *
+ */
+
+#ifndef __LEAD_CALI_H__
+#define __LEAD_CALI_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "control_config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define LEAD_SETTLE_TICK 2000U /*Settle time per lead angle candidate (100ms at 20kHz)*/
+#define LEAD_MEAS_TICK 2000U /*Current averaging window per candidate (100ms at 20kHz)*/
+#define LEAD_SEARCH_STEP 8 /*Lead angle candidate step (vector counts)*/
+#define LEAD_SEARCH_SPAN 128 /*Candidates above the previous breakpoint optimum*/
+#define LEAD_MAX 768 /*Upper bound of the lead angle (vector counts)*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+enum {
+    /**< The lead angle characterisation is idle*/
+    LEAD_STATE_IDLE = 0x00,
+    /**< Spin up to the next speed breakpoint*/
+    LEAD_STATE_SPEED,
+    /**< Wait for the speed loop to settle*/
+    LEAD_STATE_SETTLE,
+    /**< Average the current vector magnitude*/
+    LEAD_STATE_MEASURE,
+    /**< Store the table and spin down*/
+    LEAD_STATE_FINISH,
+    /**< Wait for the spin down, restore the mode*/
+    LEAD_STATE_STOP,
+    /**< The sweep was aborted, nothing stored*/
+    LEAD_STATE_ABORT,
+};
+
+/**
+ * Describes the speed sweep that measures the lead 
+ * angle giving the minimum current at each speed.
+ */
+typedef uint8_t _lead_cali_state_t;
+
+/**
+ * Describes the speed sweep that measures the lead 
+ * angle giving the minimum current at each speed.
+ */
+typedef struct {
+    /**< Whether to start characterisation*/
+    uint8_t _start;
+    /**< Ongoing characterisation steps*/
+    _lead_cali_state_t state;
+    /**< Mode before the sweep (Motor_Mode)*/
+    uint8_t mode_prev;
+    /**< Speed breakpoint under test*/
+    uint8_t point;
+    /**< Settle and measure counter*/
+    uint16_t tick;
+    /**< Sum of the current vector magnitude*/
+    int32_t sum;
+    /**< Lead angle giving the lowest 
+    current at this breakpoint*/
+    int16_t best_lead;
+    int32_t best_current;
+    /**< Measured lead angle table*/
+    int16_t table[Lead_Table_NUM];
+} _lead_cali_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void lead_cali_start();
+void lead_cali_discard();
+void lead_cali_tick_work();
+
+#endif /*__LEAD_CALI_H__*/
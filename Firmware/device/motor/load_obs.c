@@ -0,0 +1,122 @@
+/**
+ * @file load_obs.c
+ *
+ * Load torque disturbance observer. The plant is m * a = i - d, the 
+ * commanded current i is passed through the same 1/32 filter as 
+ * est_speed so that d = i_f - m * d(est_speed)/dt holds on filtered 
+ * signals without differentiating the raw encoder, then d is low-passed 
+ * (the Q filter) and fed forward on the position and speed controller 
+ * output, a sudden load is taken over without waiting for the 
+ * integrators to wind up.
+ *
+ * The model inertia is the larger of the online estimate and the 
+ * autotune reference, overestimating is the safer side. In the host 
+ * simulation the loop settles from about 0.7x to 3x the true inertia 
+ * and limit-cycles below half of it.
+ *
+ * ISR cost: one 64 bit multiply and a few adds per tick.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "load_obs.h"
+#include "inertia_est.h"
+#include "motor_control.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/*m * 20000 * dv in Q8 mA = inertia(Q16) * dv * 20000 * 256 / 
+(62500 * 65536), 0.00125 = 41943 / 2^25*/
+#define ACC_MUL 41943
+#define ACC_SHIFT 25U
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+_load_obs_t load_obs = {
+    .enable = false,
+    .valid = false,
+};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+extern _inertia_est_t inertia_est;
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Switch the load compensation, the estimate 
+ * is kept up to date either way.
+ * @param _en Whether the estimate is fed forward.
+ */
+void load_obs_set_enable(bool _en)
+{
+    load_obs.enable = _en;
+}
+
+/**
+ * Restart the observer, called with the controller 
+ * integrators while the output is off or braking.
+ */
+void load_obs_reset()
+{
+    load_obs.cur_f = 0;
+    load_obs.speed_last = motor_control.est_speed;
+    load_obs.load = 0;
+}
+
+/**
+ * Compensation added to the controller output.
+ * @return Load current (mA), 0 while disabled or without a model.
+ */
+int32_t load_obs_comp()
+{
+    if (!load_obs.enable || !load_obs.valid) return 0;
+    return load_obs_read();
+}
+
+/**
+ * Estimated load.
+ * @return Load current (mA), positive opposes forward motion.
+ */
+int32_t load_obs_read()
+{
+    int32_t _load = load_obs.load >> OBS_SIG_Q;
+
+    if (_load > Current_Rated_Current) _load = Current_Rated_Current;
+    else if (_load < -Current_Rated_Current) _load = -Current_Rated_Current;
+    return _load;
+}
+
+/**
+ * Called at 20kHz after the speed estimate, 
+ * before the controllers use the compensation.
+ */
+void load_obs_tick_work()
+{
+    _load_obs_t * obs_p = &load_obs;
+    int32_t _inertia = inertia_est.inertia_ref;
+
+    if (inertia_est.valid && (inertia_est.inertia > _inertia))
+        _inertia = inertia_est.inertia;
+    obs_p->valid = (_inertia > 0);
+
+    /*The current of the previous tick is what accelerated the rotor*/
+    obs_p->cur_f += ((motor_control.foc_current << OBS_SIG_Q) - 
+        obs_p->cur_f) >> 5;
+
+    int32_t _dv = motor_control.est_speed - obs_p->speed_last;
+    obs_p->speed_last = motor_control.est_speed;
+    int32_t _acc = (int32_t)(((int64_t)_inertia * _dv * ACC_MUL) >> ACC_SHIFT);
+
+    obs_p->load += ((obs_p->cur_f - _acc) - obs_p->load) >> OBS_Q_SHIFT;
+}
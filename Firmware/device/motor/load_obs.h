@@ -0,0 +1,55 @@
+/**
+ * @file load_obs.h
+ *
+ */
+
+#ifndef __LOAD_OBS_H__
+#define __LOAD_OBS_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "control_config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define OBS_Q_SHIFT 5U /*Observer low-pass 1/32 per tick, about 100Hz*/
+#define OBS_SIG_Q 8U /*Signal format Q8 (mA)*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * Describes the load torque disturbance observer, 
+ * the load (as phase current) is what remains of the 
+ * commanded current after accelerating the inertia.
+ */
+typedef struct {
+    /**< Compensate the controller output*/
+    bool enable;
+    /**< A model inertia is known*/
+    bool valid;
+    /**< Commanded current through the est_speed filter (Q8)*/
+    int32_t cur_f;
+    int32_t speed_last;
+    /**< Estimated load (Q8 mA)*/
+    int32_t load;
+} _load_obs_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void load_obs_set_enable(bool _en);
+void load_obs_reset();
+int32_t load_obs_comp();
+int32_t load_obs_read();
+void load_obs_tick_work();
+
+#endif /*__LOAD_OBS_H__*/
@@ -47,7 +47,13 @@
 #include "tb67h450.h"/*#include "hw_elec.h"*/
 /*#include "signal_port.h"*/
 #include "enc_cali.h"
+#include "out_filter.h"
+#include "sys_ident.h"
+#include "inertia_est.h"
+#include "load_obs.h"
+#include "pos_journal.h"
 #include "temp.h"
+#include "setup.h"
 
 /*Control*/
 #include "control_config.h"
@@ -57,6 +63,11 @@
 #include "Move_Reconstruct.h"
 #include "Location_Interp.h"
 
+#include <math.h>
+
+static bool Motor_Control_LocationMode(Motor_Mode _mode);	//位置模式
+static int32_t Motor_Control_LimitSpeed(int32_t _speed);			//软件限位速度包络
+
 /****************************************  电流输出(电流控制)  ****************************************/
 /****************************************  电流输出(电流控制)  ****************************************/
 /**
@@ -66,12 +77,14 @@
 **/
 void Control_Cur_To_Electric(int16_t current)
 {
+	//增益调度(补偿驱动层输出缩放,限制在额定电流内)
+	int32_t out = ((int32_t)current * motor_control.out_gain) >> 10;
+	if(out > 			Current_Rated_Current)		out =  Current_Rated_Current;
+	else if(out < -Current_Rated_Current)		out = -Current_Rated_Current;
 	//输出FOC电流
-	motor_control.foc_current = current;
+	motor_control.foc_current = out;
 	//输出FOC位置
-	if(motor_control.foc_current > 0)				motor_control.foc_location = motor_control.est_location + Move_Divide_NUM;
-	else if(motor_control.foc_current < 0)	motor_control.foc_location = motor_control.est_location - Move_Divide_NUM;
-	else																		motor_control.foc_location = motor_control.est_location;
+	motor_control.foc_location = Motor_Control_FocLocation(motor_control.foc_current);
 	//输出任务到驱动
 	tb_foc_set_current_vector(motor_control.foc_location, motor_control.foc_current);
 	//CurrentControl_Out_FeedTrack(motor_control.foc_location, motor_control.foc_current, false, true);
@@ -153,6 +166,8 @@ void Control_PID_Init(void)
 **/
 void Control_PID_To_Electric(int32_t _speed)
 {
+	int32_t out_raw;	//限幅前输出
+
 	//误差
 	pid.v_error_last = pid.v_error;
 	pid.v_error = _speed - motor_control.est_speed;	//速度误差
@@ -172,15 +187,19 @@ void Control_PID_To_Electric(int32_t _speed)
 	pid.od = (pid.kd) * (pid.v_error - pid.v_error_last);
 	//综合输出计算（同时限制输出范围，限制最终输出电流在额定电流范围内）
 	pid.out = (pid.op + pid.oi + pid.od) >> 10;
+	pid.out = (pid.out * motor_control.out_gain) >> 10;	//增益调度(补偿驱动层输出缩放)
+	pid.out = out_filter_apply(pid.out);								//输出滤波(陷波/低通)
+	pid.out += load_obs_comp();													//负载前馈(扰动观测器)
+	out_raw = pid.out;
 	if(pid.out > 			Current_Rated_Current)		pid.out =  Current_Rated_Current;
 	else if(pid.out < -Current_Rated_Current)		pid.out = -Current_Rated_Current;
+	//反算抗饱和（输出限幅的超出量回馈积分项，饱和期间积分不再继续累积）
+	pid.oi -= (out_raw - pid.out) << Anti_Windup_SHIFT;
 	
 	//输出FOC电流
 	motor_control.foc_current = pid.out;
 	//输出FOC位置
-	if(motor_control.foc_current > 0)				motor_control.foc_location = motor_control.est_location + Move_Divide_NUM;
-	else if(motor_control.foc_current < 0)	motor_control.foc_location = motor_control.est_location - Move_Divide_NUM;
-	else																		motor_control.foc_location = motor_control.est_location;
+	motor_control.foc_location = Motor_Control_FocLocation(motor_control.foc_current);
 	//输出任务到驱动
 	tb_foc_set_current_vector(motor_control.foc_location, motor_control.foc_current);
 	//CurrentControl_Out_FeedTrack(motor_control.foc_location, motor_control.foc_current, false, true);
@@ -276,6 +295,8 @@ void Control_DCE_Init(void)
 **/
 void Control_DCE_To_Electric(int32_t _location, int32_t _speed)
 {
+	int32_t out_raw;	//限幅前输出
+
 	//误差
 	dce.p_error = _location - motor_control.est_location;
 	dce.v_error = (_speed - motor_control.est_speed) >> 7;	//速度误差缩小至1/128
@@ -301,20 +322,99 @@ void Control_DCE_To_Electric(int32_t _location, int32_t _speed)
 	dce.od = ((dce.kd) * (dce.v_error));
 	//综合输出计算（同时限制输出范围，限制最终输出电流在额定电流范围内）
 	dce.out = (dce.op + dce.oi + dce.od) >> 10;
+	dce.out = (dce.out * motor_control.out_gain) >> 10;	//增益调度(补偿驱动层输出缩放)
+	dce.out = (dce.out * inertia_est_gain()) >> 10;			//增益调度(跟随在线估计惯量)
+	dce.out = out_filter_apply(dce.out);								//输出滤波(陷波/低通)
+	dce.out += load_obs_comp();													//负载前馈(扰动观测器)
+	dce.out += sys_ident_excite();											//辨识激励(扫频/伪随机)
+	out_raw = dce.out;
 	if(dce.out > 			Current_Rated_Current)		dce.out =  Current_Rated_Current;
 	else if(dce.out < -Current_Rated_Current)		dce.out = -Current_Rated_Current;
+	//反算抗饱和（输出限幅的超出量回馈积分项，饱和期间积分不再继续累积）
+	dce.oi -= (out_raw - dce.out) << Anti_Windup_SHIFT;
 
 	//输出FOC电流
 	motor_control.foc_current = dce.out;
 	//输出FOC位置
-	if(motor_control.foc_current > 0)			motor_control.foc_location = motor_control.est_location + Move_Divide_NUM;
-	else if(motor_control.foc_current < 0)	motor_control.foc_location = motor_control.est_location - Move_Divide_NUM;
-	else																		motor_control.foc_location = motor_control.est_location;
+	motor_control.foc_location = Motor_Control_FocLocation(motor_control.foc_current);
 	//输出任务到驱动
 	tb_foc_set_current_vector(motor_control.foc_location, motor_control.foc_current);
 	//CurrentControl_Out_FeedTrack(motor_control.foc_location, motor_control.foc_current, false, true);
 }
 
+/****************************************  级联控制器(位置控制)  ****************************************/
+/****************************************  级联控制器(位置控制)  ****************************************/
+//级联控制(P位置环 -> PI速度环 -> 电流), 速度环复用PID控制器及其参数
+Control_Cascade_Typedef casc;
+
+/**
+  * @brief  参数配置
+  * @param  _k
+  * @retval NULL
+**/
+void Control_Cascade_SetKP(uint16_t _k)
+{
+	if(_k <= 1024){		casc.kp = _k;		casc.valid_kp = true;		}
+	else{															casc.valid_kp = false;		}
+}
+
+/**
+  * @brief  级联控制器选择
+  * @param  _en  位置模式使用级联控制器
+  * @retval NULL
+**/
+void Control_Cascade_SetEnable(bool _en)
+{
+	casc.enable = _en;
+}
+
+/**
+  * @brief  控制器级联初始化
+  * @param  NULL
+  * @retval NULL
+**/
+void Control_Cascade_Init(void)
+{
+	//前置配置无效时,加载默认配置
+	if(!casc.valid_kp)			{	Control_Cascade_SetKP(De_CASC_KP);		}
+	
+	//控制参数
+	casc.p_error = 0;
+	casc.v_order = 0;
+}
+
+/**
+  * @brief  级联电流控制
+  * @param  _location 控制位置
+  * @param  _speed    控制速度(作为速度前馈)
+  * @retval NULL
+**/
+void Control_Cascade_To_Electric(int32_t _location, int32_t _speed)
+{
+	//位置环（比例），位置误差限制与DCE相同
+	casc.p_error = _location - motor_control.est_location;
+	if(casc.p_error > ( 3200))	casc.p_error = ( 3200);				//限制位置误差在1/16圈内(51200/16)
+	if(casc.p_error < (-3200))	casc.p_error = (-3200);
+	//速度指令 = 速度前馈 + 位置环输出（限制在额定转速内）
+	casc.v_order = _speed + casc.kp * casc.p_error;
+	if(casc.v_order >  Move_Rated_Speed)	casc.v_order =  Move_Rated_Speed;
+	if(casc.v_order < -Move_Rated_Speed)	casc.v_order = -Move_Rated_Speed;
+	//速度环（PI），带宽由PID参数独立整定
+	Control_PID_To_Electric(casc.v_order);
+}
+
+/**
+  * @brief  位置模式电流控制(按配置选择DCE或级联控制器)
+  * @param  _location 控制位置
+  * @param  _speed    控制速度
+  * @retval NULL
+**/
+void Control_Location_To_Electric(int32_t _location, int32_t _speed)
+{
+	if(casc.enable)		Control_Cascade_To_Electric(_location, _speed);
+	else							Control_DCE_To_Electric(_location, _speed);
+}
+
 /****************************************  Motor_Contro_Debug  ****************************************/
 /****************************************  Motor_Contro_Debug  ****************************************/
 Motor_Control_Debug_Typedef		mc_debug;	//控制调试
@@ -344,6 +444,96 @@ void Motor_MultiDebug_Speed(void)
 	motor_control.soft_speed = mc_debug.speed;
 }
 
+/****************************************  超前角补偿表  ****************************************/
+/****************************************  超前角补偿表  ****************************************/
+Motor_Control_Lead_Typedef		mc_lead;	//超前角补偿表
+
+/**
+  * @brief  写入超前角补偿表, by zhbi98
+  * @param  table: 补偿表(Lead_Table_NUM 点)
+  * @param  valid: 补偿表有效标志
+  * @retval NULL
+**/
+void Motor_Control_SetLeadTable(const int16_t * table, bool valid)
+{
+	mc_lead.valid = false;	//写入过程中回退到DPS补偿表
+	for(uint8_t i = 0; i < Lead_Table_NUM; i++)
+		mc_lead.table[i] = table[i];
+	mc_lead.valid = valid;
+}
+
+/****************************************  换向角超前  ****************************************/
+/****************************************  换向角超前  ****************************************/
+Motor_Control_Fw_Typedef		mc_fw;		//换向角超前表
+
+/**
+  * @brief  写入换向角超前断点, by zhbi98
+  * @param  speed: 断点速度(脉冲/s, 严格递增)
+  * @param  angle: 断点超前角(1024 = 360°电角度)
+  * @retval 断点有效(速度严格递增且存在非零超前角)
+**/
+bool Motor_Control_SetFwTable(const int32_t * speed, const int16_t * angle)
+{
+	bool valid = false;
+
+	mc_fw.valid = false;	//写入过程中关闭超前
+	for(uint8_t i = 0; i < Fw_Point_NUM; i++){
+		mc_fw.speed[i] = speed[i];
+		mc_fw.angle[i] = angle[i];
+		if(mc_fw.angle[i] > Fw_Angle_MAX)	mc_fw.angle[i] = Fw_Angle_MAX;
+		else if(mc_fw.angle[i] < 0)				mc_fw.angle[i] = 0;
+		if(mc_fw.angle[i] != 0)						valid = true;
+	}
+	for(uint8_t i = 0; i < (Fw_Point_NUM - 1); i++){
+		if(mc_fw.speed[i + 1] <= mc_fw.speed[i])	return false;
+		//预计算斜率(Q16),避免中断中做除法
+		mc_fw.slope[i] = ((int32_t)(mc_fw.angle[i + 1] - mc_fw.angle[i]) << 16) / (mc_fw.speed[i + 1] - mc_fw.speed[i]);
+	}
+	if(mc_fw.speed[0] < 0)	return false;
+
+	mc_fw.valid = valid;
+	return valid;
+}
+
+/**
+  * @brief  换向角超前量, 高速时绕组电感使实际电流滞后于指令矢量, 沿转动方向超前换向角补偿, by zhbi98
+  * @param  _speed: 估计速度
+  * @retval 超前量(沿转动方向, 第一断点以下为0, 末断点以上保持)
+**/
+int32_t Motor_Control_FwAdvance(int32_t _speed)
+{
+	if(!mc_fw.valid)	return 0;
+
+	int32_t abs_speed = abs(_speed);
+	int32_t advance;
+	if(abs_speed < mc_fw.speed[0]){
+		return 0;
+	}
+	else if(abs_speed >= mc_fw.speed[Fw_Point_NUM - 1]){
+		advance = mc_fw.angle[Fw_Point_NUM - 1];
+	}
+	else{
+		uint8_t i = 0;
+		while(abs_speed >= mc_fw.speed[i + 1])	i++;
+		advance = mc_fw.angle[i] + (int32_t)(((int64_t)(abs_speed - mc_fw.speed[i]) * mc_fw.slope[i]) >> 16);
+	}
+	return (_speed < 0) ? -advance : advance;
+}
+
+/**
+  * @brief  换向位置(FOC位置), 电流矢量领先估计位置90°, 再叠加按速度调度的超前量, by zhbi98
+  * @param  current: 输出电流
+  * @retval FOC位置
+**/
+int32_t Motor_Control_FocLocation(int32_t current)
+{
+	if(current == 0)	return motor_control.est_location;
+
+	int32_t advance = Motor_Control_FwAdvance(motor_control.est_speed);
+	if(current > 0)	return motor_control.est_location + Move_Divide_NUM + advance;
+	else						return motor_control.est_location - Move_Divide_NUM + advance;
+}
+
 /****************************************  Motor_Control  ****************************************/
 /****************************************  Motor_Control  ****************************************/
 Motor_Control_Typedef 				motor_control;				//控制主结构
@@ -370,6 +560,39 @@ void Motor_Control_SetStallSwitch(bool _switch)
 	motor_control.valid_stall_switch = true;
 }
 
+/**
+  * @brief  跟随误差窗口
+  * @param  _window   窗口(脉冲)(0为关闭)
+  * @param  _debounce 去抖(控制周期)(小于100时5ms内触发)
+  * @param  _react    故障反应
+  * @retval NULL
+**/
+void Motor_Control_SetFollowError(int32_t _window, uint16_t _debounce, Motor_Fault_React _react)
+{
+	if(_window < 0)								_window = 0;
+	if(_debounce == 0)						_debounce = 1;
+	if(_react > Fault_React_Decel)	_react = Fault_React_Disable;
+	motor_control.ferr_window = _window;
+	motor_control.ferr_debounce = _debounce;
+	motor_control.ferr_react = _react;
+	motor_control.ferr_count = 0;
+}
+
+/**
+  * @brief  软件限位, by zhbi98
+  * @param  _en  使能(下限不小于上限时不使能)
+  * @param  _min 下限(用户位置,脉冲)
+  * @param  _max 上限(用户位置,脉冲)
+  * @retval NULL
+**/
+void Motor_Control_SetPosLimit(bool _en, int32_t _min, int32_t _max)
+{
+	Move_Limit_Enable = false;		//控制中断不会读到半更新的限位
+	Move_Limit_Min = _min;
+	Move_Limit_Max = _max;
+	Move_Limit_Enable = (_en) && (_min < _max);
+}
+
 /**
   * @brief  控制模式参数恢复
   * @param  NULL
@@ -381,6 +604,21 @@ void Motor_Control_SetDefault(void)
 	Motor_Control_SetStallSwitch(De_Motor_Stall);
 }
 
+/**
+  * @brief  输出缩放与增益调度, by zhbi98
+  * @param  _scale: 输出缩放系数(1024 = 1.0)
+  * @retval NULL
+**/
+void Motor_Control_SetOutScale(uint16_t _scale)
+{
+	if((_scale == 0) || (_scale > 1024))	_scale = 1024;
+	//驱动层按缩放系数输出,使高相电阻电机的电流矢量不超出供电可驱动的电流
+	motor_control.out_scale = _scale;
+	tb_foc_set_out_scale(_scale);
+	//控制器输出乘以缩放的倒数,保持小信号环路增益不变,仅输出上限降低
+	motor_control.out_gain = (1024 * 1024) / _scale;
+}
+
 /**
   * @brief  写入目标位置
   * @param  NULL
@@ -417,6 +655,18 @@ void Motor_Control_Write_Goal_Current(int16_t value)
 	}
 }
 
+/**
+  * @brief  写入跟踪模式电流限制(只在跟踪模式有效,切换模式恢复额定电流)
+  * @param  value: 电流限制(mA),0或超过额定电流恢复额定电流
+  * @retval NULL
+**/
+void Motor_Control_Write_Track_Current(int32_t value)
+{
+	if((value <= 0) || (value > _setup.current_rated))	value = _setup.current_rated;
+	Current_Rated_Current = value;
+	motor_control.track_limit = (value != _setup.current_rated);
+}
+
 /**
   * @brief  写入目标失能
   * @param  NULL
@@ -448,11 +698,11 @@ void Motor_Control_Write_PosAsHomeOffset()
 }
 
 /**
-  * @brief  写入目标位置, by zhbi98
-  * @param  NULL
-  * @retval NULL
+  * @brief  按运动时间计算额定速度, by zhbi98
+  * @param  pos: 目标位置  time: 运动时间(s)
+  * @retval 额定速度, 0为时间内无法到达
 **/
-bool Motor_Control_Write_Goal_Location_WithTime(int32_t pos, float time)
+int32_t Motor_Control_Time_Speed(int32_t pos, float time)
 {
 	float rated_Acc = ((float)Move_Rated_UpAcc + 
 		(float)Move_Rated_DownAcc) / 2.0f;
@@ -464,42 +714,41 @@ bool Motor_Control_Write_Goal_Location_WithTime(int32_t pos, float time)
   int32_t _pos_delta = abs(
   	pos - motor_control.real_location + Move_Home_Offset);
 
-  if ((float)_pos_delta > _pos_max) {
-  	/*velocity Limit*/
-    Move_Rated_Speed = 30U * Move_Pulse_NUM;
-
-    /**The new rated speed needs to be synchronized to 
-    the position tracker, which needs the rated 
-    speed to generate the process speed.*/
-    Location_Tracker_Set_MaxSpeed(Move_Rated_Speed);
-    Location_Tracker_Set_UpAcc(Move_Rated_Speed);
-    Location_Tracker_Set_DownAcc(Move_Rated_Speed);
-
-    Motor_Control_Write_Goal_Location(pos);
-    return false;
-  } else {
-    speed_max = time * (float)rated_Acc;
-
-    speed_max -= (float)rated_Acc * (
-    	sqrtf(time * time - 4 * 
-    		(float)_pos_delta / (float)rated_Acc));
-
-    speed_max /= 2.0f;
-
-    /*Adjust the rated speed of the motor 
-    according to the needs of time*/
-    Move_Rated_Speed = (int32_t)speed_max;
-
-    /**The new rated speed needs to be synchronized to 
-    the position tracker, which needs the rated 
-    speed to generate the process speed.*/
-    Location_Tracker_Set_MaxSpeed(Move_Rated_Speed);
-    Location_Tracker_Set_UpAcc(Move_Rated_Speed);
-    Location_Tracker_Set_DownAcc(Move_Rated_Speed);
-
-    Motor_Control_Write_Goal_Location(pos);
-    return true;
-  }
+  if ((float)_pos_delta > _pos_max) return 0;
+
+  speed_max = time * (float)rated_Acc;
+
+  speed_max -= (float)rated_Acc * (
+  	sqrtf(time * time - 4 * 
+  		(float)_pos_delta / (float)rated_Acc));
+
+  speed_max /= 2.0f;
+  return (int32_t)speed_max;
+}
+
+/**
+  * @brief  写入目标位置, by zhbi98
+  * @param  NULL
+  * @retval NULL
+**/
+bool Motor_Control_Write_Goal_Location_WithTime(int32_t pos, float time)
+{
+  /*Adjust the rated speed of the motor 
+  according to the needs of time*/
+  int32_t _speed = Motor_Control_Time_Speed(pos, time);
+
+  /*velocity Limit*/
+  Move_Rated_Speed = (_speed != 0) ? _speed : (30U * Move_Pulse_NUM);
+
+  /**The new rated speed needs to be synchronized to 
+  the position tracker, which needs the rated 
+  speed to generate the process speed.*/
+  Location_Tracker_Set_MaxSpeed(Move_Rated_Speed);
+  Location_Tracker_Set_UpAcc(Move_Rated_Speed);
+  Location_Tracker_Set_DownAcc(Move_Rated_Speed);
+
+  Motor_Control_Write_Goal_Location(pos);
+  return (_speed != 0);
 }
 
 /**
@@ -579,18 +828,31 @@ void Motor_Control_Init(void)
 	//输出
 	motor_control.foc_location = 0;
 	motor_control.foc_current = 0;
+	if(!motor_control.out_scale)	Motor_Control_SetOutScale(_Current_Out_Scale);
 	//堵转识别
 	motor_control.stall_time_us = 0;
 	motor_control.stall_flag = false;
 	//过载识别
 	motor_control.overload_time_us = 0;
 	motor_control.overload_flag = false;
+	//跟随误差识别
+	if(!motor_control.ferr_debounce)	Motor_Control_SetFollowError(0, De_Ferr_Debounce, Fault_React_Disable);
+	motor_control.ferr_count = 0;
+	motor_control.ferr_flag = false;
+	motor_control.ferr_report = false;
+	//快速停止
+	motor_control.qstop_active = false;
+	motor_control.qstop_done = false;
+	motor_control.qstop_time_us = 0;
+	//跟踪电流限制
+	motor_control.track_limit = false;
 	//状态
 	motor_control.state = Control_State_Stop;		
 	
 	/**********  控制算法初始化  **********/
 	Control_PID_Init();
 	Control_DCE_Init();
+	Control_Cascade_Init();
 	
 	/********** 轨迹规划 **********/
 	Location_Tracker_Init();	//位置跟踪器初始化
@@ -634,6 +896,9 @@ void Motor_Control_Callback(void)
 		motor_control.real_lap_location_last	= _angle.rectified;
 		motor_control.real_location						= _angle.rectified;
 		motor_control.real_location_last			= _angle.rectified;
+		//多圈位置恢复(掉电前记录的位置与上电单圈角度对齐)
+		motor_control.real_location						= pos_journal_reconcile(_angle.rectified);
+		motor_control.real_location_last			= motor_control.real_location;
 		//第一次运行强制退出
 		first_call = false;
 		return;
@@ -678,6 +943,8 @@ void Motor_Control_Callback(void)
 	motor_control.est_location = motor_control.real_location + motor_control.est_lead_location;
 	//估计误差
 	motor_control.est_error = motor_control.soft_location - motor_control.est_location;
+	//估计负载(扰动观测器)
+	load_obs_tick_work();
 	
 	/************************************ 运动控制 ************************************/
 	/************************************ 运动控制 ************************************/
@@ -686,8 +953,9 @@ void Motor_Control_Callback(void)
 	else if(
 		 (motor_control.stall_flag)			//堵转标志置位
 	|| (motor_control.soft_disable)		//软目标_失能指令
-	|| (motor_control.overtemp_flag)	//过热标志置位
+	|| (motor_control.qstop_done)			//快速停止完成(失能/停止/过热)
 	|| ((!_angle.rectify_valid))			//编码器校准表无效
+	|| ((motor_control.ferr_flag) && (motor_control.ferr_react == Fault_React_Disable))	//跟随误差_失能
 	){
 		Motor_Control_Clear_Integral();		//清除积分
 		motor_control.foc_location = 0;		//清FOC位置
@@ -698,6 +966,7 @@ void Motor_Control_Callback(void)
 	//输出刹车
 	else if(
 		 (motor_control.soft_brake)			//软目标_刹车指令
+	|| ((motor_control.ferr_flag) && (motor_control.ferr_react == Fault_React_Brake))		//跟随误差_刹车
 	){
 		Motor_Control_Clear_Integral();		//清除积分
 		motor_control.foc_location = 0;		//清FOC位置
@@ -705,34 +974,64 @@ void Motor_Control_Callback(void)
 		tb_driver_brake();					//驱动刹车
 		//CurrentControl_OutBrake();			//XDrive采用硬件逻辑电流控制,自动刹车
 	}
+	//快速停止(速度环按快速停止减速度停到0,静止后休眠)
+	else if(
+		 (motor_control.qstop_active)		//快速停止中
+	){
+		Speed_Tracker_Capture_QuickStop();
+		Control_PID_To_Electric(speed_tck.go_speed);
+		if(speed_tck.go_speed == 0){
+			//静止或超时1s(外力拖动)后完成
+			if( (abs(motor_control.est_speed) < QStop_Rest_Speed)
+			 || (motor_control.qstop_time_us >= (1000 * 1000))
+			){
+				motor_control.qstop_active = false;
+				motor_control.qstop_done = true;
+			}
+			else{
+				motor_control.qstop_time_us += CONTROL_PERIOD_US;
+			}
+		}
+	}
+	//跟随误差减速停止(速度环按快速停止减速度停到0并保持)
+	else if(
+		 (motor_control.ferr_flag)			//跟随误差_减速
+	){
+		Speed_Tracker_Capture_QuickStop();
+		Control_PID_To_Electric(speed_tck.go_speed);
+	}
 	else{
 		//运行模式分支
 		switch(motor_control.mode_run)
 		{
 			//测试
-			case Motor_Mode_Debug_Location:		Control_DCE_To_Electric(motor_control.soft_location, motor_control.soft_speed);				break;
+			case Motor_Mode_Debug_Location:		Control_Location_To_Electric(motor_control.soft_location, motor_control.soft_speed);	break;
 			case Motor_Mode_Debug_Speed:			Control_PID_To_Electric(motor_control.soft_speed);																		break;
 			//停止
-			case Control_Mode_Stop:						tb_driver_sleep();																															break;
+			case Control_Mode_Stop:						motor_control.foc_current = 0;	tb_driver_sleep();															break;
 			//DIG(CAN/RS485)
-			case Motor_Mode_Digital_Location:	Control_DCE_To_Electric(motor_control.soft_location, motor_control.soft_speed);				break;
+			case Motor_Mode_Digital_Location:	Control_Location_To_Electric(motor_control.soft_location, motor_control.soft_speed);	break;
 			case Motor_Mode_Digital_Speed:		Control_PID_To_Electric(motor_control.soft_speed);																		break;
 			case Motor_Mode_Digital_Current:	Control_Cur_To_Electric(motor_control.soft_current);																	break;
-			case Motor_Mode_Digital_Track:		Control_DCE_To_Electric(motor_control.soft_location, motor_control.soft_speed);				break;
+			case Motor_Mode_Digital_Track:		Control_Location_To_Electric(motor_control.soft_location, motor_control.soft_speed);	break;
 			//MoreIO(PWM/PUL)
-			case Motor_Mode_PWM_Location:			Control_DCE_To_Electric(motor_control.soft_location, motor_control.soft_speed);				break;
+			case Motor_Mode_PWM_Location:			Control_Location_To_Electric(motor_control.soft_location, motor_control.soft_speed);	break;
 			case Motor_Mode_PWM_Speed:				Control_PID_To_Electric(motor_control.soft_speed);																		break;
 			case Motor_Mode_PWM_Current:			Control_Cur_To_Electric(motor_control.soft_current);																	break;
-			case Motor_Mode_PULSE_Location:		Control_DCE_To_Electric(motor_control.soft_location, motor_control.soft_speed);				break;
+			case Motor_Mode_PULSE_Location:		Control_Location_To_Electric(motor_control.soft_location, motor_control.soft_speed);	break;
 			//其他非法模式
 			default:	break;
 		}
 	}
 
-	if(motor_control.mode_run != motor_control.mode_order)
-	{
+	if( (motor_control.mode_run != motor_control.mode_order)
+	 && ((motor_control.mode_order != Control_Mode_Stop) || (motor_control.qstop_done))	//进入停止模式前先快速停止
+	){
 		motor_control.mode_run = motor_control.mode_order;
 		motor_control.soft_new_curve = true; /*触发新发生器刷新*/
+		//离开跟踪模式,恢复额定电流
+		if(motor_control.track_limit && (motor_control.mode_run != Motor_Mode_Digital_Track))
+			Motor_Control_Write_Track_Current(0);
 	}
 
 #if 0 /*Add by zhbi98*/
@@ -818,7 +1117,7 @@ void Motor_Control_Callback(void)
 	if(motor_control.soft_new_curve){
 		motor_control.soft_new_curve = false;
 		//控制重载和功率模块唤醒
-		Motor_Control_Clear_Integral();	//清除控制积分项目
+		Motor_Control_Preload_Integral(motor_control.foc_current);	//以当前输出预载积分项(无扰切换)
 		Motor_Control_Clear_Stall();		//清除堵转识别
 		//CurrentControl_OutWakeUp();		//XDrive采用硬件逻辑电流控制,自动唤醒
 		//CurrentControl_OutRunning();	//XDrive采用硬件逻辑电流控制,自动唤醒
@@ -847,7 +1146,11 @@ void Motor_Control_Callback(void)
 	/************************************ 软目标提取 ************************************/
 	/************************************ 软目标提取 ************************************/
 	//提取(软位置,软速度,软电流)
-	switch(motor_control.mode_run){
+	//快速停止和跟随误差减速停止占用速度跟踪器,期间不推进模式的跟踪器(速度模式会把减速抵消),撤销后以新曲线接续
+	if( (motor_control.qstop_active)
+	 || ((motor_control.ferr_flag) && (motor_control.ferr_react == Fault_React_Decel))
+	){}
+	else switch(motor_control.mode_run){
 		//测试
 		case Motor_Mode_Debug_Location:		Motor_MultiDebug_Location();	break;
 		case Motor_Mode_Debug_Speed:			Motor_MultiDebug_Speed();			break;
@@ -858,7 +1161,7 @@ void Motor_Control_Callback(void)
 																			motor_control.soft_location = location_tck.go_location;
 																			motor_control.soft_speed    = location_tck.go_speed;
 																			break;
-		case Motor_Mode_Digital_Speed:		Speed_Tracker_Capture_Goal(motor_control.goal_speed);
+		case Motor_Mode_Digital_Speed:		Speed_Tracker_Capture_Goal(Motor_Control_LimitSpeed(motor_control.goal_speed));
 																			motor_control.soft_speed    = speed_tck.go_speed;
 																			break;
 		case Motor_Mode_Digital_Current:	Current_Tracker_Capture_Goal(motor_control.goal_current);
@@ -873,7 +1176,7 @@ void Motor_Control_Callback(void)
 																			motor_control.soft_location = location_tck.go_location;
 																			motor_control.soft_speed    = location_tck.go_speed;
 																			break;			
-		case Motor_Mode_PWM_Speed:				Speed_Tracker_Capture_Goal(motor_control.goal_speed);
+		case Motor_Mode_PWM_Speed:				Speed_Tracker_Capture_Goal(Motor_Control_LimitSpeed(motor_control.goal_speed));
 																			motor_control.soft_speed    = speed_tck.go_speed;
 																			break;
 		case Motor_Mode_PWM_Current:			Current_Tracker_Capture_Goal(motor_control.goal_current);
@@ -887,7 +1190,7 @@ void Motor_Control_Callback(void)
 		default:	break;
 	}
 	//提取(软失能,软刹车)
-	motor_control.soft_disable = motor_control.goal_disable;
+	motor_control.soft_disable = (motor_control.goal_disable) && (motor_control.qstop_done);	//快速停止完成后失能
 	motor_control.soft_brake = motor_control.goal_brake;
 	
 	/************************************ 状态识别 ************************************/
@@ -922,11 +1225,55 @@ void Motor_Control_Callback(void)
 		motor_control.overload_flag = false;//过载标志可自清除
 	}
 
+	//跟随误差检测(位置模式,去抖后触发,标志不能自清除)
+	if( (motor_control.ferr_window != 0)
+	 && (!motor_control.ferr_flag)
+	 && (!motor_control.soft_disable) && (!motor_control.soft_brake)
+	 && (Motor_Control_LocationMode(motor_control.mode_run))
+	){
+		if(abs(motor_control.est_error) > motor_control.ferr_window){
+			if(++motor_control.ferr_count >= motor_control.ferr_debounce){
+				motor_control.ferr_flag = true;
+				motor_control.ferr_report = true;
+				motor_control.ferr_value = motor_control.est_error;
+				if(motor_control.ferr_react == Fault_React_Decel){
+					Motor_Control_Preload_Integral(motor_control.foc_current);	//速度环无扰接管
+					Speed_Tracker_NewTask(motor_control.est_speed);							//减速从当前速度开始
+				}
+			}
+		}
+		else{
+			motor_control.ferr_count = 0;
+		}
+	}
+
 	//过热检测
 	uint16_t overtemp = _overtemp();
 	if (overtemp > 3200) motor_control.overtemp_flag = true;
 	if (overtemp < 3000) motor_control.overtemp_flag = false;
 
+	//快速停止(失能、进入停止模式、过热时先停到0再休眠,撤销后从当前状态开始新曲线)
+	if( !((motor_control.goal_disable)
+	 ||   (motor_control.overtemp_flag)
+	 ||  ((motor_control.mode_order == Control_Mode_Stop) && (motor_control.mode_run != Control_Mode_Stop)))
+	){
+		if((motor_control.qstop_active) || (motor_control.qstop_done))
+			motor_control.soft_new_curve = true;
+		motor_control.qstop_active = false;
+		motor_control.qstop_done = false;
+	}
+	else if((!motor_control.qstop_active) && (!motor_control.qstop_done)){
+		if(Motor_Control_OutputRunning()){
+			Motor_Control_Preload_Integral(motor_control.foc_current);	//速度环无扰接管
+			Speed_Tracker_NewTask(motor_control.est_speed);							//减速从当前速度开始
+			motor_control.qstop_time_us = 0;
+			motor_control.qstop_active = true;
+		}
+		else{
+			motor_control.qstop_done = true;	//输出未运行,直接完成
+		}
+	}
+
 	/************************************ 状态记录 ************************************/
 	/************************************ 状态记录 ************************************/
 	//统一的电机状态
@@ -934,6 +1281,8 @@ void Motor_Control_Callback(void)
 		motor_control.state = Control_State_Stop;
 	else if(motor_control.stall_flag)								//堵转标志置位
 		motor_control.state = Control_State_Stall;
+	else if(motor_control.ferr_flag)								//跟随误差标志置位
+		motor_control.state = Control_State_FollowErr;
 	else if(motor_control.overload_flag)						//过载标志置位
 		motor_control.state = Control_State_Overload;
 	else if (motor_control.overtemp_flag)
@@ -987,6 +1336,51 @@ void Motor_Control_Clear_Integral(void)
 	//Debug
 	mc_debug.mut = 0;
 	mc_debug.dec = 0;
+
+	//输出滤波器
+	out_filter_reset();
+
+	//扰动观测器
+	load_obs_reset();
+}
+
+/**
+  * @brief  预载积分
+  * @param  _current  切换前的输出电流
+  * @retval NULL
+**/
+void Motor_Control_Preload_Integral(int32_t _current)
+{
+	//新曲线从当前位置和速度开始，比例与微分项的误差接近0，
+	//积分项承担全部输出，按输出链的增益反算积分项，使切换
+	//前后输出电流不变（保持重力等静态负载的力矩）
+	int64_t oi;
+
+	_current -= load_obs_comp();		//负载前馈不经过积分项
+	if(_current > 			Current_Rated_Current)		_current =  Current_Rated_Current;
+	else if(_current < -Current_Rated_Current)		_current = -Current_Rated_Current;
+	oi = ((int64_t)_current << 20) / motor_control.out_gain;
+	
+	//PID
+	pid.i_mut = 0;
+	pid.i_dec = 0;
+	pid.oi = (int32_t)oi;
+	if(pid.oi >      (  Current_Rated_Current << 10 ))	pid.oi = (  Current_Rated_Current << 10 );
+	else if(pid.oi < (-(Current_Rated_Current << 10)))	pid.oi = (-(Current_Rated_Current << 10));
+	
+	//DCE(额外除以惯量增益调度)
+	dce.i_mut = 0;
+	dce.i_dec = 0;
+	dce.oi = (int32_t)((oi << 10) / inertia_est_gain());
+	if(dce.oi >      (  Current_Rated_Current << 10 ))	dce.oi = (  Current_Rated_Current << 10 );
+	else if(dce.oi < (-(Current_Rated_Current << 10)))	dce.oi = (-(Current_Rated_Current << 10));
+	
+	//Debug
+	mc_debug.mut = 0;
+	mc_debug.dec = 0;
+
+	//输出滤波器从稳态开始
+	out_filter_preload(_current);
 }
 
 /**
@@ -998,6 +1392,70 @@ void Motor_Control_Clear_Stall(void)
 {
 	motor_control.stall_time_us = 0;		//堵转计时器
 	motor_control.stall_flag = false;		//堵转标志
+	motor_control.ferr_count = 0;				//跟随误差计数
+	motor_control.ferr_flag = false;		//跟随误差标志
+}
+
+/**
+  * @brief  输出运行中(需要快速停止才能休眠,输出电流由控制器给出)
+  * @param  NULL
+  * @retval 是否运行中
+**/
+bool Motor_Control_OutputRunning(void)
+{
+	return	!(	(motor_control.stall_flag)
+			||	(motor_control.soft_disable)
+			||	(motor_control.qstop_done)
+			||	(motor_control.soft_brake)
+			||	(!_angle.rectify_valid)
+			||	(motor_control.mode_run == Control_Mode_Stop)
+			||	((motor_control.ferr_flag) && (motor_control.ferr_react != Fault_React_Decel))
+			);
+}
+
+/**
+  * @brief  位置模式(软位置由跟踪器/重构器/插补器给出,跟随误差有效)
+  * @param  _mode
+  * @retval 是否位置模式
+**/
+static bool Motor_Control_LocationMode(Motor_Mode _mode)
+{
+	return	(_mode == Motor_Mode_Debug_Location)
+			||	(_mode == Motor_Mode_Digital_Location)
+			||	(_mode == Motor_Mode_Digital_Track)
+			||	(_mode == Motor_Mode_PWM_Location)
+			||	(_mode == Motor_Mode_PULSE_Location);
+}
+
+/**
+  * @brief  软件限位速度包络, by zhbi98
+  * (速度模式没有软位置,以实际位置到限位的距离限制目标速度 v = sqrt(2*down_acc*距离),
+  *  速度跟踪器按减速加速度跟随包络减速,停在限位处)
+  * @param  _speed:目标速度
+  * @retval 限制后的目标速度
+**/
+static int32_t Motor_Control_LimitSpeed(int32_t _speed)
+{
+	int32_t	distance;		//运动方向上到限位的距离
+	float		envelope;		//包络速度的平方
+
+	if(!Move_Limit_Enable)
+		return _speed;
+
+	if(_speed > 0)				distance = Move_Limit_Max + Move_Home_Offset - motor_control.est_location;
+	else if(_speed < 0)		distance = motor_control.est_location - (Move_Limit_Min + Move_Home_Offset);
+	else									return 0;
+	//速度跟踪器滞后包络一个控制周期,提前一个周期的位移
+	distance -= abs(speed_tck.go_speed) / CONTROL_FREQ_HZ;
+
+	//到达或越过限位,只允许向限位内运动
+	if(distance <= 0)
+		return 0;
+
+	envelope = 2.0f * (float)speed_tck.down_acc * (float)distance;
+	if((float)_speed * (float)_speed <= envelope)
+		return _speed;
+	return (_speed > 0) ? (int32_t)sqrtf(envelope) : -(int32_t)sqrtf(envelope);
 }
 
 /**
@@ -1007,9 +1465,29 @@ void Motor_Control_Clear_Stall(void)
 **/
 int32_t Motor_Control_AdvanceCompen(int32_t _speed)
 {
+	/******************** 标定中：使用探测超前角 ********************/
+	if(mc_lead.probe)
+		return (_speed < 0) ? -mc_lead.probe_lead : mc_lead.probe_lead;
+
+	/******************** 已标定：电机专属补偿表(定点线性插值) ********************/
+	if(mc_lead.valid){
+		uint32_t abs_speed = abs(_speed);
+		uint32_t index = abs_speed >> Lead_Speed_SHIFT;
+		int32_t compen;
+		if(index >= (Lead_Table_NUM - 1)){
+			compen = mc_lead.table[Lead_Table_NUM - 1];
+		}
+		else{
+			int32_t frac = abs_speed & ((1 << Lead_Speed_SHIFT) - 1);
+			int32_t diff = mc_lead.table[index + 1] - mc_lead.table[index];
+			compen = mc_lead.table[index] + ((diff * frac) >> Lead_Speed_SHIFT);
+		}
+		return (_speed < 0) ? -compen : compen;
+	}
+
 	/******************** !!!!! 重要1：本补偿表提取自DPS系列代码                                                  !!!!! ********************/
 	/******************** !!!!! 重要2：由于源于其他传感器数据，本补偿表并不完全适合TLE5012和MT6816                !!!!! ********************/
-	/******************** !!!!! 重要3：由于测量传感器的最佳补偿曲线十分费时繁琐，作者并不准备在近期进行校准表测量 !!!!! ********************/
+	/******************** !!!!! 重要3：未标定时使用本表，标定方法见 lead_cali.c                                   !!!!! ********************/
 
 	int32_t compen;
 	if(_speed < 0){
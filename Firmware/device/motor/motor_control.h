@@ -51,6 +51,7 @@ extern "C" {
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "control_config.h"
 
 /****************************************  直接控制(电流控制)  ****************************************/
 /****************************************  直接控制(电流控制)  ****************************************/
@@ -110,6 +111,28 @@ void Control_DCE_Set_Default(void);			//DCE参数恢复
 void Control_DCE_Init(void);
 void Control_DCE_To_Electric(int32_t _location, int32_t _speed);
 
+/****************************************  级联控制(位置控制)  ****************************************/
+/****************************************  级联控制(位置控制)  ****************************************/
+typedef struct{
+	//配置
+	#define De_CASC_KP	100		//默认位置环增益(1/s)
+	bool		valid_kp;				//参数有效标志
+	int32_t	kp;							//位置环增益(速度指令 = kp * 位置误差)
+	bool		enable;					//位置模式使用级联控制器(否则使用DCE)
+	//控制参数
+	int32_t		p_error;			//误差记录
+	int32_t		v_order;			//速度环指令
+}Control_Cascade_Typedef;
+extern Control_Cascade_Typedef casc;
+
+//参数配置
+void Control_Cascade_SetKP(uint16_t _k);		//KP参数配置
+void Control_Cascade_SetEnable(bool _en);		//级联控制器选择
+//初始化
+void Control_Cascade_Init(void);
+void Control_Cascade_To_Electric(int32_t _location, int32_t _speed);
+void Control_Location_To_Electric(int32_t _location, int32_t _speed);
+
 /****************************************  Motor_Contro_Debug  ****************************************/
 /****************************************  Motor_Contro_Debug  ****************************************/
 /**
@@ -127,6 +150,38 @@ extern Motor_Control_Debug_Typedef mc_debug;
 void Motor_MultiDebug_Location(void);	//多功能调试位置
 void Motor_MultiDebug_Speed(void);		//多功能调试速度
 
+/****************************************  超前角补偿表  ****************************************/
+/****************************************  超前角补偿表  ****************************************/
+/**
+  * 超前角补偿表结构体定义
+**/
+typedef struct{
+	bool		valid;					//补偿表有效标志(无效时使用DPS补偿表)
+	bool		probe;					//标定中(使用探测超前角)
+	int16_t	probe_lead;			//探测超前角
+	int16_t	table[Lead_Table_NUM];	//补偿表(速度间隔 2^Lead_Speed_SHIFT)
+}Motor_Control_Lead_Typedef;
+extern Motor_Control_Lead_Typedef mc_lead;
+
+void Motor_Control_SetLeadTable(const int16_t * table, bool valid);	//写入超前角补偿表
+
+/****************************************  换向角超前  ****************************************/
+/****************************************  换向角超前  ****************************************/
+/**
+  * 换向角超前表结构体定义
+**/
+typedef struct{
+	bool		valid;								//超前表有效标志
+	int32_t	speed[Fw_Point_NUM];	//断点速度(脉冲/s)
+	int16_t	angle[Fw_Point_NUM];	//断点超前角(1024 = 360°电角度)
+	int32_t	slope[Fw_Point_NUM];	//断点间斜率(Q16)
+}Motor_Control_Fw_Typedef;
+extern Motor_Control_Fw_Typedef mc_fw;
+
+bool Motor_Control_SetFwTable(const int32_t * speed, const int16_t * angle);	//写入换向角超前断点
+int32_t Motor_Control_FwAdvance(int32_t _speed);			//换向角超前量
+int32_t Motor_Control_FocLocation(int32_t current);		//换向位置
+
 /****************************************  Motor_Control  ****************************************/
 /****************************************  Motor_Control  ****************************************/
 /**
@@ -139,8 +194,18 @@ typedef enum{
 	Control_State_Overload		= 0x03,	//过载
 	Control_State_Stall				= 0x04,	//堵转
 	Control_State_Overtemp		= 0x05,	//过热
+	Control_State_FollowErr		= 0x06,	//跟随误差超限
 }Motor_State;
 
+/**
+  * 故障反应
+**/
+typedef enum{
+	Fault_React_Disable				= 0x00,	//失能(驱动休眠)
+	Fault_React_Brake					= 0x01,	//刹车(绕组短接)
+	Fault_React_Decel					= 0x02,	//减速停止(速度环按减速度停到0)
+}Motor_Fault_React;
+
 /**
   * 模式
 **/
@@ -209,6 +274,8 @@ typedef struct{
 	//输出
 	int32_t		foc_location;		//FOC矢量位置
 	int32_t		foc_current;		//FOC矢量大小
+	uint16_t	out_scale;			//输出缩放系数(1024 = 1.0)(由相电阻辨识得到)
+	int32_t		out_gain;				//增益调度系数(1024 = 1.0)(输出缩放的倒数)
 	//堵转识别
 	uint32_t	stall_time_us;	//堵转计时器
 	bool			stall_flag;			//堵转标志
@@ -216,6 +283,22 @@ typedef struct{
 	uint32_t	overload_time_us;	//过载计时器
 	bool			overload_flag;		//过载标志
 	bool			overtemp_flag;		//过热标志
+	//跟随误差识别
+	#define			De_Ferr_Debounce	20		//默认去抖(控制周期)(1ms)
+	int32_t		ferr_window;			//跟随误差窗口(脉冲)(0为关闭)
+	uint16_t	ferr_debounce;		//跟随误差去抖(控制周期)
+	uint16_t	ferr_count;				//跟随误差计数
+	Motor_Fault_React	ferr_react;	//跟随误差反应
+	bool			ferr_flag;				//跟随误差标志
+	bool			ferr_report;			//跟随误差待上报(CAN异步帧)
+	int32_t		ferr_value;				//触发时的跟随误差
+	//快速停止
+	#define			QStop_Rest_Speed	(Move_Pulse_NUM / 20)	//静止判定速度(0.05转/s)
+	bool			qstop_active;			//快速停止减速中
+	bool			qstop_done;				//快速停止完成(随后休眠)
+	uint32_t	qstop_time_us;		//速度指令到0后的计时
+	//跟踪电流限制
+	bool			track_limit;			//跟踪模式的电流限制生效中(切换模式恢复额定电流)
 	//状态
 	Motor_State		state;			//统一的电机状态
 }Motor_Control_Typedef;
@@ -225,6 +308,9 @@ extern Motor_Control_Typedef motor_control;
 void Motor_Control_SetMotorMode(Motor_Mode _mode);	//控制模式
 void Motor_Control_SetStallSwitch(bool _switch);		//堵转保护开关
 void Motor_Control_SetDefault(void);								//控制模式参数恢复
+void Motor_Control_SetOutScale(uint16_t _scale);		//输出缩放与增益调度
+void Motor_Control_SetFollowError(int32_t _window, uint16_t _debounce, Motor_Fault_React _react);	//跟随误差窗口
+void Motor_Control_SetPosLimit(bool _en, int32_t _min, int32_t _max);	//软件限位
 
 //数据写入
 void Motor_Control_Write_Goal_Location(int32_t value);//写入目标位置
@@ -232,9 +318,11 @@ void Motor_Control_Write_Goal_Speed(int32_t value);		//写入目标速度
 void Motor_Control_Write_Goal_Current(int16_t value);	//写入目标电流
 void Motor_Control_Write_Goal_Disable(uint16_t value);//写入目标失能
 void Motor_Control_Write_Goal_Brake(uint16_t value);	//写入目标刹车
+void Motor_Control_Write_Track_Current(int32_t value);	//写入跟踪模式电流限制
 
 void Motor_Control_Write_PosAsHomeOffset(); //写入磁编码器零点偏移
 bool Motor_Control_Write_Goal_Location_WithTime(int32_t pos, float time); //写入目标位置
+int32_t Motor_Control_Time_Speed(int32_t pos, float time); //按运动时间计算额定速度
 float Motor_Control_Read_Goal_Position(bool is_lap);//读取目标位置
 float Motor_Control_Read_Goal_Speed();//读取目标速度
 float Motor_Control_Read_Goal_FocCurrent();//读取目标电流
@@ -243,7 +331,9 @@ float Motor_Control_Read_Goal_FocCurrent();//读取目标电流
 void Motor_Control_Init(void);											//电机控制初始化
 void Motor_Control_Callback(void);									//控制器任务回调
 void Motor_Control_Clear_Integral(void);						//清除积分
+void Motor_Control_Preload_Integral(int32_t _current);	//预载积分(无扰切换)
 void Motor_Control_Clear_Stall(void);								//清除堵转保护
+bool Motor_Control_OutputRunning(void);							//输出运行中
 int32_t Motor_Control_AdvanceCompen(int32_t _speed);//超前角补偿
 
 #ifdef __cplusplus
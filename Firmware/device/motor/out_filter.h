@@ -0,0 +1,54 @@
+/**
+ * @file out_filter.h
+ *
+ */
+
+#ifndef __OUT_FILTER_H__
+#define __OUT_FILTER_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "control_config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define OUT_FILTER_COEF_NUM 5U /*b0, b1, b2, a1, a2*/
+#define OUT_FILTER_Q 24U /*Coefficient format Q24, |coef| < 128*/
+#define OUT_FILTER_SIG_Q 8U /*Signal format between sections Q8 (mA)*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * Describes one direct form I biquad section, 
+ * y = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2 (a0 = 1).
+ */
+typedef struct {
+    /**< The section takes part in the bank*/
+    bool enable;
+    /**< Coefficients b0, b1, b2, a1, a2 in Q24*/
+    int32_t coef[OUT_FILTER_COEF_NUM];
+    /**< Input and output history in Q8*/
+    int32_t x1;
+    int32_t x2;
+    int32_t y1;
+    int32_t y2;
+} _out_filter_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void out_filter_set(uint8_t _sec, const int32_t * _coef, bool _en);
+void out_filter_reset();
+void out_filter_preload(int32_t _out);
+int32_t out_filter_apply(int32_t _in);
+
+#endif /*__OUT_FILTER_H__*/
@@ -0,0 +1,324 @@
+/**
+ * @file pos_journal.c
+ *
+ * Multi-turn position journal. The encoder is absolute over one turn
+ * only, the turn count is lost with the supply. The location is
+ * recorded to a flash journal when the supply collapses (ADC supply
+ * monitor) and, as a fallback, at standstill after the axis moved a
+ * quarter turn. At power-up the recorded location is reconciled with
+ * the single-turn angle, the axis may have moved up to half a turn
+ * while unpowered.
+ *
+ * Records are appended to two flash pages in turn, the other page is
+ * erased once the present one is half full (after 1s at standstill, the
+ * erase stalls the CPU for about 20ms), the free half page is left for
+ * the power-fail records meanwhile. Programming one record from the
+ * control tick takes about 200us.
+ *
+ * Endurance: a page is specified for 10k erase cycles and is erased 
+ * once every 2 * JR_PAGE_SLOT records, the journal takes about 2.5M 
+ * records. The power-fail record is the one that counts, the rest 
+ * record is written at most once per JR_REST_GAP (5 minutes) however 
+ * often the axis stops, about 290 a day. Cycling around the clock 
+ * with a power cycle every hour lasts more than 20 years, a rest 
+ * record on every stop (one every 2s) would wear the pages out in 
+ * about 2 months.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "pos_journal.h"
+#include "motor_control.h"
+#include "romf103cb.h"
+#include "supply.h"
+#include <string.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+_pos_journal_t pos_journal = {
+    .enable = false,
+    .valid = false,
+    .restored = false,
+};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static uint32_t _jr_addr(uint8_t _page, uint16_t _slot);
+static bool _jr_read(uint8_t _page, uint16_t _slot, _jr_rec_t * rec_p);
+static bool _jr_free(uint8_t _page, uint16_t _slot);
+static bool _jr_page_free(uint8_t _page);
+static bool _jr_write(_pos_journal_t * jr_p, int32_t _loc);
+static void _jr_supply(_pos_journal_t * jr_p);
+static void _jr_rest(_pos_journal_t * jr_p);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Find the newest record and the next free slot, called
+ * at power-up before the control tick is started.
+ * @param _en Whether the multi-turn position is kept.
+ */
+void pos_journal_init(bool _en)
+{
+    _jr_rec_t _rec = {0};
+    bool _found = false;
+    uint8_t _page = 0;
+    uint16_t _slot = 0;
+
+    pos_journal.enable = _en;
+
+    for (uint8_t p = 0; p < 2; p++) {
+        for (uint16_t s = 0; s < JR_PAGE_SLOT; s++) {
+            if (!_jr_read(p, s, &_rec)) continue;
+            /*Sequence numbers wrap, at most 2 * JR_PAGE_SLOT
+            records are alive so the serial order holds*/
+            if (_found && ((int16_t)(_rec.seq - pos_journal.seq) <= 0))
+                continue;
+            _found = true;
+            pos_journal.seq = _rec.seq;
+            pos_journal.saved = (int32_t)(_rec.loc_lo |
+                ((uint32_t)_rec.loc_hi << 16));
+            _page = p;
+            _slot = s + 1;
+        }
+    }
+    pos_journal.valid = _found;
+
+    /*Append after the newest record, slots cut by a
+    power failure are skipped*/
+    while ((_slot < JR_PAGE_SLOT) && !_jr_free(_page, _slot))
+        _slot++;
+
+    /*The control tick is not running yet*/
+    if ((_slot >= JR_ERASE_SLOT) && !_jr_page_free(_page ^ 1))
+        rom_data_clear(&_journal[_page ^ 1]);
+    if (_slot >= JR_PAGE_SLOT) {
+        _page ^= 1;
+        _slot = 0;
+    }
+    pos_journal.page = _page;
+    pos_journal.slot = _slot;
+    pos_journal.erase = false;
+    /*A rest record may follow the first stop*/
+    pos_journal.rest_gap = JR_REST_GAP;
+}
+
+/**
+ * Switch keeping the multi-turn position, the present
+ * location is recorded at once on enabling.
+ * @param _en Whether the multi-turn position is kept.
+ */
+void pos_journal_set_enable(bool _en)
+{
+    if (_en && !pos_journal.enable)
+        pos_journal.dirty = true;
+    pos_journal.enable = _en;
+}
+
+/**
+ * Place the power-up location on the recorded turn.
+ * @param _lap Single-turn location at power-up (pulse).
+ * @return Location nearest the record with the same
+ * single-turn angle, _lap without a record.
+ */
+int32_t pos_journal_reconcile(int32_t _lap)
+{
+    if ((!pos_journal.enable) || (!pos_journal.valid)) return _lap;
+
+    int32_t _d = (_lap - pos_journal.saved) % Move_Pulse_NUM;
+    if (_d >= (Move_Pulse_NUM >> 1)) _d -= Move_Pulse_NUM;
+    else if (_d < -(Move_Pulse_NUM >> 1)) _d += Move_Pulse_NUM;
+
+    pos_journal.restored = true;
+    pos_journal.saved += _d;
+    return pos_journal.saved;
+}
+
+/**
+ * Watch the supply and record the location,
+ * called at 20kHz after the motor control callback.
+ */
+void pos_journal_tick_work()
+{
+    if (!pos_journal.enable) return;
+
+    _jr_supply(&pos_journal);
+    if (pos_journal.pf) return;
+
+    /*Standstill time, gates the rest record and the page erase*/
+    if (abs(motor_control.est_speed) >= QStop_Rest_Speed)
+        pos_journal.rest_tick = 0;
+    else if (pos_journal.rest_tick < JR_REST_TICK)
+        pos_journal.rest_tick++;
+    if (pos_journal.rest_gap < JR_REST_GAP)
+        pos_journal.rest_gap++;
+
+    if (pos_journal.dirty) {
+        if (_jr_write(&pos_journal, motor_control.real_location))
+            pos_journal.dirty = false;
+        return;
+    }
+    _jr_rest(&pos_journal);
+}
+
+/**
+ * Erase the other page once the present one is half full,
+ * only after 1s at standstill as the rest record, called
+ * from the main loop.
+ */
+void pos_journal_solve()
+{
+    if (!pos_journal.erase) return;
+    if (pos_journal.rest_tick < JR_REST_TICK) return;
+
+    __disable_irq();
+    rom_data_clear(&_journal[pos_journal.page ^ 1]);
+    pos_journal.erase = false;
+    __enable_irq();
+}
+
+/**
+ * Flash address of a record slot.
+ */
+static uint32_t _jr_addr(uint8_t _page, uint16_t _slot)
+{
+    return _journal[_page].begin_add +
+        (uint32_t)_slot * sizeof(_jr_rec_t);
+}
+
+/**
+ * Read a record slot.
+ * @param rec_p Record read.
+ * @return Whether the record is complete.
+ */
+static bool _jr_read(uint8_t _page, uint16_t _slot, _jr_rec_t * rec_p)
+{
+    memcpy(rec_p, (const void *)(uintptr_t)_jr_addr(_page, _slot),
+        sizeof(_jr_rec_t));
+    return rec_p->check == (uint16_t)(JR_CHECK ^
+        rec_p->loc_lo ^ rec_p->loc_hi ^ rec_p->seq);
+}
+
+/**
+ * Whether a record slot is erased.
+ */
+static bool _jr_free(uint8_t _page, uint16_t _slot)
+{
+    const uint16_t * _p = 
+        (const uint16_t *)(uintptr_t)_jr_addr(_page, _slot);
+
+    for (uint8_t i = 0; i < sizeof(_jr_rec_t) / 2; i++)
+        if (_p[i] != 0xFFFF) return false;
+    return true;
+}
+
+/**
+ * Whether a whole page is erased.
+ */
+static bool _jr_page_free(uint8_t _page)
+{
+    for (uint16_t s = 0; s < JR_PAGE_SLOT; s++)
+        if (!_jr_free(_page, s)) return false;
+    return true;
+}
+
+/**
+ * Append a record, a full page moves on to the
+ * other page once that one is erased.
+ * @param _loc Location (pulse).
+ * @return Whether the record was written.
+ */
+static bool _jr_write(_pos_journal_t * jr_p, int32_t _loc)
+{
+    _jr_rec_t _rec = {0};
+
+    if (jr_p->slot >= JR_PAGE_SLOT) {
+        if (jr_p->erase) return false;
+        jr_p->page ^= 1;
+        jr_p->slot = 0;
+    }
+
+    _rec.loc_lo = (uint16_t)((uint32_t)_loc);
+    _rec.loc_hi = (uint16_t)((uint32_t)_loc >> 16);
+    _rec.seq = jr_p->seq + 1;
+    _rec.check = (uint16_t)(JR_CHECK ^ _rec.loc_lo ^
+        _rec.loc_hi ^ _rec.seq);
+
+    _f103_rom_t * rom_p = &_journal[jr_p->page];
+    rom_data_begin(rom_p);
+    rom_write_set_addr(rom_p, _jr_addr(jr_p->page, jr_p->slot));
+    rom_write_data16(rom_p, (uint16_t *)&_rec, sizeof(_jr_rec_t) / 2);
+    rom_data_end(rom_p);
+    jr_p->rest_gap = 0;
+
+    bool _ok = _jr_read(jr_p->page, jr_p->slot, &_rec) &&
+        (_rec.seq == (uint16_t)(jr_p->seq + 1));
+    if (_ok) {
+        jr_p->seq = _rec.seq;
+        jr_p->saved = _loc;
+        jr_p->valid = true;
+    }
+
+    /*Erase ahead of the page switch*/
+    if (++jr_p->slot == JR_ERASE_SLOT)
+        jr_p->erase = true;
+    return _ok;
+}
+
+/**
+ * Power-fail detection, the supply falling below 3/4 of its
+ * average trips, the threshold follows any supply voltage.
+ */
+static void _jr_supply(_pos_journal_t * jr_p)
+{
+    int32_t _v = (int32_t)_supply() << 8;
+
+    if (jr_p->pf) {
+        /*Brownout, the supply came back*/
+        if (_v * 8 > jr_p->avg * 7) {
+            jr_p->pf = false;
+            jr_p->pf_count = 0;
+        }
+        return;
+    }
+
+    jr_p->avg += (_v - jr_p->avg) >> JR_AVG_SHIFT;
+
+    if ((jr_p->avg >= (int32_t)(JR_SUPPLY_MIN << 8)) &&
+        (_v * 4 < jr_p->avg * 3)) {
+        if (++jr_p->pf_count < JR_PF_TICK) return;
+        jr_p->pf = true;
+        jr_p->pf_num++;
+        _jr_write(jr_p, motor_control.real_location);
+    } else {
+        jr_p->pf_count = 0;
+    }
+}
+
+/**
+ * Fallback record at standstill, if the power-fail
+ * record is lost the axis is still on the recorded
+ * turn as long as it did not move since. Rate limited 
+ * to one per JR_REST_GAP for the flash endurance.
+ */
+static void _jr_rest(_pos_journal_t * jr_p)
+{
+    if (jr_p->rest_tick < JR_REST_TICK) return;
+    if (jr_p->rest_gap < JR_REST_GAP) return;
+    if (jr_p->valid && (abs(motor_control.real_location -
+        jr_p->saved) < JR_REST_MOVE)) return;
+
+    _jr_write(jr_p, motor_control.real_location);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file pos_journal.h
+ *
+ */
+
+#ifndef __POS_JOURNAL_H__
+#define __POS_JOURNAL_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "control_config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define JR_PAGE_SLOT 128U /*8 byte records per 1K flash page*/
+#define JR_ERASE_SLOT (JR_PAGE_SLOT / 2) /*Erase the other page once half full*/
+#define JR_CHECK 0x5AA5U /*Record check seed*/
+#define JR_REST_TICK 20000U /*At rest for 1s before a record (20kHz)*/
+#define JR_REST_MOVE (Move_Pulse_NUM / 4) /*Record at rest after moving a quarter turn*/
+#define JR_REST_GAP (300U * 20000U) /*At most one rest record per 5 minutes (20kHz)*/
+#define JR_AVG_SHIFT 12U /*Supply average 1/4096 per tick, about 0.2s*/
+#define JR_PF_TICK 4U /*Supply below 3/4 of the average for 200us*/
+#define JR_SUPPLY_MIN 400U /*Supply average (raw) below this never trips*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * One journal record, the check is written last so
+ * a record cut by the power failure is not valid.
+ */
+typedef struct {
+    uint16_t loc_lo;
+    uint16_t loc_hi;
+    uint16_t seq;
+    uint16_t check;
+} _jr_rec_t;
+
+/**
+ * Describes the multi-turn position journal, two flash
+ * pages are written in turn so that each page is erased
+ * once every 2 * JR_PAGE_SLOT records.
+ */
+typedef struct {
+    /**< Keep the multi-turn position*/
+    bool enable;
+    /**< A record was found or written*/
+    bool valid;
+    /**< The position was restored at power-up*/
+    bool restored;
+    /**< Write a record on the next tick*/
+    bool dirty;
+    /**< Newest record*/
+    int32_t saved;
+    uint16_t seq;
+    /**< Next free slot, JR_PAGE_SLOT on a full page*/
+    uint8_t page;
+    uint16_t slot;
+    /**< The other page must be erased*/
+    bool erase;
+    /**< Supply average (Q8, raw)*/
+    int32_t avg;
+    uint8_t pf_count;
+    /**< Power failure, until the supply recovers*/
+    bool pf;
+    uint16_t pf_num;
+    /**< Standstill counter*/
+    uint16_t rest_tick;
+    /**< Ticks since the last record was programmed*/
+    uint32_t rest_gap;
+} _pos_journal_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void pos_journal_init(bool _en);
+void pos_journal_set_enable(bool _en);
+int32_t pos_journal_reconcile(int32_t _lap);
+void pos_journal_tick_work();
+void pos_journal_solve();
+
+#endif /*__POS_JOURNAL_H__*/
@@ -0,0 +1,352 @@
+/**
+ * @file sys_ident.c
+ *
+ * Frequency response identification of the position loop plant. 
+ * A chirp or PRBS current perturbation is added to the DCE output, 
+ * the total current and the position are recorded at 20kHz / decim 
+ * and a single complex FFT (CMSIS-DSP) in the main loop gives the 
+ * position / current bode response and its resonance peaks.
+ *
+ * RAM: 2KB record (transformed in place) and 512 bytes of bode data.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "sys_ident.h"
+#include "motor_control.h"
+#include "sin_map.h"
+#include "arm_math.h"
+#include "arm_const_structs.h"
+#include <math.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define SYSID_TICK_HZ 20000U
+#define SYSID_NORM_BIT 28U /*Peak of each channel before the FFT*/
+#define SYSID_MIN_EXCITE 1e-4f /*Relative current bin magnitude treated as not excited*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+_sys_ident_t sys_ident = {
+    ._start = false,
+    .state = SYSID_STATE_IDLE,
+};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static int32_t _sin(uint32_t _phase);
+static int8_t _normalize(int32_t * data_p, uint16_t len);
+static void _state_settle_execute(_sys_ident_t * id_p);
+static void _state_record_execute(_sys_ident_t * id_p);
+static void _excite_next(_sys_ident_t * id_p);
+static void _peak_search(_sys_ident_t * id_p);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Start the identification, the motor must be holding 
+ * position in DCE mode, the perturbation rides on top 
+ * of the DCE output.
+ * @param _type SYSID_CHIRP or SYSID_PRBS.
+ * @param _amp Perturbation amplitude (mA).
+ * @param _decim Control ticks per sample, 0 for the default.
+ * @return Whether the identification was started.
+ */
+bool sys_ident_start(uint8_t _type, int32_t _amp, uint8_t _decim)
+{
+    if (sys_ident._start) return false;
+    if (motor_control.mode_run != Motor_Mode_Digital_Location) 
+        return false;
+    if ((_amp <= 0) || (_amp > Current_Rated_Current)) 
+        return false;
+
+    if (_decim == 0) _decim = SYSID_DECIM_DEF;
+    if (_decim > SYSID_DECIM_MAX) _decim = SYSID_DECIM_MAX;
+
+    sys_ident.type = _type;
+    sys_ident.amp = _amp;
+    sys_ident.decim = _decim;
+    sys_ident.excite = 0;
+    sys_ident.tick = 0;
+    sys_ident.state = SYSID_STATE_SETTLE;
+    sys_ident._start = true;
+    return true;
+}
+
+/**
+ * Current perturbation added to the DCE 
+ * output on the next control tick.
+ * @return Perturbation (mA), 0 when idle.
+ */
+int32_t sys_ident_excite()
+{
+    return sys_ident.excite;
+}
+
+/**
+ * Frequency of a bode bin.
+ * @param _bin Bin index (0 ~ SYSID_BIN_NUM - 1).
+ * @return Frequency (0.1Hz).
+ */
+uint32_t sys_ident_bin_freq(uint16_t _bin)
+{
+    return ((uint32_t)_bin * SYSID_TICK_HZ * 10U) / 
+        ((uint32_t)sys_ident.decim * SYSID_FFT_LEN);
+}
+
+/**
+ * Called at 20kHz after the motor control callback, 
+ * records the tick that just ran and prepares the 
+ * perturbation of the next one.
+ */
+void sys_ident_tick_work()
+{
+    if (!sys_ident._start) return;
+
+    if (motor_control.mode_run != Motor_Mode_Digital_Location) {
+        sys_ident.excite = 0;
+        sys_ident.state = SYSID_STATE_ABORT;
+        sys_ident._start = false;
+        return;
+    }
+
+    switch (sys_ident.state) {
+    case SYSID_STATE_SETTLE:
+        _state_settle_execute(&sys_ident);
+        break;
+    case SYSID_STATE_RECORD:
+        _state_record_execute(&sys_ident);
+        break;
+    default: break;
+    }
+}
+
+/**
+ * Keep the perturbation off until the position loop is quiet, 
+ * then prepare the chirp sweep (first bin to 0.4 of the 
+ * sampling rate over one record) or the PRBS generator.
+ */
+static void _state_settle_execute(_sys_ident_t * id_p)
+{
+    if (++id_p->tick < SYSID_SETTLE_TICK) return;
+
+    uint32_t _ticks = (uint32_t)id_p->decim * SYSID_FFT_LEN;
+    uint32_t inc_hi = (uint32_t)(0x66666666UL / id_p->decim); /*0.4 / decim*/
+
+    id_p->inc = (uint32_t)(0x100000000ULL / _ticks);
+    id_p->inc_step = (inc_hi - id_p->inc) / _ticks;
+    id_p->phase = 0;
+    id_p->lfsr = 0x1FF;
+
+    id_p->ref = motor_control.est_location;
+    id_p->sum_u = 0;
+    id_p->sum_y = 0;
+    id_p->sub = 0;
+    id_p->index = 0;
+    id_p->state = SYSID_STATE_RECORD;
+
+    _excite_next(id_p);
+}
+
+/**
+ * Average the current and position over one sample 
+ * period, the perturbation of the next tick is computed 
+ * here so the ISR cost stays a few tens of cycles.
+ */
+static void _state_record_execute(_sys_ident_t * id_p)
+{
+    id_p->sum_u += motor_control.foc_current;
+    id_p->sum_y += motor_control.est_location - id_p->ref;
+
+    if (++id_p->sub >= id_p->decim) {
+        id_p->buf[id_p->index * 2] = id_p->sum_u;
+        id_p->buf[id_p->index * 2 + 1] = id_p->sum_y;
+        id_p->sum_u = 0;
+        id_p->sum_y = 0;
+        id_p->sub = 0;
+
+        if (++id_p->index >= SYSID_FFT_LEN) {
+            id_p->excite = 0;
+            id_p->state = SYSID_STATE_SOLVE;
+            return;
+        }
+
+        /*x^9 + x^5 + 1, period 511*/
+        uint16_t _bit = ((id_p->lfsr >> 8) ^ (id_p->lfsr >> 4)) & 0x01;
+        id_p->lfsr = ((id_p->lfsr << 1) | _bit) & 0x1FF;
+    }
+
+    _excite_next(id_p);
+}
+
+/**
+ * PRBS holds one chip per sample, the chirp 
+ * frequency rises linearly every tick.
+ */
+static void _excite_next(_sys_ident_t * id_p)
+{
+    if (id_p->type == SYSID_PRBS) {
+        id_p->excite = (id_p->lfsr & 0x01) ? id_p->amp : -id_p->amp;
+    }
+    else {
+        id_p->excite = (id_p->amp * _sin(id_p->phase)) >> SIN_PI_M2_DPIYBIT;
+        id_p->phase += id_p->inc;
+        id_p->inc += id_p->inc_step;
+    }
+}
+
+/**
+ * Transform the record and compute the position / current 
+ * response, runs in the main loop once the record is full.
+ * Current and position are packed as the real and imaginary 
+ * parts of one complex sequence and separated after the FFT: 
+ * U(k) = (Z(k) + Z*(N-k)) / 2, Y(k) = (Z(k) - Z*(N-k)) / 2j.
+ */
+void sys_ident_solve()
+{
+    if (sys_ident.state != SYSID_STATE_SOLVE) return;
+
+    int32_t * buf = sys_ident.buf;
+
+    /*Separate normalisation of both channels, 
+    the shifts are removed from the ratio*/
+    int8_t su = _normalize(&buf[0], SYSID_FFT_LEN);
+    int8_t sy = _normalize(&buf[1], SYSID_FFT_LEN);
+    float _scale = ldexpf(1.0f, su - sy);
+
+    /*Hann window*/
+    for (uint16_t n = 0; n < SYSID_FFT_LEN; n++) {
+        uint32_t _phase = (uint32_t)n * (0x100000000ULL / SYSID_FFT_LEN);
+        int32_t w = (1 << SIN_PI_M2_DPIYBIT) - 
+            _sin(_phase + 0x40000000UL); /*1 - cos, 2^13 full scale*/
+        buf[n * 2] = (int32_t)(((int64_t)buf[n * 2] * w) >> 13);
+        buf[n * 2 + 1] = (int32_t)(((int64_t)buf[n * 2 + 1] * w) >> 13);
+    }
+
+    arm_cfft_q31(&arm_cfft_sR_q31_len256, buf, 0, 1);
+
+    float u_max = 0.0f;
+    for (uint16_t k = 1; k < SYSID_BIN_NUM; k++) {
+        float ur = ((float)buf[k * 2] + (float)buf[(SYSID_FFT_LEN - k) * 2]) * 0.5f;
+        float ui = ((float)buf[k * 2 + 1] - (float)buf[(SYSID_FFT_LEN - k) * 2 + 1]) * 0.5f;
+        float _abs = ur * ur + ui * ui;
+        if (_abs > u_max) u_max = _abs;
+    }
+
+    sys_ident.mag[0] = SYSID_MAG_INVALID;
+    sys_ident.pha[0] = 0;
+
+    for (uint16_t k = 1; k < SYSID_BIN_NUM; k++) {
+        float zr = (float)buf[k * 2];
+        float zi = (float)buf[k * 2 + 1];
+        float nr = (float)buf[(SYSID_FFT_LEN - k) * 2];
+        float ni = (float)buf[(SYSID_FFT_LEN - k) * 2 + 1];
+
+        float ur = (zr + nr) * 0.5f;
+        float ui = (zi - ni) * 0.5f;
+        float yr = (zi + ni) * 0.5f;
+        float yi = (nr - zr) * 0.5f;
+
+        float u_abs = ur * ur + ui * ui;
+        if (u_abs < u_max * SYSID_MIN_EXCITE) {
+            sys_ident.mag[k] = SYSID_MAG_INVALID;
+            sys_ident.pha[k] = 0;
+            continue;
+        }
+
+        /*H = Y / U = Y * U' / |U|^2*/
+        float hr = (yr * ur + yi * ui) / u_abs * _scale;
+        float hi = (yi * ur - yr * ui) / u_abs * _scale;
+
+        float _db = 10.0f * log10f(hr * hr + hi * hi + 1e-20f);
+        float _deg = atan2f(hi, hr) * (180.0f / PI);
+        if (_db > 300.0f) _db = 300.0f;
+        if (_db < -300.0f) _db = -300.0f;
+        sys_ident.mag[k] = (int16_t)(_db * 100.0f);
+        sys_ident.pha[k] = (int16_t)(_deg * 100.0f);
+    }
+
+    _peak_search(&sys_ident);
+
+    sys_ident.state = SYSID_STATE_DONE;
+    sys_ident._start = false;
+}
+
+/**
+ * Local maxima of the magnitude response, the 
+ * largest SYSID_PEAK_NUM are kept in descending order.
+ */
+static void _peak_search(_sys_ident_t * id_p)
+{
+    for (uint8_t i = 0; i < SYSID_PEAK_NUM; i++)
+        id_p->peak[i] = 0;
+
+    for (uint16_t k = 2; k < SYSID_BIN_NUM - 1; k++) {
+        int16_t m = id_p->mag[k];
+        if ((m == SYSID_MAG_INVALID) || 
+            (m <= id_p->mag[k - 1]) || 
+            (m < id_p->mag[k + 1])) continue;
+
+        for (uint8_t i = 0; i < SYSID_PEAK_NUM; i++) {
+            if ((id_p->peak[i] != 0) && 
+                (m <= id_p->mag[id_p->peak[i]])) continue;
+            for (uint8_t j = SYSID_PEAK_NUM - 1; j > i; j--)
+                id_p->peak[j] = id_p->peak[j - 1];
+            id_p->peak[i] = k;
+            break;
+        }
+    }
+}
+
+/**
+ * Remove the mean of one interleaved channel and 
+ * shift it so that its peak is about 2^SYSID_NORM_BIT.
+ * @param data_p First sample of the channel, stride 2.
+ * @param len Number of samples.
+ * @return Applied left shift (negative for right shift).
+ */
+static int8_t _normalize(int32_t * data_p, uint16_t len)
+{
+    int64_t _sum = 0;
+    for (uint16_t i = 0; i < len; i++) 
+        _sum += data_p[i * 2];
+    int32_t _mean = (int32_t)(_sum / len);
+
+    uint32_t _max = 0;
+    for (uint16_t i = 0; i < len; i++) {
+        data_p[i * 2] -= _mean;
+        uint32_t _abs = abs(data_p[i * 2]);
+        if (_abs > _max) _max = _abs;
+    }
+
+    int8_t _shift = 0;
+    if (_max == 0) return 0;
+    while ((_max << 1) < (1UL << SYSID_NORM_BIT)) { _max <<= 1; _shift++; }
+    while (_max >= (2UL << SYSID_NORM_BIT)) { _max >>= 1; _shift--; }
+
+    for (uint16_t i = 0; i < len; i++) {
+        if (_shift >= 0) data_p[i * 2] <<= _shift;
+        else data_p[i * 2] >>= -_shift;
+    }
+    return _shift;
+}
+
+/**
+ * Sine of a 32 bit phase from the driver sine table.
+ * @param _phase Phase, 2^32 = one cycle.
+ * @return Sine, 2^SIN_PI_M2_DPIYBIT full scale.
+ */
+static int32_t _sin(uint32_t _phase)
+{
+    return sin_pi_m2[_phase >> 22];
+}
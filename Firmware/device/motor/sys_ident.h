@@ -0,0 +1,110 @@
+/**
+ * @file sys_ident.h
+ *
+ */
+
+#ifndef __SYS_IDENT_H__
+#define __SYS_IDENT_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "control_config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define SYSID_FFT_LEN 256U /*Record length, also the FFT length*/
+#define SYSID_BIN_NUM (SYSID_FFT_LEN / 2U) /*Bode bins 0 ~ Nyquist*/
+#define SYSID_PEAK_NUM 3U /*Reported resonance peaks*/
+#define SYSID_DECIM_DEF 8U /*Default decimation, 2.5kHz sampling*/
+#define SYSID_DECIM_MAX 32U
+#define SYSID_SETTLE_TICK 2000U /*Quiet time before recording (100ms at 20kHz)*/
+#define SYSID_MAG_INVALID INT16_MIN /*Bin not excited*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+enum {
+    /**< The identification is idle*/
+    SYSID_STATE_IDLE = 0x00,
+    /**< Let the position loop settle*/
+    SYSID_STATE_SETTLE,
+    /**< Inject the perturbation and record*/
+    SYSID_STATE_RECORD,
+    /**< Record finished, FFT pending in the main loop*/
+    SYSID_STATE_SOLVE,
+    /**< Bode response and peaks are ready*/
+    SYSID_STATE_DONE,
+    /**< Aborted, the DCE mode was left*/
+    SYSID_STATE_ABORT,
+};
+
+/**
+ * Describes the perturbation injected on top of the 
+ * DCE output and the recorded response.
+ */
+typedef uint8_t _sys_ident_state_t;
+
+enum {
+    /**< Linear sine sweep from the first bin to 0.4 fs*/
+    SYSID_CHIRP = 0x00,
+    /**< 9 bit maximum length sequence, one chip per sample*/
+    SYSID_PRBS,
+};
+
+/**
+ * Describes the perturbation injected on top of the 
+ * DCE output and the recorded response.
+ */
+typedef struct {
+    /**< Whether to start identification*/
+    uint8_t _start;
+    /**< Ongoing identification steps*/
+    _sys_ident_state_t state;
+    /**< Perturbation type and amplitude (mA)*/
+    uint8_t type;
+    int32_t amp;
+    /**< Control ticks per recorded sample*/
+    uint8_t decim;
+    uint8_t sub;
+    uint16_t tick;
+    uint16_t index;
+    /**< Position at the start of recording*/
+    int32_t ref;
+    int32_t sum_u;
+    int32_t sum_y;
+    /**< Chirp phase and phase increment (2^32 = 1 cycle)*/
+    uint32_t phase;
+    uint32_t inc;
+    uint32_t inc_step;
+    uint16_t lfsr;
+    /**< Current perturbation of the next control tick*/
+    int32_t excite;
+    /**< Current (real) and position (imaginary) record, 
+    transformed in place by a single complex FFT*/
+    int32_t buf[SYSID_FFT_LEN * 2];
+    /**< Position / current response, 0.01dB (counts/mA) 
+    and 0.01deg per bin*/
+    int16_t mag[SYSID_BIN_NUM];
+    int16_t pha[SYSID_BIN_NUM];
+    /**< Bins of the largest resonance peaks, 0 if none*/
+    uint16_t peak[SYSID_PEAK_NUM];
+} _sys_ident_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+bool sys_ident_start(uint8_t _type, int32_t _amp, uint8_t _decim);
+int32_t sys_ident_excite();
+uint32_t sys_ident_bin_freq(uint16_t _bin);
+void sys_ident_tick_work();
+void sys_ident_solve();
+
+#endif /*__SYS_IDENT_H__*/
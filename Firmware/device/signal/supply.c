@@ -0,0 +1,28 @@
+/**
+ * @file supply.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "supply.h"
+#include "adc.h"
+
+/**********************
+ * GLOBAL FUNCTIONS
+ **********************/
+
+extern uint16_t whole_adc_data[2][12];
+
+/**
+ * Get the supply voltage of the motor drive (ADC1_IN0 through 
+ * the divider, raw 12 bit), it is used for power-fail detection.
+ */
+uint16_t _supply()
+{
+    uint16_t * _adc_p = NULL;
+    _adc_p = whole_adc_data[0];
+    return _adc_p[0];
+}
@@ -0,0 +1,21 @@
+/**
+ * @file supply.h
+ *
+ */
+
+#ifndef __SUPPLY_H__
+#define __SUPPLY_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdint.h>
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+uint16_t _supply();
+
+#endif /*__SUPPLY_H__*/
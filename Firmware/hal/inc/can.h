@@ -11,15 +11,86 @@
  *********************/
 
 #include "main.h"
+#include "can_ring.h"
 
 /*********************
  *      DEFINES
  *********************/
 
+#define CAN_TX_NUM 16U /*Transmit queue (frames)*/
+#define CAN_TX_TIMEOUT 20U /*A frame is aborted after 20ms in a mailbox*/
+#define CAN_BAUD_DEF 500000U /*Bit rate without a valid setting (bit/s)*/
+#define CAN_BUSOFF_WAIT_MIN 10U /*First recovery 10ms after the bus-off*/
+#define CAN_BUSOFF_WAIT_MAX 1000U /*Doubled per bus-off up to 1s*/
+#define CAN_BUSOFF_STABLE 1000U /*The wait restarts after 1s on the bus*/
+
+/*Reaction of the motor to a bus-off*/
+#define CAN_REACT_NONE 0U /*Keeps the last setpoint*/
+#define CAN_REACT_QSTOP 1U /*Quick-stops and disables, as 0x01*/
+
 /**********************
  *      TYPEDEFS
  **********************/
 
+/**
+ * One queued transmit frame.
+ */
+typedef struct {
+    _can_frame_t frame;
+    /**< Order of sending*/
+    uint32_t seq;
+    bool used;
+} _can_tx_slot_t;
+
+/**
+ * Describes the transmit queue statistics.
+ */
+typedef struct {
+    /**< Frames waiting for a mailbox*/
+    uint16_t depth;
+    uint16_t depth_max;
+    /**< Frames dropped on a full queue*/
+    uint32_t drops;
+    /**< Frames aborted after CAN_TX_TIMEOUT*/
+    uint32_t timeouts;
+} _can_tx_stat_t;
+
+enum {
+    CAN_ERR_ACTIVE = 0,
+    CAN_ERR_WARNING, /*A counter reached 96*/
+    CAN_ERR_PASSIVE, /*A counter exceeded 127*/
+    CAN_ERR_BUSOFF, /*The transmit counter exceeded 255*/
+};
+
+/**
+ * Describes the error state supervision, the state 
+ * and the counters follow the ESR register.
+ */
+typedef struct {
+    /**< Error state (CAN_ERR_x)*/
+    uint8_t state;
+    /**< Transmit and receive error counters*/
+    uint8_t tec;
+    uint8_t rec;
+    /**< Entries into each error state*/
+    uint16_t warnings;
+    uint16_t passives;
+    uint16_t busoffs;
+    /**< Recoveries that left the bus-off, and the ones 
+    followed by a bus-off within CAN_BUSOFF_STABLE*/
+    uint16_t recoveries;
+    uint16_t fails;
+    /**< Protocol errors (stuff, form, ACK, bit, CRC)*/
+    uint32_t errors;
+    /**< Wait before the next recovery (ms)*/
+    uint16_t wait;
+    /**< HAL tick of the bus-off and of the last recovery*/
+    uint32_t off_tick;
+    uint32_t on_tick;
+    /**< Recovery started, until the bus-off flag clears*/
+    bool recovering;
+} _can_err_stat_t;
+
 /* USER CODE BEGIN Includes */
 extern CAN_TxHeaderTypeDef TxHeader;
 extern CAN_RxHeaderTypeDef RxHeader;
@@ -27,6 +98,10 @@ extern CAN_HandleTypeDef hcan;
 extern uint32_t TxMailbox;
 extern uint8_t TxData[8];
 extern uint8_t RxData[8];
+extern _can_ring_t can_rx_ring;
+extern volatile uint32_t can_rx_overrun;
+extern _can_tx_stat_t can_tx_stat;
+extern _can_err_stat_t can_err_stat;
 /* USER CODE END Includes */
 
 /**********************
@@ -34,6 +109,11 @@ extern uint8_t RxData[8];
  **********************/
 
 void x35_can_init();
+void x35_can_filter(uint32_t _node);
+bool x35_can_timing(uint32_t _rate, CAN_InitTypeDef * init_p);
+uint32_t x35_can_baud(uint32_t _rate, bool _detect);
 void CAN_Send(CAN_TxHeaderTypeDef * pHeader, uint8_t * data);
+void CAN_Tx_Check();
+void CAN_Err_Check();
 
 #endif /*__CAN_H__*/
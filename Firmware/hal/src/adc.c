@@ -91,6 +91,9 @@ void x35_adc1_init(void)
     /* USER CODE BEGIN ADC1_Init 2 */
     HAL_ADCEx_Calibration_Start(&hadc1);
     HAL_ADC_Start_DMA(&hadc1, (uint32_t*)&whole_adc_data[0][0], 2);
+    /*The samples are only read, no interrupt 
+    for each conversion (every 21us)*/
+    __HAL_DMA_DISABLE_IT(&hdma_adc1, DMA_IT_TC | DMA_IT_HT);
 
     /* USER CODE END ADC1_Init 2 */
 
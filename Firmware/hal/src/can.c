@@ -23,11 +23,21 @@
 #include "stm32f1xx_hal.h"
 #include "setup.h"
 #include "can.h"
+#include "can_ring.h"
+#include "clk_sync.h"
+#include "can_protocol.h"
+#include <string.h>
 
 /*********************
  *      DEFINES
  *********************/
 
+#define CAN_NODE_SHIFT 7U /*StdId = node << 7 | command*/
+#define CAN_NODE_MASK 0x0FU /*4 bit node ID, 0 is broadcast*/
+#define CAN_MAILBOX_NUM 3U
+#define CAN_SAMPLE_POINT 875U /*Sample point (1/1000 bit, CiA 301)*/
+#define CAN_BAUD_WAIT 100U /*Listen for traffic 100ms per bit rate*/
+
 /**********************
  *      TYPEDEFS
  **********************/
@@ -44,6 +54,51 @@ uint8_t RxData[8] = {0};
 
 uint32_t TxMailbox = 0;
 
+/*Frames to this node, applied from the main loop*/
+_can_ring_t can_rx_ring = {0};
+/*Receive FIFO overruns, frames lost before the ring*/
+volatile uint32_t can_rx_overrun = 0;
+
+/*Transmit queue statistics*/
+_can_tx_stat_t can_tx_stat = {0};
+
+/*Error state supervision*/
+_can_err_stat_t can_err_stat = {
+    .state = CAN_ERR_ACTIVE,
+    .wait = CAN_BUSOFF_WAIT_MIN,
+};
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**< Bit rates tried by the detection, the 
+most common first*/
+static const uint32_t can_rates[] = {
+    500000, 1000000, 250000, 125000, 800000,
+};
+
+/**
+ * Frames waiting for a free mailbox, sent in CAN
+ * priority order (lowest StdId first), in order of
+ * sending within the same StdId.
+ */
+static _can_tx_slot_t tx_queue[CAN_TX_NUM] = {0};
+static uint32_t tx_seq = 0;
+/**< HAL tick each mailbox was loaded at*/
+static uint32_t tx_mb_tick[CAN_MAILBOX_NUM] = {0};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void _can_tx_push(const _can_frame_t * frame_p);
+static int8_t _can_tx_next();
+static void _can_tx_refill();
+static void _can_start(uint32_t _mode);
+static bool _can_listen(uint32_t _rate);
+static void _can_err_state(uint32_t _esr);
+
 /**********************
  *   GLOBAL FUNCTIONS
  **********************/
@@ -66,15 +121,14 @@ void x35_can_init()
     /* USER CODE END CAN_Init 1 */
 
     hcan.Instance = CAN1;
-    hcan.Init.Prescaler = 8; /*36MHz/(5tq+3tq+1tq)/prescaler = 500KHz*/
+    /*Set again with the stored bit rate once the settings are read*/
+    x35_can_timing(CAN_BAUD_DEF, &hcan.Init);
     hcan.Init.Mode = CAN_MODE_NORMAL;
     hcan.Init.SyncJumpWidth = CAN_SJW_1TQ;
-    hcan.Init.TimeSeg1 = CAN_BS1_5TQ;
-    hcan.Init.TimeSeg2 = CAN_BS2_3TQ;
     hcan.Init.TimeTriggeredMode = DISABLE;
-    hcan.Init.AutoBusOff = DISABLE;
+    hcan.Init.AutoBusOff = DISABLE; /*Recovered with a backoff (CAN_Err_Check)*/
     hcan.Init.AutoWakeUp = DISABLE;
-    hcan.Init.AutoRetransmission = DISABLE;
+    hcan.Init.AutoRetransmission = ENABLE; /*Bounded by CAN_TX_TIMEOUT*/
     hcan.Init.ReceiveFifoLocked = DISABLE;
     hcan.Init.TransmitFifoPriority = DISABLE;
     if (HAL_CAN_Init(&hcan) != HAL_OK)
@@ -82,25 +136,11 @@ void x35_can_init()
         Error_Handler();
     }
     /* USER CODE BEGIN CAN_Init 2 */
-    CAN_FilterTypeDef sFilterConfig;
-    /*Filter one (stack light blink)*/
-    sFilterConfig.FilterBank = 0;
-    sFilterConfig.FilterMode = CAN_FILTERMODE_IDMASK;
-    sFilterConfig.FilterScale = CAN_FILTERSCALE_32BIT;
-    sFilterConfig.FilterIdHigh = 0x0000;
-    sFilterConfig.FilterIdLow = 0x0000;
-    sFilterConfig.FilterMaskIdHigh = 0x0000;
-    sFilterConfig.FilterMaskIdLow = 0x0000;
-    sFilterConfig.FilterFIFOAssignment = CAN_RX_FIFO0;
-    sFilterConfig.FilterActivation = ENABLE;
-    sFilterConfig.SlaveStartFilterBank = 14;
-    if (HAL_CAN_ConfigFilter(&hcan, 
-        &sFilterConfig) != HAL_OK)
-    {
-        /*Filter configuration Error*/
-        Error_Handler();
-    }
+    /*Reprogrammed with the stored node 
+    ID once the settings are read*/
+    x35_can_filter(_setup.can_id);
 
+    can_ring_init(&can_rx_ring);
     HAL_CAN_Start(&hcan); /*Start CAN*/
 
     HAL_CAN_ActivateNotification(&hcan,
@@ -161,16 +201,16 @@ void HAL_CAN_MspInit(CAN_HandleTypeDef *canHandle)
         /*__HAL_AFIO_REMAP_CAN1_2();*/
 
         /* CAN1 interrupt Init */
-        HAL_NVIC_SetPriority(USB_HP_CAN1_TX_IRQn, 0/*3*/, 0);
+        HAL_NVIC_SetPriority(USB_HP_CAN1_TX_IRQn, 1/*3*/, 0);
         HAL_NVIC_EnableIRQ(USB_HP_CAN1_TX_IRQn);
 
-        HAL_NVIC_SetPriority(USB_LP_CAN1_RX0_IRQn, 0/*3*/, 0);
+        HAL_NVIC_SetPriority(USB_LP_CAN1_RX0_IRQn, 1/*3*/, 0);
         HAL_NVIC_EnableIRQ(USB_LP_CAN1_RX0_IRQn);
 
-        HAL_NVIC_SetPriority(CAN1_RX1_IRQn, 0/*3*/, 0);
+        HAL_NVIC_SetPriority(CAN1_RX1_IRQn, 1/*3*/, 0);
         HAL_NVIC_EnableIRQ(CAN1_RX1_IRQn);
 
-        HAL_NVIC_SetPriority(CAN1_SCE_IRQn, 0/*3*/, 0);
+        HAL_NVIC_SetPriority(CAN1_SCE_IRQn, 1/*3*/, 0);
         HAL_NVIC_EnableIRQ(CAN1_SCE_IRQn);
         /* USER CODE BEGIN CAN1_MspInit 1 */
 
@@ -214,24 +254,255 @@ void HAL_CAN_MspDeInit(CAN_HandleTypeDef* canHandle)
 /* USER CODE BEGIN 1 */
 
 /**
-  * @brief  Add a message to the first free Tx mailbox and activate the
-  *         corresponding transmission request.
-  * @param  hcan pointer to a CAN_HandleTypeDef structure that contains
-  *         the configuration information for the specified CAN.
-  * @param  pHeader pointer to a CAN_TxHeaderTypeDef structure.
-  * @param  aData array containing the payload of the Tx frame.
-  * @param  pTxMailbox pointer to a variable where the function will return
-  *         the TxMailbox used to store the Tx message.
-  *         This parameter can be a value of @arg CAN_Tx_Mailboxes.
-  * @retval HAL status
+  * @brief  Configure the acceptance filters for this node, bank 0 
+  *         passes the standard frames addressed to the node and bank 1 
+  *         the broadcast frames (node 0), the other nodes' traffic is 
+  *         dropped in hardware and takes no receive interrupt. Safe 
+  *         to call while the CAN is running.
+  * @param  _node Node ID (1~15).
+  * @retval None
+  */
+void x35_can_filter(uint32_t _node)
+{
+    CAN_FilterTypeDef sFilterConfig;
+    /*32 bit ID-mask mode, the StdId is in bits 31~21 and 
+    IDE in bit 2, the node bits and IDE must match*/
+    uint16_t _mask = (uint16_t)((CAN_NODE_MASK << CAN_NODE_SHIFT) << 5);
+    uint32_t _ids[2] = {_node & CAN_NODE_MASK, 0};
+
+    for (uint8_t i = 0; i < 2; i++) {
+        sFilterConfig.FilterBank = i;
+        sFilterConfig.FilterMode = CAN_FILTERMODE_IDMASK;
+        sFilterConfig.FilterScale = CAN_FILTERSCALE_32BIT;
+        sFilterConfig.FilterIdHigh = (uint16_t)((_ids[i] << CAN_NODE_SHIFT) << 5);
+        sFilterConfig.FilterIdLow = 0x0000;
+        sFilterConfig.FilterMaskIdHigh = _mask;
+        sFilterConfig.FilterMaskIdLow = CAN_ID_EXT; /*IDE bit*/
+        sFilterConfig.FilterFIFOAssignment = CAN_RX_FIFO0;
+        sFilterConfig.FilterActivation = ENABLE;
+        sFilterConfig.SlaveStartFilterBank = 14;
+        if (HAL_CAN_ConfigFilter(&hcan, 
+            &sFilterConfig) != HAL_OK)
+        {
+            /*Filter configuration Error*/
+            Error_Handler();
+        }
+    }
+}
+
+/**
+  * @brief  Bit timing for a bit rate from the PCLK1 frequency, 8~25 
+  *         time quanta per bit with the sample point nearest 
+  *         CAN_SAMPLE_POINT, more quanta for the same sample point.
+  * @param  _rate Bit rate (bit/s).
+  * @param  init_p Prescaler and time segments to set.
+  * @retval Whether the rate can be set.
+  */
+bool x35_can_timing(uint32_t _rate, CAN_InitTypeDef * init_p)
+{
+    uint32_t _pclk = HAL_RCC_GetPCLK1Freq();
+    int32_t _best = -1;
+
+    if (_rate == 0) return false;
+
+    for (uint32_t _tq = 25; _tq >= 8; _tq--) {
+        if (_pclk % (_rate * _tq)) continue;
+        uint32_t _pre = _pclk / (_rate * _tq);
+        if (_pre > 1024) continue;
+
+        /*SYNC_SEG(1tq) + BS1, then BS2 to the end of the bit*/
+        uint32_t _bs2 = (_tq * (1000 - CAN_SAMPLE_POINT) + 500) / 1000;
+        if (_bs2 < 2) _bs2 = 2;
+        uint32_t _bs1 = _tq - 1 - _bs2;
+        if ((_bs1 > 16) || (_bs2 > 8)) continue;
+
+        int32_t _err = (int32_t)((_tq - _bs2) * 1000 / _tq) - 
+            (int32_t)CAN_SAMPLE_POINT;
+        if (_err < 0) _err = -_err;
+        if ((_best >= 0) && (_err >= _best)) continue;
+
+        _best = _err;
+        init_p->Prescaler = _pre;
+        init_p->TimeSeg1 = (_bs1 - 1) << CAN_BTR_TS1_Pos;
+        init_p->TimeSeg2 = (_bs2 - 1) << CAN_BTR_TS2_Pos;
+    }
+    return _best >= 0;
+}
+
+/**
+  * @brief  Set the bit rate, called at power-up after the settings 
+  *         are read. With the detection the supported rates are 
+  *         tried in listen-only mode (nothing is sent, no error 
+  *         frames or acknowledges disturb the bus) until a frame is 
+  *         received without error, an idle bus keeps _rate.
+  * @param  _rate Bit rate (bit/s), CAN_BAUD_DEF if not supported.
+  * @param  _detect Whether the rate of the bus traffic is detected.
+  * @retval Bit rate set.
+  */
+uint32_t x35_can_baud(uint32_t _rate, bool _detect)
+{
+    if (!x35_can_timing(_rate, &hcan.Init)) _rate = CAN_BAUD_DEF;
+
+    if (_detect) {
+        /*Polled, the frames are discarded*/
+        HAL_NVIC_DisableIRQ(USB_LP_CAN1_RX0_IRQn);
+        HAL_NVIC_DisableIRQ(CAN1_SCE_IRQn);
+
+        for (uint8_t i = 0; i < sizeof(can_rates) / sizeof(can_rates[0]); i++) {
+            if (_can_listen(can_rates[i])) {
+                _rate = can_rates[i];
+                break;
+            }
+        }
+
+        CAN_RxHeaderTypeDef _header;
+        uint8_t _data[8];
+        while (HAL_CAN_GetRxFifoFillLevel(&hcan, CAN_RX_FIFO0) > 0)
+            HAL_CAN_GetRxMessage(&hcan, CAN_RX_FIFO0, &_header, _data);
+        HAL_CAN_ResetError(&hcan);
+
+        HAL_NVIC_EnableIRQ(USB_LP_CAN1_RX0_IRQn);
+        HAL_NVIC_EnableIRQ(CAN1_SCE_IRQn);
+    }
+
+    x35_can_timing(_rate, &hcan.Init);
+    _can_start(CAN_MODE_NORMAL);
+    x35_can_filter(_setup.can_id);
+    return _rate;
+}
+
+/**
+  * @brief  Queue a frame for sending, never blocks. The frame goes to 
+  *         a free mailbox at once unless frames of higher priority are 
+  *         waiting, the rest is loaded from the mailbox empty interrupt. 
+  *         A full queue drops its lowest priority frame.
+  * @param  pHeader pointer to a CAN_TxHeaderTypeDef structure, only 
+  *         the StdId and DLC are used (standard data frames).
+  * @param  data array containing the payload of the Tx frame.
+  * @retval None
   */
 void CAN_Send(CAN_TxHeaderTypeDef * pHeader, uint8_t * data)
 {
-    if (HAL_CAN_AddTxMessage(&hcan, pHeader, 
-        data, &TxMailbox) != HAL_OK)
-    {
-        Error_Handler();
+    _can_frame_t _frame;
+
+    memcpy(_frame.data, data, sizeof(_frame.data));
+    _frame.std_id = pHeader->StdId;
+    _frame.dlc = (uint8_t)pHeader->DLC;
+
+    __disable_irq();
+    _can_tx_push(&_frame);
+    _can_tx_refill();
+    __enable_irq();
+}
+
+/**
+  * @brief  Abort the frames that stayed in a mailbox longer than 
+  *         CAN_TX_TIMEOUT, the hardware retransmits a frame after a 
+  *         lost arbitration or an error until then. Without a receiver 
+  *         (no acknowledge) the mailboxes would stay blocked. 
+  *         Called from the main loop.
+  * @retval None
+  */
+void CAN_Tx_Check()
+{
+    for (uint8_t i = 0; i < CAN_MAILBOX_NUM; i++) {
+        uint32_t _mb = CAN_TX_MAILBOX0 << i;
+
+        __disable_irq();
+        if (HAL_CAN_IsTxMessagePending(&hcan, _mb) && 
+            ((HAL_GetTick() - tx_mb_tick[i]) >= CAN_TX_TIMEOUT)) {
+            /*The abort interrupt loads the next frame*/
+            HAL_CAN_AbortTxRequest(&hcan, _mb);
+            can_tx_stat.timeouts++;
+        }
+        __enable_irq();
+    }
+}
+
+/**
+  * @brief  Follow the error state and recover from the bus-off, called 
+  *         from the main loop. The bus-off is left through the 
+  *         initialisation mode, the controller then takes part again 
+  *         after 128 x 11 recessive bits, the recovery lasts until the 
+  *         bus-off flag clears and is never started again meanwhile. 
+  *         The wait before a recovery doubles from CAN_BUSOFF_WAIT_MIN 
+  *         to CAN_BUSOFF_WAIT_MAX for a node that falls off the bus 
+  *         again within CAN_BUSOFF_STABLE (a short or a wrong bit rate) 
+  *         and restarts after CAN_BUSOFF_STABLE on the bus. The 
+  *         counters fall without an interrupt, the state is read 
+  *         again here.
+  * @retval None
+  */
+void CAN_Err_Check()
+{
+    uint32_t _tick = HAL_GetTick();
+
+    __disable_irq();
+    _can_err_state(READ_REG(hcan.Instance->ESR));
+    __enable_irq();
+
+    if (can_err_stat.recovering) {
+        /*Leave the initialisation mode once entered*/
+        if (READ_BIT(hcan.Instance->MCR, CAN_MCR_INRQ)) {
+            if (READ_BIT(hcan.Instance->MSR, CAN_MSR_INAK))
+                CLEAR_BIT(hcan.Instance->MCR, CAN_MCR_INRQ);
+            return;
+        }
+        /*Still counting the recessive bits*/
+        if (can_err_stat.state == CAN_ERR_BUSOFF) return;
+        can_err_stat.recovering = false;
+        can_err_stat.recoveries++;
+        can_err_stat.on_tick = _tick;
+        return;
+    }
+
+    if (can_err_stat.state != CAN_ERR_BUSOFF) {
+        if ((_tick - can_err_stat.on_tick) >= CAN_BUSOFF_STABLE)
+            can_err_stat.wait = CAN_BUSOFF_WAIT_MIN;
+        return;
     }
+
+    if ((_tick - can_err_stat.off_tick) < can_err_stat.wait) return;
+    /*Not polled for the acknowledge, the main loop goes on*/
+    SET_BIT(hcan.Instance->MCR, CAN_MCR_INRQ);
+    can_err_stat.recovering = true;
+}
+
+/**
+  * @brief  Mailbox empty callbacks, a frame was sent or aborted, 
+  *         load the next queued frame.
+  * @param  hcan pointer to a CAN_HandleTypeDef structure that contains
+  *         the configuration information for the specified CAN.
+  * @retval None
+  */
+void HAL_CAN_TxMailbox0CompleteCallback(CAN_HandleTypeDef * hcan)
+{
+    _can_tx_refill();
+}
+
+void HAL_CAN_TxMailbox1CompleteCallback(CAN_HandleTypeDef * hcan)
+{
+    _can_tx_refill();
+}
+
+void HAL_CAN_TxMailbox2CompleteCallback(CAN_HandleTypeDef * hcan)
+{
+    _can_tx_refill();
+}
+
+void HAL_CAN_TxMailbox0AbortCallback(CAN_HandleTypeDef * hcan)
+{
+    _can_tx_refill();
+}
+
+void HAL_CAN_TxMailbox1AbortCallback(CAN_HandleTypeDef * hcan)
+{
+    _can_tx_refill();
+}
+
+void HAL_CAN_TxMailbox2AbortCallback(CAN_HandleTypeDef * hcan)
+{
+    _can_tx_refill();
 }
 
 /**
@@ -247,28 +518,233 @@ void CAN_Send(CAN_TxHeaderTypeDef * pHeader, uint8_t * data)
   */
 void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef* hcan)
 {
+    _can_frame_t _frame;
+
     /* Get RX message */
-    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &RxHeader, RxData) != HAL_OK)
+    if (HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &RxHeader, _frame.data) != HAL_OK)
     {
         /* Reception Error */
         Error_Handler();
     }
 
+    /*Time stamps are taken at once, the offset is 
+    measured at the reception*/
+    if ((RxHeader.IDE == CAN_ID_STD) && (RxHeader.StdId == CLK_CMD)) {
+        clk_sync_rx(_frame.data);
+        return;
+    }
+
     /**
-     * CAN is configured in identifier masking mode, 
-     * all packets are received, and the corresponding ID packets are filtered 
-     * out in the form of software masks, which is commonly 
-     * referred to as software filtering
+     * The acceptance filters only pass this node and broadcast, 
+     * the check remains for a node ID above 15 in the settings
      */
 
     uint8_t id = (RxHeader.StdId >> 7); // 4Bits ID & 7Bits Msg
-    uint8_t cmd = RxHeader.StdId & 0x7F; // 4Bits ID & 7Bits Msg
     uint8_t canNodeId = _setup.can_id;
     if (id == 0 || id == canNodeId)
     {
-        /*OnCanCmd(cmd, RxData, RxHeader.DLC);*/
-        extern void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len);
-        dev_can_cmd(cmd, RxData, RxHeader.DLC);
+        /*SYNC broadcast, latched by the control tick*/
+        if (RxHeader.StdId == 0x000) dev_can_sync_latch();
+
+        /*The command is parsed and applied from the main loop 
+        (dev_can_rx_solve), not at the control tick priority*/
+        _frame.std_id = RxHeader.StdId;
+        _frame.dlc = (uint8_t)RxHeader.DLC;
+        can_ring_push(&can_rx_ring, &_frame);
+    }
+}
+
+/**
+  * @brief  Error callback, counts the receive FIFO overruns, 
+  *         the frames of a full FIFO are lost in hardware, and 
+  *         the protocol errors, follows the error state.
+  * @param  hcan pointer to a CAN_HandleTypeDef structure that contains
+  *         the configuration information for the specified CAN.
+  * @retval None
+  */
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef * hcan)
+{
+    if (hcan->ErrorCode & HAL_CAN_ERROR_RX_FOV0) can_rx_overrun++;
+    if (hcan->ErrorCode & (HAL_CAN_ERROR_STF | HAL_CAN_ERROR_FOR | 
+        HAL_CAN_ERROR_ACK | HAL_CAN_ERROR_BR | HAL_CAN_ERROR_BD | 
+        HAL_CAN_ERROR_CRC)) can_err_stat.errors++;
+    _can_err_state(READ_REG(hcan->Instance->ESR));
+    HAL_CAN_ResetError(hcan);
+    /*A mailbox may have been freed by a failed transmission*/
+    _can_tx_refill();
+}
+
+/**
+ * Initialise the CAN again with the bit timing 
+ * of hcan.Init, the filters are kept.
+ * @param _mode CAN_MODE_NORMAL or CAN_MODE_SILENT.
+ */
+static void _can_start(uint32_t _mode)
+{
+    hcan.Init.Mode = _mode;
+    HAL_CAN_Stop(&hcan);
+    if (HAL_CAN_Init(&hcan) != HAL_OK)
+    {
+        Error_Handler();
+    }
+    HAL_CAN_Start(&hcan);
+}
+
+/**
+ * Listen for traffic at one bit rate, every frame on 
+ * the bus passes the filter meanwhile.
+ * @return Whether a frame was received, a bit, 
+ * form or CRC error gives up at once.
+ */
+static bool _can_listen(uint32_t _rate)
+{
+    CAN_FilterTypeDef sFilterConfig = {
+        .FilterBank = 0, .FilterMode = CAN_FILTERMODE_IDMASK,
+        .FilterScale = CAN_FILTERSCALE_32BIT,
+        .FilterIdHigh = 0x0000, .FilterIdLow = 0x0000,
+        .FilterMaskIdHigh = 0x0000, .FilterMaskIdLow = 0x0000,
+        .FilterFIFOAssignment = CAN_RX_FIFO0,
+        .FilterActivation = ENABLE, .SlaveStartFilterBank = 14,
+    };
+
+    if (!x35_can_timing(_rate, &hcan.Init)) return false;
+    _can_start(CAN_MODE_SILENT);
+    HAL_CAN_ConfigFilter(&hcan, &sFilterConfig);
+    CLEAR_BIT(hcan.Instance->ESR, CAN_ESR_LEC);
+
+    uint32_t _tick = HAL_GetTick();
+    while ((HAL_GetTick() - _tick) < CAN_BAUD_WAIT) {
+        if (HAL_CAN_GetRxFifoFillLevel(&hcan, CAN_RX_FIFO0) > 0)
+            return true;
+        if (READ_BIT(hcan.Instance->ESR, CAN_ESR_LEC) != 0)
+            return false;
+    }
+    return false;
+}
+
+/**
+ * Take the error state and the counters of the ESR 
+ * register, counts the entries into a worse state. 
+ * Called from the error interrupt or with the 
+ * interrupts disabled.
+ */
+static void _can_err_state(uint32_t _esr)
+{
+    uint8_t _state = CAN_ERR_ACTIVE;
+
+    if (_esr & CAN_ESR_BOFF) _state = CAN_ERR_BUSOFF;
+    else if (_esr & CAN_ESR_EPVF) _state = CAN_ERR_PASSIVE;
+    else if (_esr & CAN_ESR_EWGF) _state = CAN_ERR_WARNING;
+
+    can_err_stat.tec = (uint8_t)((_esr & CAN_ESR_TEC_Msk) >> CAN_ESR_TEC_Pos);
+    can_err_stat.rec = (uint8_t)((_esr & CAN_ESR_REC_Msk) >> CAN_ESR_REC_Pos);
+
+    if (_state > can_err_stat.state) {
+        switch (_state) {
+        case CAN_ERR_WARNING: can_err_stat.warnings++; break;
+        case CAN_ERR_PASSIVE: can_err_stat.passives++; break;
+        case CAN_ERR_BUSOFF:
+            can_err_stat.busoffs++;
+            can_err_stat.off_tick = HAL_GetTick();
+            /*Off again soon after the last recovery, 
+            wait longer before the next one*/
+            if ((can_err_stat.recoveries != 0) && 
+                ((can_err_stat.off_tick - can_err_stat.on_tick) < CAN_BUSOFF_STABLE)) {
+                can_err_stat.fails++;
+                can_err_stat.wait = (can_err_stat.wait >= CAN_BUSOFF_WAIT_MAX / 2) ? 
+                    CAN_BUSOFF_WAIT_MAX : (can_err_stat.wait * 2);
+            }
+            break;
+        default: break;
+        }
+    }
+    can_err_stat.state = _state;
+}
+
+/**
+ * Put a frame in the transmit queue, a full queue 
+ * drops the frame of the lowest priority (the 
+ * highest StdId, the newest within the same StdId).
+ */
+static void _can_tx_push(const _can_frame_t * frame_p)
+{
+    int8_t _slot = -1;
+
+    for (uint8_t i = 0; i < CAN_TX_NUM; i++) {
+        if (!tx_queue[i].used) {
+            _slot = i;
+            break;
+        }
+    }
+
+    if (_slot < 0) {
+        can_tx_stat.drops++;
+        /*Lowest priority queued frame*/
+        _slot = 0;
+        for (uint8_t i = 1; i < CAN_TX_NUM; i++) {
+            if ((tx_queue[i].frame.std_id > tx_queue[_slot].frame.std_id) || 
+                ((tx_queue[i].frame.std_id == tx_queue[_slot].frame.std_id) && 
+                ((int32_t)(tx_queue[i].seq - tx_queue[_slot].seq) > 0)))
+                _slot = i;
+        }
+        /*The new frame is the lowest priority itself*/
+        if (frame_p->std_id >= tx_queue[_slot].frame.std_id) return;
+    } else {
+        can_tx_stat.depth++;
+        if (can_tx_stat.depth > can_tx_stat.depth_max)
+            can_tx_stat.depth_max = can_tx_stat.depth;
+    }
+
+    memcpy(&tx_queue[_slot].frame, frame_p, sizeof(_can_frame_t));
+    tx_queue[_slot].seq = tx_seq++;
+    tx_queue[_slot].used = true;
+}
+
+/**
+ * Highest priority queued frame.
+ * @return Queue slot, -1 if the queue is empty.
+ */
+static int8_t _can_tx_next()
+{
+    int8_t _slot = -1;
+
+    for (uint8_t i = 0; i < CAN_TX_NUM; i++) {
+        if (!tx_queue[i].used) continue;
+        if ((_slot < 0) || 
+            (tx_queue[i].frame.std_id < tx_queue[_slot].frame.std_id) || 
+            ((tx_queue[i].frame.std_id == tx_queue[_slot].frame.std_id) && 
+            ((int32_t)(tx_queue[i].seq - tx_queue[_slot].seq) < 0)))
+            _slot = i;
+    }
+    return _slot;
+}
+
+/**
+ * Load queued frames into the free mailboxes, called with 
+ * the interrupts disabled or from the CAN interrupts.
+ */
+static void _can_tx_refill()
+{
+    int8_t _slot = 0;
+    uint32_t _mb = 0;
+
+    while (HAL_CAN_GetTxMailboxesFreeLevel(&hcan) > 0) {
+        _slot = _can_tx_next();
+        if (_slot < 0) return;
+
+        _can_frame_t * frame_p = &tx_queue[_slot].frame;
+        CAN_TxHeaderTypeDef _header = {
+            .StdId = frame_p->std_id, .ExtId = 0x00,
+            .IDE = CAN_ID_STD, .RTR = CAN_RTR_DATA, .DLC = frame_p->dlc,
+            .TransmitGlobalTime = DISABLE,
+        };
+        /*Not started yet, stays queued*/
+        if (HAL_CAN_AddTxMessage(&hcan, &_header, 
+            frame_p->data, &_mb) != HAL_OK) return;
+
+        tx_mb_tick[_mb >> 1] = HAL_GetTick();
+        tx_queue[_slot].used = false;
+        can_tx_stat.depth--;
     }
 }
 /* USER CODE END 1 */
@@ -173,6 +173,34 @@ void TIM2_IRQHandler()
     /* USER CODE END TIM2_IRQn 1 */
 }
 
+/**
+  * @brief This function handles EXTI line0 interrupt.
+  */
+void EXTI0_IRQHandler(void)
+{
+    /* USER CODE BEGIN EXTI0_IRQn 0 */
+
+    /* USER CODE END EXTI0_IRQn 0 */
+    HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_0);
+    /* USER CODE BEGIN EXTI0_IRQn 1 */
+
+    /* USER CODE END EXTI0_IRQn 1 */
+}
+
+/**
+  * @brief This function handles EXTI line1 interrupt.
+  */
+void EXTI1_IRQHandler(void)
+{
+    /* USER CODE BEGIN EXTI1_IRQn 0 */
+
+    /* USER CODE END EXTI1_IRQn 0 */
+    HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_1);
+    /* USER CODE BEGIN EXTI1_IRQn 1 */
+
+    /* USER CODE END EXTI1_IRQn 1 */
+}
+
 /**
   * @brief This function handles DMA1 channel1 global interrupt.
   */
@@ -150,7 +150,7 @@ void HAL_UART_MspInit(UART_HandleTypeDef * uartHandle)
 
         /*##-3- Configure the NVIC for UART*/
         /* NVIC for USART */
-        HAL_NVIC_SetPriority(USART1_IRQn, 0, 0);
+        HAL_NVIC_SetPriority(USART1_IRQn, 1, 0);
         HAL_NVIC_EnableIRQ(USART1_IRQn);
     }
     else if(uartHandle->Instance==USART2)
@@ -177,7 +177,7 @@ void HAL_UART_MspInit(UART_HandleTypeDef * uartHandle)
 
         /*##-3- Configure the NVIC for UART*/
         /* NVIC for USART */
-        HAL_NVIC_SetPriority(USART2_IRQn, 0, 0);
+        HAL_NVIC_SetPriority(USART2_IRQn, 1, 0);
         HAL_NVIC_EnableIRQ(USART2_IRQn);
     }
 }
@@ -22,6 +22,14 @@
 
 #include "MultiTimer.h"
 #include "enc_cali.h"
+#include "lead_cali.h"
+#include "out_filter.h"
+#include "sys_ident.h"
+#include "dce_tune.h"
+#include "inertia_est.h"
+#include "load_obs.h"
+#include "homing.h"
+#include "pos_journal.h"
 #include "mt6816.h"
 #include "tb67h450.h"
 #include "led_anim.h"
@@ -36,6 +44,9 @@
 #include "adc.h"
 #include "dma.h"
 #include "setup.h"
+#include "can_protocol.h"
+#include "can_telem.h"
+#include "clk_sync.h"
 
 /*********************
  *      DEFINES
@@ -112,6 +123,15 @@ int32_t main()
     btn_doing_start();
 
     read_file();
+    x35_can_baud(_setup.can_baud, _setup.can_detect);
+
+    /*The supply monitor of the position 
+    journal needs the ADC*/
+    pos_journal_init(_setup.pos_keep);
+    if (_setup.pos_keep) {
+        x35_dma_init();
+        x35_adc1_init();
+    }
 
     Move_Home_Offset = _setup.home_ofs;
     Move_Rated_Speed = _setup.speed_rated;
@@ -121,9 +141,16 @@ int32_t main()
     Motor_Control_SetStallSwitch(_setup.stall_protect);
     Speed_Tracker_Set_UpAcc(_setup.speed_up_acc);
     Speed_Tracker_Set_DownAcc(_setup.speed_down_acc);
+    Speed_Tracker_Set_QuickStopAcc(_setup.qstop_acc);
     Location_Tracker_Set_UpAcc(_setup.speed_up_acc);
     Location_Tracker_Set_DownAcc(_setup.speed_down_acc);
     Motor_Control_Init();
+    Motor_Control_SetOutScale(_setup.out_scale);
+    Motor_Control_SetLeadTable(_setup.lead_table, _setup.lead_valid);
+    Motor_Control_SetFwTable(_setup.fw_speed, _setup.fw_angle);
+    for (uint8_t i = 0; i < Out_Filter_NUM; i++)
+        out_filter_set(i, _setup.filter_coef[i], 
+            (_setup.filter_enable >> i) & 0x01);
 
     Current_Rated_Current = _setup.current_rated;
     Move_Rated_UpCurrentRate = _setup.current_up_acc;
@@ -135,6 +162,21 @@ int32_t main()
     dce.kv = _setup.dce_kv;
     dce.ki = _setup.dce_ki;
     dce.kd = _setup.dce_kd;
+    inertia_est_set_ref(_setup.inertia_ref);
+    inertia_est_set_sched(_setup.gain_sched);
+    Control_PID_SetKP(_setup.pid_kp);
+    Control_PID_SetKI(_setup.pid_ki);
+    Control_Cascade_SetKP(_setup.casc_kp);
+    Control_Cascade_SetEnable(_setup.casc_enable);
+    load_obs_set_enable(_setup.load_comp);
+    Motor_Control_SetFollowError(_setup.ferr_window, 
+        _setup.ferr_debounce, (Motor_Fault_React)_setup.ferr_react);
+    Motor_Control_SetPosLimit(_setup.pos_limit, 
+        _setup.pos_min, _setup.pos_max);
+    for (uint8_t i = 0; i < Telem_Frame_NUM; i++)
+        can_telem_set(i, _setup.telem_period[i], 
+            (_setup.telem_sync >> i) & 0x01, _setup.telem_map[i]);
+    clk_sync_set_master(_setup.clk_master);
 
     HAL_Delay(100);
     /*Start close loop control tick work*/
@@ -147,7 +189,17 @@ int32_t main()
     for (;;) {
         /* Insert delay 100 ms */
         /*led_dev_task_handler();*/
+        dev_can_rx_solve();
         _enc_cali_solve();
+        sys_ident_solve();
+        dce_tune_solve();
+        pos_journal_solve();
+        dev_can_fault_report();
+        dev_can_homing_report();
+        dev_can_heartbeat_check();
+        CAN_Tx_Check();
+        CAN_Err_Check();
+        dev_can_busoff_check();
         /*led_anim_tick_work();*/
         /*btn_doing_tick_work();*/
         file_tick_work();
@@ -167,10 +219,21 @@ void _TIM2_callback_20kHz()
 {
     __HAL_TIM_CLEAR_IT(&htim2, TIM_IT_UPDATE);
 
+    clk_sync_tick_work();
     _enc_dev_tick_work();
 
     if (cali._start) _enc_cali_tick_work();
-    else Motor_Control_Callback();
+    else {
+        dev_can_sync_tick_work();
+        Motor_Control_Callback();
+        lead_cali_tick_work();
+        sys_ident_tick_work();
+        dce_tune_tick_work();
+        inertia_est_tick_work();
+        homing_tick_work();
+        pos_journal_tick_work();
+        can_telem_tick_work();
+    }
     multiTimerYield();
 
     led_anim_tick_inc(1);
@@ -194,6 +257,17 @@ void _TIM1_callback_100Hz()
     __HAL_TIM_CLEAR_IT(&htim1, TIM_IT_UPDATE);
 }
 
+/**
+ * Home switch (PB0) and index (PB1) edges, the 
+ * position is captured with a microsecond timestamp.
+ * @param GPIO_Pin Pin of the EXTI line.
+ */
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+    if (GPIO_Pin == GPIO_PIN_0) homing_capture(HOME_CAP_LIMIT);
+    else if (GPIO_Pin == GPIO_PIN_1) homing_capture(HOME_CAP_INDEX);
+}
+
 /**
  * Magnetic encoder calibration, data acquisition program, 
  * open-loop state control motor turns left once, 
@@ -236,6 +310,7 @@ void SystemClock_Config(void)
 {
     RCC_ClkInitTypeDef clkinitstruct = {0};
     RCC_OscInitTypeDef oscinitstruct = {0};
+    RCC_PeriphCLKInitTypeDef periphclkinit = {0};
     
     /* Configure PLL ------------------------------------------------------*/
     /* PLL configuration: PLLCLK = (HSI / 2) * PLLMUL = (8 / 2) * 16 = 64 MHz */
@@ -269,4 +344,13 @@ void SystemClock_Config(void)
         /* Initialization Error */
         Error_Handler();
     }
+
+    /* ADC clock: PCLK2 / 6 = 12 MHz (14 MHz maximum) */
+    periphclkinit.PeriphClockSelection = RCC_PERIPHCLK_ADC;
+    periphclkinit.AdcClockSelection = RCC_ADCPCLK2_DIV6;
+    if (HAL_RCCEx_PeriphCLKConfig(&periphclkinit) != HAL_OK)
+    {
+        /* Initialization Error */
+        Error_Handler();
+    }
 }
@@ -15,7 +15,18 @@
 #include "Current_Tracker.h"
 #include "setup.h"
 #include "enc_cali.h"
+#include "lead_cali.h"
+#include "out_filter.h"
+#include "sys_ident.h"
+#include "dce_tune.h"
+#include "inertia_est.h"
+#include "load_obs.h"
+#include "homing.h"
+#include "pos_journal.h"
+#include "can_telem.h"
+#include "clk_sync.h"
 #include "can.h"
+#include <string.h>
 
 /*********************
  *      DEFINES
@@ -25,6 +36,29 @@
  *      TYPEDEFS
  **********************/
 
+/**
+ * Describes a setpoint waiting for the SYNC broadcast, 
+ * decoded in the main loop so that the control tick 
+ * only copies it.
+ */
+typedef struct {
+    /**< Staged command, for the reply*/
+    uint8_t cmd;
+    /**< Reply when latched*/
+    bool ack;
+    Motor_Mode mode;
+    /**< Rated speed reset on entering the mode*/
+    bool rated_def;
+    /**< Rated speed (pulse/s, 0 keeps it)*/
+    int32_t rated;
+    /**< Goal location (pulse, with the home offset)*/
+    int32_t location;
+    /**< Track mode speed feedforward (pulse/s) 
+    and current limit (mA)*/
+    int32_t speed;
+    int32_t current;
+} _sync_set_t;
+
 /**
  * CAN Tx message header structure definition.
  */
@@ -39,27 +73,86 @@ CAN_TxHeaderTypeDef txHeader = {
  **********************/
 
 extern _cali_attr_t cali;
+extern _sys_ident_t sys_ident;
+extern _dce_tune_t dce_tune;
+extern _inertia_est_t inertia_est;
+extern _load_obs_t load_obs;
+extern _homing_t homing;
+extern _pos_journal_t pos_journal;
+
+static void _homing_frame(uint8_t * _frame);
+static void _count_reply(uint8_t _cmd, int32_t _val, uint8_t * _frame);
+static void _status_frame(uint8_t * _frame);
+static void _sync_stage(uint8_t _cmd, uint8_t * _data);
+static void _sync_reply(uint8_t * _frame);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**< HAL tick of the last received frame*/
+static volatile uint32_t hb_tick = 0;
+static bool hb_lost = false;
+/**< Bus-offs already reacted to*/
+static uint16_t busoff_num = 0;
+
+/**< Setpoint waiting for the SYNC broadcast, the 
+newest one replaces an older one*/
+static _sync_set_t sync_set = {0};
+static volatile bool sync_staged = false;
+/**< SYNC received (receive interrupt) and the ring slot 
+of the SYNC frame, the frames ahead of it are applied 
+once the main loop has read past the slot*/
+static volatile bool sync_latch = false;
+static volatile uint16_t sync_mark = 0;
+static volatile bool sync_ready = false;
+/**< The staged setpoint was latched, reply pending*/
+static volatile bool sync_done = false;
 
 /**********************
  *   GLOBAL FUNCTIONS
  **********************/
 
 /**
- * CAN is configured in identifier masking mode, 
- * all packets are received, and the corresponding ID packets are filtered 
- * out in the form of software masks, which is commonly 
- * referred to as software filtering
+ * Parse and apply one command to this node or broadcast, 
+ * the acceptance filters drop the frames to other nodes 
+ * in hardware (x35_can_filter)
+ * @param _std_id Standard identifier, node (bit7~10) and command.
  */
-void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
+void dev_can_cmd(uint16_t _std_id, uint8_t * _data, uint32_t _len)
 {
     uint8_t canNodeId = _setup.can_id;
+    uint8_t _cmd = _std_id & 0x7F;
     float _float_val = 0.0f;
     int32_t _int_val = 0U;
+    uint32_t _uint_val = 0U;
+
+    /*Every frame to this node feeds the heartbeat*/
+    hb_tick = HAL_GetTick();
+
+    /*In synchronous mode the position setpoints 
+    wait for the SYNC broadcast (0x00)*/
+    if (_setup.sync_mode && 
+        ((_cmd == 0x05) || (_cmd == 0x06) || (_cmd == 0x07) || 
+        (_cmd == 0x35) || (_cmd == 0x36) || (_cmd == 0x3C))) {
+        _sync_stage(_cmd, _data);
+        return;
+    }
 
     switch (_cmd) {
-    /*0x00~0x0F No Memory CMDs*/
+    /*0x00~0x0A No Memory CMDs*/
+    case 0x00: /*SYNC*/
+        /*Broadcast only (StdId 0x000) as in the receive interrupt, 
+        which has marked the latch (dev_can_sync_latch), a command 
+        0x00 addressed to the node is ignored. The commands ahead 
+        of the SYNC are applied now, the staged setpoint is copied 
+        by the next tick, then the frames marked for SYNC are sent*/
+        if (_std_id != 0x000) break;
+        sync_ready = true;
+        can_telem_sync();
+        break;
     case 0x01: /*Enable Motor*/
-        motor_control.mode_order = (*(uint32_t *)(RxData) == 1) ?
+        motor_control.mode_order = (*(uint32_t *)(_data) == 1) ?
             Motor_Mode_Digital_Speed : Control_Mode_Stop;
         break;
     case 0x02: /*Do Calibration*/
@@ -68,7 +161,7 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
     case 0x03: /*Set Current SetPoint*/
         if (motor_control.mode_run != Motor_Mode_Digital_Current)
             Motor_Control_SetMotorMode(Motor_Mode_Digital_Current);
-        Motor_Control_Write_Goal_Current((int32_t)(*(float *)RxData * 1000));
+        Motor_Control_Write_Goal_Current((int32_t)(*(float *)_data * 1000));
         break;
     case 0x04: /*Set Velocity SetPoint*/
         if (motor_control.mode_run != Motor_Mode_Digital_Speed) {
@@ -76,7 +169,7 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
             Motor_Control_SetMotorMode(Motor_Mode_Digital_Speed);
         }
         Motor_Control_Write_Goal_Speed(
-            (int32_t)(*(float *)RxData * (float)Move_Pulse_NUM));
+            (int32_t)(*(float *)_data * (float)Move_Pulse_NUM));
         break;
     case 0x05: /*Set Position SetPoint*/
     {
@@ -85,7 +178,7 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
             Motor_Control_SetMotorMode(Motor_Mode_Digital_Location);
         }
         Motor_Control_Write_Goal_Location(
-            (int32_t)(*(float *)RxData * (float)Move_Pulse_NUM));
+            (int32_t)(*(float *)_data * (float)Move_Pulse_NUM));
         /*增加 HomeOffset 是为了调节电机零点，便于因适配结构需要调节机械臂关节零点位置*/
         if (_data[4]) { /*Need Position & Finished ACK*/
             _float_val = Motor_Control_Read_Goal_Position(false);
@@ -103,8 +196,8 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
         if (motor_control.mode_run != Motor_Mode_Digital_Location)
             Motor_Control_SetMotorMode(Motor_Mode_Digital_Location);
         Motor_Control_Write_Goal_Location_WithTime(
-            (int32_t)(*(float *)RxData * (float)Move_Pulse_NUM),
-            *(float*)(RxData + 4));
+            (int32_t)(*(float *)_data * (float)Move_Pulse_NUM),
+            *(float*)(_data + 4));
         if (_data[4]) { /*Need Position & Finished ACK*/
             _float_val = Motor_Control_Read_Goal_Position(false);
             uint8_t * bin = (uint8_t *)&_float_val;
@@ -122,7 +215,7 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
             Move_Rated_Speed = 30U * Move_Pulse_NUM;
             Motor_Control_SetMotorMode(Motor_Mode_Digital_Location);
         }
-        Move_Rated_Speed = (int32_t)(*(float *)(RxData + 4) * \
+        Move_Rated_Speed = (int32_t)(*(float *)(_data + 4) * \
             (float)Move_Pulse_NUM);
 
         /**The new rated speed needs to be synchronized to 
@@ -133,7 +226,7 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
         Location_Tracker_Set_DownAcc(Move_Rated_Speed);
 
         Motor_Control_Write_Goal_Location(
-            (int32_t)(*(float *)RxData * (float)Move_Pulse_NUM));
+            (int32_t)(*(float *)_data * (float)Move_Pulse_NUM));
         // Always Need Position & Finished ACK
         _float_val = Motor_Control_Read_Goal_Position(false);
         uint8_t * bin = (uint8_t *)&_float_val;
@@ -144,24 +237,147 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
         CAN_Send(&txHeader, _data);
     }
         break;
+    case 0x08: /*Do Lead-Angle Characterisation*/
+        if (*(uint32_t *)(_data) == 1) lead_cali_start();
+        else { /*Discard the table and use the DPS table*/
+            lead_cali_discard();
+            if (_data[4]) { /*It need to be stored*/
+                operate_file(0);
+            }
+        }
+        break;
+    case 0x09: /*Do System Identification*/
+        /*Byte0~3 amplitude(A), Byte4 chirp(0) or PRBS(1), 
+        Byte5 decimation(0 for default)*/
+        sys_ident_start(_data[4], 
+            (int32_t)(*(float *)_data * 1000), _data[5]);
+        break;
+    case 0x0A: /*Do DCE Autotune*/
+        /*Byte0~3 relay current(A), Byte4 target bandwidth(Hz, 0 for default), 
+        the tuned gains are stored*/
+        dce_tune_start((int32_t)(*(float *)_data * 1000), _data[4]);
+        break;
+
+
+    /*0x0B~0x0E CMDs with Memory*/
+    case 0x0B: /*Set Load-Compensation*/
+        _setup.load_comp = (*(uint32_t *)(_data) == 1);
+        load_obs_set_enable(_setup.load_comp);
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
+    case 0x0C: /*Set Following-Error Window*/
+        /*Byte0~3 window(float, r, 0 disables), Byte5~6 debounce 
+        (control ticks, 50us each), Byte7 reaction(0 disable, 
+        1 brake, 2 decelerate to rest)*/
+        _setup.ferr_window = (int32_t)(*(float *)_data * 
+            (float)Move_Pulse_NUM);
+        _setup.ferr_debounce = (uint16_t)(_data[5] | (_data[6] << 8));
+        _setup.ferr_react = _data[7];
+        Motor_Control_SetFollowError(_setup.ferr_window, 
+            _setup.ferr_debounce, (Motor_Fault_React)_setup.ferr_react);
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
+    case 0x0D: /*Set Quick-Stop*/
+        /*Byte0~3 quick-stop deceleration(float, r/s^2), Byte5~6 
+        heartbeat timeout(ms, 0 disables), any frame to this node 
+        counts as a heartbeat*/
+        _float_val = *(float *)_data * (float)Move_Pulse_NUM;
+        Speed_Tracker_Set_QuickStopAcc((int32_t)_float_val);
+        _setup.qstop_acc = speed_tck.qstop_acc;
+        _setup.hb_timeout = (uint16_t)(_data[5] | (_data[6] << 8));
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
+    case 0x0E: /*Set Homing Parameter*/
+        /*Byte0~3 value, Byte5 parameter index: 0 method(uint32, 0 hard 
+        stop, 1 limit switch, 2 absolute angle), 1 direction(uint32, 0 
+        positive, 1 negative), 2 search speed(float, r/s), 3 latch 
+        speed(float, r/s), 4 hard stop current(float, A), 5 user 
+        position of the reference(float, r), 6 search range(float, r), 
+        7 single-turn encoder angle(float, 0~1 r), 8 switch 
+        polarity(uint32, 1 active high)*/
+        _float_val = *(float *)_data;
+        switch (_data[5]) {
+        case 0:
+            _setup.home_method = (uint8_t)(*(uint32_t *)(_data));
+            break;
+        case 1:
+            _setup.home_dir = (*(uint32_t *)(_data) == 1);
+            break;
+        case 2:
+            _setup.home_search = abs((int32_t)(_float_val * 
+                (float)Move_Pulse_NUM));
+            break;
+        case 3:
+            _setup.home_latch = abs((int32_t)(_float_val * 
+                (float)Move_Pulse_NUM));
+            break;
+        case 4:
+            _setup.home_current = abs((int32_t)(_float_val * 1000));
+            break;
+        case 5:
+            _setup.home_pos = (int32_t)(_float_val * 
+                (float)Move_Pulse_NUM);
+            break;
+        case 6:
+            _setup.home_range = abs((int32_t)(_float_val * 
+                (float)Move_Pulse_NUM));
+            break;
+        case 7:
+            _setup.home_angle = (int32_t)(_float_val * 
+                (float)Move_Pulse_NUM) % Move_Pulse_NUM;
+            break;
+        case 8:
+            _setup.home_polarity = (*(uint32_t *)(_data) == 1);
+            break;
+        default: break;
+        }
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
+
+
+    /*0x0F No Memory CMD*/
+    case 0x0F: /*Do Homing*/
+        /*Byte0 start(1) or abort(0), the result is reported 
+        with an unsolicited 0x2C frame*/
+        if (*(uint32_t *)(_data) == 1) homing_start();
+        else homing_abort();
+        break;
 
 
     /*0x10~0x1F CMDs with Memory*/
+    case 0x10: /*Set Multi-Turn Position Keep*/
+        /*Byte0~3 enable, the supply monitor starts 
+        after storing and rebooting*/
+        _setup.pos_keep = (*(uint32_t *)(_data) == 1);
+        pos_journal_set_enable(_setup.pos_keep);
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
     case 0x11: /*Set Node-ID and Store to EEPROM*/
-        _setup.can_id = *(uint32_t*)(RxData);
+        _setup.can_id = *(uint32_t*)(_data);
+        x35_can_filter(_setup.can_id);
         if (_data[4]) { /*It need to be stored*/
             operate_file(0);
         }
         break;
     case 0x12: /*Set Current-Limit and Store to EEPROM*/
-        Current_Rated_Current = (int32_t)(*(float *)RxData * 1000);
+        Current_Rated_Current = (int32_t)(*(float *)_data * 1000);
         _setup.current_rated = Current_Rated_Current;
         if (_data[4]) { /*It need to be stored*/
             operate_file(0);
         }
         break;
     case 0x13: /*Set Velocity-Limit and Store to EEPROM*/
-        Move_Rated_Speed = (int32_t)(*(float *)RxData *
+        Move_Rated_Speed = (int32_t)(*(float *)_data *
                        (float)Move_Pulse_NUM);
         _setup.speed_rated = Move_Rated_Speed;
         if (_data[4]) { /*It need to be stored*/
@@ -169,7 +385,7 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
         }
         break;
     case 0x14: /*Set Acceleration （and Store to EEPROM）*/
-        _float_val = *(float *)RxData * (float)Move_Pulse_NUM;
+        _float_val = *(float *)_data * (float)Move_Pulse_NUM;
 
         Move_Rated_UpAcc = (int32_t)_float_val;
         Move_Rated_DownAcc = (int32_t)_float_val;
@@ -195,42 +411,124 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
         operate_file(0);
         break;
     case 0x16: /*Set Auto-Enable and Store to EEPROM*/
-        _setup.motor_onboot = (*(uint32_t *)(RxData) == 1);
+        _setup.motor_onboot = (*(uint32_t *)(_data) == 1);
         if (_data[4]) { /*It need to be stored*/
             operate_file(0);
         }
         break;
     case 0x17: /*Set DCE Kp*/
-        dce.kp = *(int32_t *)(RxData);
+        dce.kp = *(int32_t *)(_data);
         _setup.dce_kp = dce.kp;
         if (_data[4]) { /*It need to be stored*/
             operate_file(0);
         }
         break;
     case 0x18: /*Set DCE Kv*/
-        dce.kv = *(int32_t *)(RxData);
+        dce.kv = *(int32_t *)(_data);
         _setup.dce_kv = dce.kv;
         if (_data[4]) { /*It need to be stored*/
             operate_file(0);
         }
         break;
     case 0x19: /*Set DCE Ki*/
-        dce.ki = *(int32_t *)(RxData);
+        dce.ki = *(int32_t *)(_data);
         _setup.dce_ki = dce.ki;
         if (_data[4]) { /*It need to be stored*/
             operate_file(0);
         }
         break;
     case 0x1A: /*Set DCE Kd*/
-        dce.kd = *(int32_t *)(RxData);
+        dce.kd = *(int32_t *)(_data);
         _setup.dce_kd = dce.kd;
         if (_data[4]) { /*It need to be stored*/
             operate_file(0);
         }
         break;
     case 0x1B: /*Set Enable Stall-Protect*/
-        Motor_Control_SetStallSwitch((*(uint32_t *)(RxData) == 1));
-        _setup.stall_protect = (*(uint32_t*)(RxData) == 1);
+        Motor_Control_SetStallSwitch((*(uint32_t *)(_data) == 1));
+        _setup.stall_protect = (*(uint32_t*)(_data) == 1);
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
+    case 0x1C: /*Set Commutation-Advance Breakpoint*/
+        /*Byte0~3 speed(r/s), Byte5 breakpoint index, 
+        Byte6~7 advance angle(1024 = 360deg electrical)*/
+        if (_data[5] < Fw_Point_NUM) {
+            _setup.fw_speed[_data[5]] = (int32_t)(*(float *)_data * 
+                (float)Move_Pulse_NUM);
+            _setup.fw_angle[_data[5]] = (int16_t)(_data[6] | (_data[7] << 8));
+            /*Applied once the breakpoints are ascending*/
+            Motor_Control_SetFwTable(_setup.fw_speed, _setup.fw_angle);
+            if (_data[4]) { /*It need to be stored*/
+                operate_file(0);
+            }
+        }
+        break;
+    case 0x1D: /*Set Output-Filter Coefficient*/
+        /*Byte0~3 coefficient(float), Byte5 section index, 
+        Byte6 coefficient index(b0 b1 b2 a1 a2), 
+        Byte7 section enable, the section is bypassed 
+        while its coefficients are being written*/
+        if ((_data[5] < Out_Filter_NUM) && 
+            (_data[6] < OUT_FILTER_COEF_NUM)) {
+            _setup.filter_coef[_data[5]][_data[6]] = 
+                (int32_t)(*(float *)_data * (float)(1UL << OUT_FILTER_Q));
+            if (_data[7]) _setup.filter_enable |= (1U << _data[5]);
+            else _setup.filter_enable &= ~(1U << _data[5]);
+            out_filter_set(_data[5], _setup.filter_coef[_data[5]], 
+                _data[7] != 0);
+            if (_data[4]) { /*It need to be stored*/
+                operate_file(0);
+            }
+        }
+        break;
+    case 0x1E: /*Set Gain-Scheduling*/
+        /*Byte0 enable, Byte1 take the present estimate as the 
+        inertia the DCE gains were designed for*/
+        if (_data[1] && inertia_est.valid) {
+            _setup.inertia_ref = inertia_est.inertia;
+            inertia_est_set_ref(_setup.inertia_ref);
+        }
+        _setup.gain_sched = (_data[0] == 1);
+        inertia_est_set_sched(_setup.gain_sched);
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
+
+    case 0x1F: /*Set Position-Controller*/
+        /*Byte0~3 value, Byte5 parameter index: 0 controller of 
+        the position modes(0 DCE, 1 cascade), 1 position loop 
+        gain(1/s), 2 velocity loop Kp, 3 velocity loop Ki, the 
+        velocity loop is shared with the speed modes, the gains 
+        are checked as uint32 before the uint16 setters (0~1024)*/
+        _uint_val = *(uint32_t *)(_data);
+        switch (_data[5]) {
+        case 0:
+            _setup.casc_enable = (*(uint32_t *)(_data) == 1);
+            Control_Cascade_SetEnable(_setup.casc_enable);
+            /*Restart the curve from the present state, 
+            the integrators are preloaded bumplessly*/
+            motor_control.soft_new_curve = true;
+            break;
+        case 1:
+            if (_uint_val > 1024) break;
+            Control_Cascade_SetKP((uint16_t)_uint_val);
+            _setup.casc_kp = casc.kp;
+            break;
+        case 2:
+            if (_uint_val > 1024) break;
+            Control_PID_SetKP((uint16_t)_uint_val);
+            _setup.pid_kp = pid.kp;
+            break;
+        case 3:
+            if (_uint_val > 1024) break;
+            Control_PID_SetKI((uint16_t)_uint_val);
+            _setup.pid_ki = pid.ki;
+            break;
+        default: break;
+        }
         if (_data[4]) { /*It need to be stored*/
             operate_file(0);
         }
@@ -238,6 +536,33 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
 
 
     /*0x20~0x2F Inquiry CMDs*/
+    case 0x20: /*Get Clock Sync*/
+    {
+        /*Byte0 state(0 free, 1 locking, 2 locked), Byte1 mean 
+        absolute offset while locked(us, saturated), Byte2~3 offset 
+        at the last time stamp(int16, us, saturated), Byte4~5 largest 
+        absolute offset while locked(us, saturated), Byte6~7 period 
+        trim(int16, ppm)*/
+        _int_val = clk_sync.jitter >> 4;
+        _data[0] = clk_sync.state;
+        _data[1] = (_int_val > 0xFF) ? 0xFF : (uint8_t)_int_val;
+        _int_val = clk_sync.offset;
+        if (_int_val > INT16_MAX) _int_val = INT16_MAX;
+        else if (_int_val < INT16_MIN) _int_val = INT16_MIN;
+        _data[2] = (uint8_t)(_int_val);
+        _data[3] = (uint8_t)(_int_val >> 8);
+        _int_val = (clk_sync.offset_max > 0xFFFF) ? 
+            0xFFFF : clk_sync.offset_max;
+        _data[4] = (uint8_t)(_int_val);
+        _data[5] = (uint8_t)(_int_val >> 8);
+        _int_val = (int32_t)((int64_t)clk_sync.adj * 1000000 / 
+            ((int32_t)CONTROL_PERIOD_US << CLK_FRAC_SHIFT));
+        _data[6] = (uint8_t)(_int_val);
+        _data[7] = (uint8_t)(_int_val >> 8);
+        txHeader.StdId = (canNodeId << 7) | 0x20;
+        CAN_Send(&txHeader, _data);
+    }
+        break;
     case 0x21: /*Get Current*/
     {
         _float_val = Motor_Control_Read_Goal_FocCurrent();
@@ -284,7 +609,411 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
         CAN_Send(&txHeader, _data);
     }
         break;
+    case 0x25: /*Get Saturated-Current & Output-Scale*/
+    {
+        /*Byte0~3 saturated phase current found by the calibration
+        (int32, mA), the rated current without saturation, 0 before 
+        the calibration, Byte4~5 output scale(uint16, 1024 = 1.0), 
+        the resistance and inductance are not identified*/
+        _int_val = _setup.i_sat;
+        uint8_t * bin = (uint8_t *)&_int_val;
+        for (int i = 0; i < 4; i++)
+            _data[i] = *(bin + i);
+        _data[4] = (uint8_t)(motor_control.out_scale);
+        _data[5] = (uint8_t)(motor_control.out_scale >> 8);
+        txHeader.StdId = (canNodeId << 7) | 0x25;
+        CAN_Send(&txHeader, _data);
+    }
+        break;
+
+
+    case 0x26: /*Get Identification Peaks*/
+    {
+        for (uint8_t i = 0; i < SYSID_PEAK_NUM; i++) {
+            /*Peak frequency(Hz)*/
+            uint16_t _freq = sys_ident_bin_freq(sys_ident.peak[i]) / 10;
+            _data[i * 2] = (uint8_t)(_freq);
+            _data[i * 2 + 1] = (uint8_t)(_freq >> 8);
+        }
+        _data[6] = sys_ident.state;
+        _data[7] = sys_ident.decim;
+        txHeader.StdId = (canNodeId << 7) | 0x26;
+        CAN_Send(&txHeader, _data);
+    }
+        break;
+    case 0x27: /*Get Identification Bode Bin*/
+    {
+        /*Byte0~1 bin index*/
+        uint16_t _bin = _data[0] | (_data[1] << 8);
+        if (_bin >= SYSID_BIN_NUM) break;
+        uint16_t _freq = sys_ident_bin_freq(_bin) / 10;
+        /*Byte2~3 magnitude(0.01dB), Byte4~5 phase(0.01deg), 
+        Byte6~7 frequency(Hz)*/
+        _data[2] = (uint8_t)(sys_ident.mag[_bin]);
+        _data[3] = (uint8_t)(sys_ident.mag[_bin] >> 8);
+        _data[4] = (uint8_t)(sys_ident.pha[_bin]);
+        _data[5] = (uint8_t)(sys_ident.pha[_bin] >> 8);
+        _data[6] = (uint8_t)(_freq);
+        _data[7] = (uint8_t)(_freq >> 8);
+        txHeader.StdId = (canNodeId << 7) | 0x27;
+        CAN_Send(&txHeader, _data);
+    }
+        break;
+
+
+    case 0x28: /*Get Autotune Result*/
+    {
+        /*Byte0~3 inertia(mA/(r/s^2)), Byte4~5 Coulomb friction(mA), 
+        Byte6 viscous friction(mA/(r/s)), Byte7 autotune state*/
+        _float_val = dce_tune.inertia * (float)Move_Pulse_NUM;
+        uint8_t * bin = (uint8_t *)&_float_val;
+        for (int i = 0; i < 4; i++)
+            _data[i] = *(bin + i);
+        _int_val = (int32_t)dce_tune.friction;
+        if (_int_val > 0xFFFF) _int_val = 0xFFFF;
+        _data[4] = (uint8_t)(_int_val);
+        _data[5] = (uint8_t)(_int_val >> 8);
+        _int_val = (int32_t)(dce_tune.viscous * (float)Move_Pulse_NUM);
+        _data[6] = (_int_val > 0xFF) ? 0xFF : (uint8_t)_int_val;
+        _data[7] = dce_tune.state;
+        txHeader.StdId = (canNodeId << 7) | 0x28;
+        CAN_Send(&txHeader, _data);
+    }
+        break;
+
+
+    case 0x29: /*Get Inertia Estimate*/
+    {
+        /*Byte0~3 inertia(mA/(r/s^2)), Byte4~5 Coulomb friction(mA), 
+        Byte6~7 scheduled DCE gain(1024 = 1.0)*/
+        _float_val = (float)inertia_est.inertia * 
+            (float)Move_Pulse_NUM / EST_INERTIA_SCALE;
+        uint8_t * bin = (uint8_t *)&_float_val;
+        for (int i = 0; i < 4; i++)
+            _data[i] = *(bin + i);
+        _data[4] = (uint8_t)(inertia_est.friction);
+        _data[5] = (uint8_t)(inertia_est.friction >> 8);
+        _int_val = inertia_est_gain();
+        _data[6] = (uint8_t)(_int_val);
+        _data[7] = (uint8_t)(_int_val >> 8);
+        txHeader.StdId = (canNodeId << 7) | 0x29;
+        CAN_Send(&txHeader, _data);
+    }
+        break;
+
+
+    case 0x2A: /*Get Load Torque*/
+    {
+        /*Byte0~3 load(float, A), Byte4 compensation enabled, 
+        Byte5 model inertia known*/
+        _float_val = (float)load_obs_read() / 1000.0f;
+        uint8_t * bin = (uint8_t *)&_float_val;
+        for (int i = 0; i < 4; i++)
+            _data[i] = *(bin + i);
+        _data[4] = load_obs.enable ? 1 : 0;
+        _data[5] = load_obs.valid ? 1 : 0;
+        txHeader.StdId = (canNodeId << 7) | 0x2A;
+        CAN_Send(&txHeader, _data);
+    }
+        break;
+
+
+    case 0x2C: /*Get Homing State*/
+    {
+        _homing_frame(_data);
+        txHeader.StdId = (canNodeId << 7) | 0x2C;
+        CAN_Send(&txHeader, _data);
+    }
+        break;
+    case 0x2D: /*Get Position Capture*/
+    {
+        /*Byte0 capture input(0 home switch, 1 index) in the request, 
+        Byte0~3 position at the last edge(float, r), Byte4~7 
+        timestamp of the edge(uint32, us)*/
+        if (_data[0] >= HOME_CAP_NUM) break;
+        _home_cap_t * cap_p = &homing.cap[_data[0]];
+        _float_val = (float)(cap_p->location - Move_Home_Offset) / 
+            (float)Move_Pulse_NUM;
+        uint8_t * bin = (uint8_t *)&_float_val;
+        for (int i = 0; i < 4; i++)
+            _data[i] = *(bin + i);
+        _data[4] = (uint8_t)(cap_p->time_us);
+        _data[5] = (uint8_t)(cap_p->time_us >> 8);
+        _data[6] = (uint8_t)(cap_p->time_us >> 16);
+        _data[7] = (uint8_t)(cap_p->time_us >> 24);
+        txHeader.StdId = (canNodeId << 7) | 0x2D;
+        CAN_Send(&txHeader, _data);
+    }
+        break;
+
+    case 0x2E: /*Get Position Journal*/
+    {
+        /*Byte0 enabled, Byte1 restored at power-up, Byte2~3 power 
+        failures since power-up, Byte4~7 newest record(int32, pulse)*/
+        _data[0] = pos_journal.enable ? 1 : 0;
+        _data[1] = pos_journal.restored ? 1 : 0;
+        _data[2] = (uint8_t)(pos_journal.pf_num);
+        _data[3] = (uint8_t)(pos_journal.pf_num >> 8);
+        _data[4] = (uint8_t)(pos_journal.saved);
+        _data[5] = (uint8_t)(pos_journal.saved >> 8);
+        _data[6] = (uint8_t)(pos_journal.saved >> 16);
+        _data[7] = (uint8_t)(pos_journal.saved >> 24);
+        txHeader.StdId = (canNodeId << 7) | 0x2E;
+        CAN_Send(&txHeader, _data);
+    }
+        break;
+
+    case 0x2F: /*Get CAN Queue*/
+    {
+        /*Byte0 queue in the request(0 receive, 1 transmit, 2 error 
+        state), Byte0 frames waiting, Byte1 deepest fill, Byte2~5 
+        frames dropped on a full queue(uint32), Byte6~7 receive FIFO 
+        overruns or transmit timeouts(uint16, saturated)*/
+        uint32_t _drops = 0;
+        uint32_t _count = 0;
+        if (_data[0] == 2) {
+            /*Byte0 error state(0 active, 1 warning, 2 passive, 
+            3 bus-off), Byte1 TEC, Byte2 REC, Byte3 warnings, Byte4 
+            error passives, Byte5 bus-offs, Byte6~7 protocol 
+            errors(uint16), counts saturated*/
+            uint16_t _num[3] = {
+                can_err_stat.warnings, can_err_stat.passives, 
+                can_err_stat.busoffs,
+            };
+            _count = can_err_stat.errors;
+            if (_count > 0xFFFF) _count = 0xFFFF;
+            _data[0] = can_err_stat.state;
+            _data[1] = can_err_stat.tec;
+            _data[2] = can_err_stat.rec;
+            for (uint8_t i = 0; i < 3; i++)
+                _data[3 + i] = (_num[i] > 0xFF) ? 0xFF : (uint8_t)_num[i];
+            _data[6] = (uint8_t)(_count);
+            _data[7] = (uint8_t)(_count >> 8);
+            txHeader.StdId = (canNodeId << 7) | 0x2F;
+            CAN_Send(&txHeader, _data);
+            break;
+        }
+        if (_data[0] == 1) {
+            _drops = can_tx_stat.drops;
+            _count = can_tx_stat.timeouts;
+            _data[0] = (uint8_t)can_tx_stat.depth;
+            _data[1] = (uint8_t)can_tx_stat.depth_max;
+        } else {
+            _drops = can_rx_ring.drops;
+            _count = can_rx_overrun;
+            _data[0] = (uint8_t)can_ring_depth(&can_rx_ring);
+            _data[1] = (uint8_t)can_rx_ring.depth_max;
+        }
+        if (_count > 0xFFFF) _count = 0xFFFF;
+        _data[2] = (uint8_t)(_drops);
+        _data[3] = (uint8_t)(_drops >> 8);
+        _data[4] = (uint8_t)(_drops >> 16);
+        _data[5] = (uint8_t)(_drops >> 24);
+        _data[6] = (uint8_t)(_count);
+        _data[7] = (uint8_t)(_count >> 8);
+        txHeader.StdId = (canNodeId << 7) | 0x2F;
+        CAN_Send(&txHeader, _data);
+    }
+        break;
+
+    /*0x30~0x33 CMDs with Memory*/
+    case 0x30: /*Set Software Position-Limit*/
+        /*Byte0~3 value, Byte5 parameter index: 0 enable(uint32), 
+        1 lower limit(float, r), 2 upper limit(float, r), the limits 
+        are user positions and only enabled with lower < upper*/
+        switch (_data[5]) {
+        case 0:
+            _setup.pos_limit = (*(uint32_t *)(_data) == 1);
+            break;
+        case 1:
+            _setup.pos_min = (int32_t)(*(float *)_data * 
+                (float)Move_Pulse_NUM);
+            break;
+        case 2:
+            _setup.pos_max = (int32_t)(*(float *)_data * 
+                (float)Move_Pulse_NUM);
+            break;
+        default: break;
+        }
+        /*Suspended while homing, applied once it finishes*/
+        if (!homing._start) {
+            Motor_Control_SetPosLimit(_setup.pos_limit, 
+                _setup.pos_min, _setup.pos_max);
+        }
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
+    case 0x31: /*Set Cyclic Telemetry*/
+        /*Byte0~3 value, Byte5 parameter index: 0 period(uint32, 
+        control ticks, 0 off), 1 signals 1~4(one TELEM_SIG_x per 
+        byte), 2 signals 5~8, 3 also sent on SYNC(uint32), Byte6 
+        frame index, frame n is sent as 0x40 + n without a request*/
+        if (_data[6] >= Telem_Frame_NUM) break;
+        switch (_data[5]) {
+        case 0:
+            _setup.telem_period[_data[6]] = 
+                (*(uint32_t *)(_data) > 0xFFFF) ? 
+                0xFFFF : (uint16_t)(*(uint32_t *)(_data));
+            break;
+        case 1:
+        case 2:
+            for (uint8_t i = 0; i < 4; i++)
+                _setup.telem_map[_data[6]][(_data[5] - 1) * 4 + i] = _data[i];
+            break;
+        case 3:
+            if (*(uint32_t *)(_data) == 1) _setup.telem_sync |= (1U << _data[6]);
+            else _setup.telem_sync &= ~(1U << _data[6]);
+            break;
+        default: break;
+        }
+        can_telem_set(_data[6], _setup.telem_period[_data[6]], 
+            (_setup.telem_sync >> _data[6]) & 0x01, 
+            _setup.telem_map[_data[6]]);
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
+    case 0x32: /*Set Synchronous Mode*/
+        /*Byte0~3 enable, the position setpoints (0x05, 0x06, 0x07) 
+        then wait for the SYNC broadcast, a setpoint waiting is 
+        dropped on disabling*/
+        _setup.sync_mode = (*(uint32_t *)(_data) == 1);
+        if (!_setup.sync_mode) sync_staged = false;
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
+    case 0x33: /*Set Clock Master*/
+        /*Byte0~3 time stamp period(uint32, ms, 0 follows the 
+        master), the time stamps are broadcast as 0x34, one 
+        master per bus*/
+        _setup.clk_master = (*(uint32_t *)(_data) > 1000) ? 
+            1000 : (uint16_t)(*(uint32_t *)(_data));
+        clk_sync_set_master(_setup.clk_master);
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
+
+    /*0x35~0x3D No Memory CMDs, 0x35~0x3B integer 
+    counts instead of float turns, 0x3C~0x3D track 
+    setpoint and packed status*/
+    case 0x35: /*Set Position SetPoint (Counts)*/
+        /*Byte0~3 position(int32, pulse), Byte4~5 velocity limit 
+        (uint16, 0.01r/s, 0 keeps the present one), Byte6 Position 
+        & Finished ACK(0x39)*/
+        if (motor_control.mode_run != Motor_Mode_Digital_Location) {
+            Move_Rated_Speed = 30U * Move_Pulse_NUM;
+            Motor_Control_SetMotorMode(Motor_Mode_Digital_Location);
+        }
+        _int_val = _data[4] | (_data[5] << 8);
+        if (_int_val) { /*Same as 0x07*/
+            Move_Rated_Speed = _int_val * (Move_Pulse_NUM / 100);
+            Location_Tracker_Set_MaxSpeed(Move_Rated_Speed);
+            Location_Tracker_Set_UpAcc(Move_Rated_Speed);
+            Location_Tracker_Set_DownAcc(Move_Rated_Speed);
+        }
+        Motor_Control_Write_Goal_Location(*(int32_t *)_data);
+        if (_data[6]) {
+            _count_reply(0x39, motor_control.real_location - 
+                Move_Home_Offset, _data);
+        }
+        break;
+    case 0x36: /*Set Position with Time (Counts)*/
+        /*Byte0~3 position(int32, pulse), Byte4~5 time(uint16, ms), 
+        Byte6 Position & Finished ACK(0x39), the profile itself is 
+        still planned in float*/
+        if (motor_control.mode_run != Motor_Mode_Digital_Location)
+            Motor_Control_SetMotorMode(Motor_Mode_Digital_Location);
+        Motor_Control_Write_Goal_Location_WithTime(*(int32_t *)_data, 
+            (float)(_data[4] | (_data[5] << 8)) / 1000.0f);
+        if (_data[6]) {
+            _count_reply(0x39, motor_control.real_location - 
+                Move_Home_Offset, _data);
+        }
+        break;
+    case 0x37: /*Set Velocity SetPoint (Counts)*/
+        /*Byte0~3 speed(int32, pulse/s)*/
+        if (motor_control.mode_run != Motor_Mode_Digital_Speed) {
+            Move_Rated_Speed = 30U * Move_Pulse_NUM;
+            Motor_Control_SetMotorMode(Motor_Mode_Digital_Speed);
+        }
+        Motor_Control_Write_Goal_Speed(*(int32_t *)_data);
+        break;
+    case 0x38: /*Set Current SetPoint (Counts)*/
+        /*Byte0~1 current(int16, mA)*/
+        if (motor_control.mode_run != Motor_Mode_Digital_Current)
+            Motor_Control_SetMotorMode(Motor_Mode_Digital_Current);
+        Motor_Control_Write_Goal_Current((int16_t)(_data[0] | (_data[1] << 8)));
+        break;
+    case 0x39: /*Get Position (Counts)*/
+        _count_reply(0x39, motor_control.real_location - 
+            Move_Home_Offset, _data);
+        break;
+    case 0x3A: /*Get Velocity (Counts)*/
+        _count_reply(0x3A, motor_control.est_speed, _data);
+        break;
+    case 0x3B: /*Get Current (Counts)*/
+        _count_reply(0x3B, motor_control.foc_current, _data);
+        break;
+    case 0x3C: /*Set Track SetPoint*/
+        /*Byte0~3 position(int32, pulse), Byte4~5 velocity feedforward 
+        (int16, 0.01r/s), Byte6~7 current limit(uint16, mA, 0 or above 
+        the stored limit restores the stored limit, the limit holds in 
+        track mode only, any mode change restores the stored limit), 
+        the trajectory is followed by the motion reconstructor, always 
+        answered with the packed status(0x3D)*/
+        if (motor_control.mode_run != Motor_Mode_Digital_Track)
+            Motor_Control_SetMotorMode(Motor_Mode_Digital_Track);
+        Motor_Control_Write_Track_Current(_data[6] | (_data[7] << 8));
+        motor_control.goal_location = *(int32_t *)_data + Move_Home_Offset;
+        motor_control.goal_speed = (int16_t)(_data[4] | (_data[5] << 8)) * 
+            (Move_Pulse_NUM / 100);
+        _status_frame(_data);
+        txHeader.StdId = (canNodeId << 7) | 0x3D;
+        CAN_Send(&txHeader, _data);
+        break;
+    case 0x3D: /*Get Status (Packed)*/
+        _status_frame(_data);
+        txHeader.StdId = (canNodeId << 7) | 0x3D;
+        CAN_Send(&txHeader, _data);
+        break;
+
+
+    /*0x3E~0x3F CMDs with Memory*/
+    case 0x3E: /*Set CAN Bit-Rate*/
+    {
+        /*Byte0~3 value, Byte5 parameter index: 0 bit rate(uint32, 
+        bit/s, 125k~1M, unsupported rates are ignored), 1 detect 
+        the rate at power-up(uint32), applied after storing and 
+        rebooting*/
+        CAN_InitTypeDef _init;
+        switch (_data[5]) {
+        case 0:
+            if (x35_can_timing(*(uint32_t *)(_data), &_init))
+                _setup.can_baud = *(uint32_t *)(_data);
+            break;
+        case 1:
+            _setup.can_detect = (*(uint32_t *)(_data) == 1);
+            break;
+        default: break;
+        }
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+    }
+        break;
 
+    case 0x3F: /*Set CAN Bus-Off Reaction*/
+        /*Byte0~3 reaction of the motor to a bus-off(uint32, 
+        0 none, 1 quick-stop and disable)*/
+        if (*(uint32_t *)(_data) <= CAN_REACT_QSTOP)
+            _setup.can_react = (uint8_t)(*(uint32_t *)(_data));
+        if (_data[4]) { /*It need to be stored*/
+            operate_file(0);
+        }
+        break;
 
     case 0x7e: /*Erase Configs*/
         /*CONFIG_RESTORE;*/
@@ -296,3 +1025,337 @@ void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len)
     default: break;
     }
 }
+
+/**
+ * Apply the commands queued by the receive interrupt in 
+ * order, called from the main loop. Each command is applied 
+ * with the control tick held off, as it was from the receive 
+ * interrupt, so that a mode change and its setpoint take 
+ * effect on the same tick.
+ */
+void dev_can_rx_solve()
+{
+    _can_frame_t _frame;
+    uint8_t _data[8];
+
+    for (;;) {
+        /*Taken with the tick held off as well, the 
+        SYNC latch waits for the frames ahead of it*/
+        HAL_NVIC_DisableIRQ(TIM2_IRQn);
+        if (!can_ring_pop(&can_rx_ring, &_frame)) {
+            HAL_NVIC_EnableIRQ(TIM2_IRQn);
+            break;
+        }
+        dev_can_cmd(_frame.std_id, _frame.data, _frame.dlc);
+        HAL_NVIC_EnableIRQ(TIM2_IRQn);
+    }
+
+    if (sync_done) {
+        sync_done = false;
+        _sync_reply(_data);
+    }
+}
+
+/**
+ * Mark the SYNC broadcast, called from the CAN receive 
+ * interrupt before the frame is queued, so that every 
+ * axis latches on the first tick after the SYNC and not 
+ * after its own main loop latency.
+ */
+void dev_can_sync_latch()
+{
+    if (!_setup.sync_mode) return;
+    sync_mark = can_rx_ring.head;
+    sync_ready = false;
+    sync_latch = true;
+}
+
+/**
+ * Copy the staged setpoint into the control goals on the 
+ * tick after the SYNC, called from the control tick before 
+ * the motor control callback. Frames still queued ahead of 
+ * the SYNC (a slow main loop) delay the latch until applied.
+ */
+void dev_can_sync_tick_work()
+{
+    if (!sync_latch) return;
+    if (!sync_ready && (can_rx_ring.tail != sync_mark)) return;
+    sync_latch = false;
+
+    if (!sync_staged) return;
+    sync_staged = false;
+
+    if (motor_control.mode_run != sync_set.mode) {
+        if (sync_set.rated_def) Move_Rated_Speed = 30U * Move_Pulse_NUM;
+        Motor_Control_SetMotorMode(sync_set.mode);
+    }
+    if (sync_set.rated) {
+        Move_Rated_Speed = sync_set.rated;
+        Location_Tracker_Set_MaxSpeed(Move_Rated_Speed);
+        Location_Tracker_Set_UpAcc(Move_Rated_Speed);
+        Location_Tracker_Set_DownAcc(Move_Rated_Speed);
+    }
+    motor_control.goal_location = sync_set.location;
+    if (sync_set.mode == Motor_Mode_Digital_Track) {
+        motor_control.goal_speed = sync_set.speed;
+        Motor_Control_Write_Track_Current(sync_set.current);
+    }
+    sync_done = sync_set.ack;
+}
+
+/**
+ * Send the pending fault frames without being asked, 
+ * called from the main loop.
+ */
+void dev_can_fault_report()
+{
+    if (!motor_control.ferr_report) return;
+    motor_control.ferr_report = false;
+
+    /*Own header and buffer, kept apart 
+    from the command replies*/
+    CAN_TxHeaderTypeDef _header = {
+        .StdId = (_setup.can_id << 7) | 0x2B, .ExtId = 0x00,
+        .IDE = CAN_ID_STD, .RTR = CAN_RTR_DATA, .DLC = 8,
+        .TransmitGlobalTime = DISABLE,
+    };
+    uint8_t _frame[8] = {0};
+
+    /*Fault Report: Byte0 fault(1 following error), Byte1 reaction, 
+    Byte2~5 following error when tripped(int32, pulse)*/
+    _frame[0] = 1;
+    _frame[1] = motor_control.ferr_react;
+    _frame[2] = (uint8_t)(motor_control.ferr_value);
+    _frame[3] = (uint8_t)(motor_control.ferr_value >> 8);
+    _frame[4] = (uint8_t)(motor_control.ferr_value >> 16);
+    _frame[5] = (uint8_t)(motor_control.ferr_value >> 24);
+    CAN_Send(&_header, _frame);
+}
+
+/**
+ * Send the homing state once a homing run has 
+ * finished or failed, called from the main loop.
+ */
+void dev_can_homing_report()
+{
+    if (!homing.report) return;
+    homing.report = false;
+
+    CAN_TxHeaderTypeDef _header = {
+        .StdId = (_setup.can_id << 7) | 0x2C, .ExtId = 0x00,
+        .IDE = CAN_ID_STD, .RTR = CAN_RTR_DATA, .DLC = 8,
+        .TransmitGlobalTime = DISABLE,
+    };
+    uint8_t _frame[8] = {0};
+
+    _homing_frame(_frame);
+    CAN_Send(&_header, _frame);
+}
+
+/**
+ * Stop the motor when no frame was received within 
+ * the heartbeat timeout, called from the main loop.
+ */
+void dev_can_heartbeat_check()
+{
+    if (_setup.hb_timeout == 0) return;
+
+    if ((HAL_GetTick() - hb_tick) < _setup.hb_timeout) {
+        hb_lost = false;
+        return;
+    }
+    if (hb_lost) return;
+    hb_lost = true;
+
+    /*Same as disabling over 0x01, the motor quick-stops 
+    first and stays disabled until enabled again*/
+    motor_control.mode_order = Control_Mode_Stop;
+}
+
+/**
+ * React to a bus-off of this node, called from the 
+ * main loop. The commands may have been lost, the 
+ * recovery (CAN_Err_Check) does not wait for this.
+ */
+void dev_can_busoff_check()
+{
+    if (can_err_stat.busoffs == busoff_num) return;
+    busoff_num = can_err_stat.busoffs;
+
+    /*Same as the heartbeat timeout*/
+    if (_setup.can_react == CAN_REACT_QSTOP)
+        motor_control.mode_order = Control_Mode_Stop;
+}
+
+/**
+ * Integer reply: Byte0~3 value(int32, pulse, pulse/s or mA), 
+ * Byte4 Finished ACK.
+ * @param _cmd Reply command.
+ * @param _val Value in counts.
+ * @param _frame 8 byte frame to fill and send.
+ */
+static void _count_reply(uint8_t _cmd, int32_t _val, uint8_t * _frame)
+{
+    _frame[0] = (uint8_t)(_val);
+    _frame[1] = (uint8_t)(_val >> 8);
+    _frame[2] = (uint8_t)(_val >> 16);
+    _frame[3] = (uint8_t)(_val >> 24);
+    _frame[4] = motor_control.state == Control_State_Finish ? 1 : 0;
+    _frame[5] = 0;
+    _frame[6] = 0;
+    _frame[7] = 0;
+    txHeader.StdId = (_setup.can_id << 7) | _cmd;
+    CAN_Send(&txHeader, _frame);
+}
+
+/**
+ * Packed Status: Byte0~3 position(int32, pulse, user position), 
+ * Byte4~5 speed(int16, 0.01r/s, saturated), Byte6~7 bit0~11 FOC 
+ * current(int12, 2mA, saturated), bit12 finished, bit13 fault 
+ * (overload, stall, overtemperature, following error), bit14 
+ * enabled, bit15 homed since power-up.
+ * @param _frame 8 byte frame to fill.
+ */
+static void _status_frame(uint8_t * _frame)
+{
+    int32_t _loc = motor_control.real_location - Move_Home_Offset;
+    int32_t _speed = motor_control.est_speed / (Move_Pulse_NUM / 100);
+    int32_t _current = motor_control.foc_current / 2;
+    uint16_t _bits = 0;
+
+    if (_speed > INT16_MAX) _speed = INT16_MAX;
+    else if (_speed < INT16_MIN) _speed = INT16_MIN;
+    if (_current > 2047) _current = 2047;
+    else if (_current < -2048) _current = -2048;
+
+    _bits = (uint16_t)(_current & 0x0FFF);
+    if (motor_control.state == Control_State_Finish) _bits |= 0x1000;
+    if (motor_control.state >= Control_State_Overload) _bits |= 0x2000;
+    if (motor_control.mode_run != Control_Mode_Stop) _bits |= 0x4000;
+    if (homing.homed) _bits |= 0x8000;
+
+    _frame[0] = (uint8_t)(_loc);
+    _frame[1] = (uint8_t)(_loc >> 8);
+    _frame[2] = (uint8_t)(_loc >> 16);
+    _frame[3] = (uint8_t)(_loc >> 24);
+    _frame[4] = (uint8_t)(_speed);
+    _frame[5] = (uint8_t)(_speed >> 8);
+    _frame[6] = (uint8_t)(_bits);
+    _frame[7] = (uint8_t)(_bits >> 8);
+}
+
+/**
+ * Homing State: Byte0 state, Byte1 result of the last run, Byte2 
+ * homed since power-up, Byte3 inputs(bit0 home switch, bit1 index), 
+ * Byte4~7 reference found(int32, pulse, encoder location).
+ * @param _frame 8 byte frame to fill.
+ */
+static void _homing_frame(uint8_t * _frame)
+{
+    _frame[0] = homing.state;
+    _frame[1] = homing.result;
+    _frame[2] = homing.homed ? 1 : 0;
+    _frame[3] = (homing.cap[HOME_CAP_LIMIT].active ? 0x01 : 0x00) | 
+        (homing.cap[HOME_CAP_INDEX].active ? 0x02 : 0x00);
+    _frame[4] = (uint8_t)(homing.reference);
+    _frame[5] = (uint8_t)(homing.reference >> 8);
+    _frame[6] = (uint8_t)(homing.reference >> 16);
+    _frame[7] = (uint8_t)(homing.reference >> 24);
+}
+
+/**
+ * Decode a position setpoint held for the SYNC broadcast, 
+ * called from the main loop, the fields are the ones the 
+ * command writes when it is applied at once.
+ * @param _cmd 0x05, 0x06, 0x07, 0x35, 0x36 or 0x3C.
+ */
+static void _sync_stage(uint8_t _cmd, uint8_t * _data)
+{
+    int32_t _val = 0;
+
+    sync_set.cmd = _cmd;
+    sync_set.mode = Motor_Mode_Digital_Location;
+    sync_set.rated_def = false;
+    sync_set.rated = 0;
+    sync_set.speed = 0;
+    sync_set.current = 0;
+
+    switch (_cmd) {
+    case 0x05:
+    case 0x07:
+        sync_set.ack = (_cmd == 0x07) || _data[4];
+        sync_set.rated_def = true;
+        sync_set.location = (int32_t)(*(float *)_data * 
+            (float)Move_Pulse_NUM) + Move_Home_Offset;
+        if (_cmd == 0x07) sync_set.rated = (int32_t)(
+            *(float *)(_data + 4) * (float)Move_Pulse_NUM);
+        break;
+    case 0x06:
+    case 0x36:
+        /*Planned from the present position, 
+        the axis waits for the SYNC at rest*/
+        sync_set.ack = (_cmd == 0x06) ? _data[4] : _data[6];
+        _val = (_cmd == 0x06) ? (int32_t)(*(float *)_data * 
+            (float)Move_Pulse_NUM) : *(int32_t *)_data;
+        sync_set.location = _val + Move_Home_Offset;
+        sync_set.rated = Motor_Control_Time_Speed(_val, (_cmd == 0x06) ? 
+            *(float *)(_data + 4) : 
+            (float)(_data[4] | (_data[5] << 8)) / 1000.0f);
+        if (sync_set.rated == 0) sync_set.rated = 30U * Move_Pulse_NUM;
+        break;
+    case 0x35:
+        sync_set.ack = _data[6];
+        sync_set.rated_def = true;
+        sync_set.location = *(int32_t *)_data + Move_Home_Offset;
+        sync_set.rated = (_data[4] | (_data[5] << 8)) * 
+            (Move_Pulse_NUM / 100);
+        break;
+    case 0x3C:
+        sync_set.ack = true;
+        sync_set.mode = Motor_Mode_Digital_Track;
+        sync_set.location = *(int32_t *)_data + Move_Home_Offset;
+        sync_set.speed = (int16_t)(_data[4] | (_data[5] << 8)) * 
+            (Move_Pulse_NUM / 100);
+        sync_set.current = _data[6] | (_data[7] << 8);
+        break;
+    default: return;
+    }
+    sync_staged = true;
+}
+
+/**
+ * Answer a setpoint latched by the SYNC broadcast as the 
+ * command does when applied at once, called from the 
+ * main loop.
+ * @param _frame 8 byte frame to fill and send.
+ */
+static void _sync_reply(uint8_t * _frame)
+{
+    float _float_val = 0.0f;
+
+    switch (sync_set.cmd) {
+    case 0x05:
+    case 0x06:
+    case 0x07:
+        _float_val = Motor_Control_Read_Goal_Position(false);
+        memcpy(_frame, &_float_val, sizeof(_float_val));
+        _frame[4] = motor_control.state == Control_State_Finish ? 1 : 0;
+        _frame[5] = 0;
+        _frame[6] = 0;
+        _frame[7] = 0;
+        txHeader.StdId = (_setup.can_id << 7) | 0x23;
+        CAN_Send(&txHeader, _frame);
+        break;
+    case 0x35:
+    case 0x36:
+        _count_reply(0x39, motor_control.real_location - 
+            Move_Home_Offset, _frame);
+        break;
+    case 0x3C:
+        _status_frame(_frame);
+        txHeader.StdId = (_setup.can_id << 7) | 0x3D;
+        CAN_Send(&txHeader, _frame);
+        break;
+    default: break;
+    }
+}
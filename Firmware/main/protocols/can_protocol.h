@@ -17,11 +17,54 @@
  **********************/
 
 /**
- * CAN is configured in identifier masking mode, 
- * all packets are received, and the corresponding ID packets are filtered 
- * out in the form of software masks, which is commonly 
- * referred to as software filtering
+ * Parse and apply one command to this node or broadcast, 
+ * the acceptance filters drop the frames to other nodes 
+ * in hardware (x35_can_filter)
+ * @param _std_id Standard identifier, node (bit7~10) and command.
  */
-void dev_can_cmd(uint8_t _cmd, uint8_t * _data, uint32_t _len);
+void dev_can_cmd(uint16_t _std_id, uint8_t * _data, uint32_t _len);
+
+/**
+ * Apply the commands queued by the receive 
+ * interrupt in order, called from the main loop.
+ */
+void dev_can_rx_solve();
+
+/**
+ * Mark the SYNC broadcast, called from the CAN 
+ * receive interrupt before the frame is queued.
+ */
+void dev_can_sync_latch();
+
+/**
+ * Copy the staged setpoint on the tick after the SYNC, 
+ * called from the control tick before the motor 
+ * control callback.
+ */
+void dev_can_sync_tick_work();
+
+/**
+ * Send the pending fault frames without being asked, 
+ * called from the main loop.
+ */
+void dev_can_fault_report();
+
+/**
+ * Send the homing state once a homing run has 
+ * finished or failed, called from the main loop.
+ */
+void dev_can_homing_report();
+
+/**
+ * Stop the motor when no frame was received within 
+ * the heartbeat timeout, called from the main loop.
+ */
+void dev_can_heartbeat_check();
+
+/**
+ * React to a bus-off of this node, 
+ * called from the main loop.
+ */
+void dev_can_busoff_check();
 
 #endif /*__CAN_PROTOCOL_H__*/
@@ -0,0 +1,186 @@
+/**
+ * @file can_telem.c
+ *
+ * Cyclic telemetry. Up to Telem_Frame_NUM frames are sent without
+ * a request, each with its own period and map of signals, so a
+ * host reads the state of every axis from one frame per axis and
+ * cycle instead of a request and a reply per value. The frames are
+ * sampled and queued from the control tick, the transmit queue
+ * (CAN_Send) does not block. A frame may also be sent on the SYNC
+ * broadcast, as the status of the axis at the synchronous latch.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "can_telem.h"
+#include "motor_control.h"
+#include "setup.h"
+#include "can.h"
+#include <string.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+_can_telem_t can_telem = {0};
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+/**< Packed size of each signal (byte)*/
+static const uint8_t telem_size[TELEM_SIG_NUM] = {
+    0, 4, 4, 2, 2, 1, 1, 2, 1,
+};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static int32_t _telem_value(_telem_frame_t * tf_p, uint8_t _sig);
+static int32_t _telem_sat16(int32_t _val);
+static uint8_t _telem_pack(_telem_frame_t * tf_p, uint8_t * _frame);
+static void _telem_send(uint8_t _index);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Configure one cyclic frame, the frame restarts its
+ * period from the next tick.
+ * @param _index Frame (0 ~ Telem_Frame_NUM - 1).
+ * @param _period Period (control ticks, 0 = off), raised
+ * to TELEM_PERIOD_MIN.
+ * @param _sync Whether the frame is also sent on SYNC.
+ * @param _map Telem_Map_NUM signals (TELEM_SIG_x).
+ */
+void can_telem_set(uint8_t _index, uint16_t _period, bool _sync, 
+    const uint8_t * _map)
+{
+    if (_index >= Telem_Frame_NUM) return;
+    _telem_frame_t * tf_p = &can_telem.frame[_index];
+
+    if ((_period > 0) && (_period < TELEM_PERIOD_MIN))
+        _period = TELEM_PERIOD_MIN;
+
+    memcpy(tf_p->map, _map, Telem_Map_NUM);
+    tf_p->count = 0;
+    tf_p->period = _period;
+    tf_p->sync = _sync;
+}
+
+/**
+ * Sample and send the frames that are due,
+ * called at 20kHz after the motor control callback.
+ */
+void can_telem_tick_work()
+{
+    for (uint8_t i = 0; i < Telem_Frame_NUM; i++) {
+        _telem_frame_t * tf_p = &can_telem.frame[i];
+
+        if (tf_p->period == 0) continue;
+        if (++tf_p->count < tf_p->period) continue;
+        tf_p->count = 0;
+        _telem_send(i);
+    }
+}
+
+/**
+ * Send the frames marked for SYNC, called on the SYNC 
+ * broadcast with the control tick held off, the signals 
+ * are those of the tick before the latch.
+ */
+void can_telem_sync()
+{
+    for (uint8_t i = 0; i < Telem_Frame_NUM; i++)
+        if (can_telem.frame[i].sync) _telem_send(i);
+}
+
+/**
+ * Present value of a signal, in the units of the frame.
+ */
+static int32_t _telem_value(_telem_frame_t * tf_p, uint8_t _sig)
+{
+    switch (_sig) {
+    case TELEM_SIG_LOCATION:
+        return motor_control.real_location - Move_Home_Offset;
+    case TELEM_SIG_SPEED:
+        return motor_control.est_speed;
+    case TELEM_SIG_CURRENT:
+        return _telem_sat16(motor_control.foc_current);
+    case TELEM_SIG_ERROR:
+        return _telem_sat16(motor_control.est_error);
+    case TELEM_SIG_STATE:
+        return motor_control.state;
+    case TELEM_SIG_MODE:
+        return motor_control.mode_run;
+    case TELEM_SIG_SPEED16:
+        return _telem_sat16(motor_control.est_speed /
+            (Move_Pulse_NUM / 100));
+    case TELEM_SIG_COUNT:
+        return tf_p->seq;
+    default: return 0;
+    }
+}
+
+/**
+ * Saturate to int16.
+ */
+static int32_t _telem_sat16(int32_t _val)
+{
+    if (_val > INT16_MAX) return INT16_MAX;
+    if (_val < INT16_MIN) return INT16_MIN;
+    return _val;
+}
+
+/**
+ * Pack the signals of the map, unknown signals
+ * are skipped.
+ * @param _frame 8 byte frame to fill.
+ * @return Packed length (byte).
+ */
+static uint8_t _telem_pack(_telem_frame_t * tf_p, uint8_t * _frame)
+{
+    uint8_t _len = 0;
+
+    for (uint8_t i = 0; i < Telem_Map_NUM; i++) {
+        uint8_t _sig = tf_p->map[i];
+        if (_sig >= TELEM_SIG_NUM) continue;
+
+        uint8_t _size = telem_size[_sig];
+        if (_size == 0) continue;
+        if (_len + _size > 8) break;
+
+        int32_t _val = _telem_value(tf_p, _sig);
+        for (uint8_t b = 0; b < _size; b++)
+            _frame[_len++] = (uint8_t)((uint32_t)_val >> (b * 8));
+    }
+    return _len;
+}
+
+/**
+ * Sample and queue one frame.
+ */
+static void _telem_send(uint8_t _index)
+{
+    _telem_frame_t * tf_p = &can_telem.frame[_index];
+    uint8_t _frame[8] = {0};
+    CAN_TxHeaderTypeDef _header = {
+        .StdId = (_setup.can_id << 7) | (TELEM_CMD + _index), .ExtId = 0x00,
+        .IDE = CAN_ID_STD, .RTR = CAN_RTR_DATA, .DLC = 0,
+        .TransmitGlobalTime = DISABLE,
+    };
+
+    _header.DLC = _telem_pack(tf_p, _frame);
+    if (_header.DLC == 0) return;
+
+    CAN_Send(&_header, _frame);
+    tf_p->seq++;
+}
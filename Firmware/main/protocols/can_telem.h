@@ -0,0 +1,74 @@
+/**
+ * @file can_telem.h
+ *
+ */
+
+#ifndef __CAN_TELEM_H__
+#define __CAN_TELEM_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "control_config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define TELEM_CMD 0x40U /*Frame n is sent as command 0x40 + n*/
+#define TELEM_PERIOD_MIN 10U /*At most 2kHz per frame (control ticks)*/
+
+/*Signals, little endian, packed in the order of the map*/
+#define TELEM_SIG_NONE 0U
+#define TELEM_SIG_LOCATION 1U /*int32, pulse, user position*/
+#define TELEM_SIG_SPEED 2U /*int32, pulse/s*/
+#define TELEM_SIG_CURRENT 3U /*int16, mA, FOC current*/
+#define TELEM_SIG_ERROR 4U /*int16, pulse, position error, saturated*/
+#define TELEM_SIG_STATE 5U /*uint8, Motor_State*/
+#define TELEM_SIG_MODE 6U /*uint8, Motor_Mode running*/
+#define TELEM_SIG_SPEED16 7U /*int16, 0.01r/s, saturated*/
+#define TELEM_SIG_COUNT 8U /*uint8, frame counter*/
+#define TELEM_SIG_NUM 9U
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * One cyclic frame, the signals of the map are
+ * packed until the next one no longer fits in
+ * 8 bytes, the DLC is the packed length.
+ */
+typedef struct {
+    /**< Period (control ticks, 0 = off)*/
+    uint16_t period;
+    /**< Also sent on each SYNC*/
+    bool sync;
+    uint16_t count;
+    uint8_t map[Telem_Map_NUM];
+    /**< Frames sent, TELEM_SIG_COUNT*/
+    uint8_t seq;
+} _telem_frame_t;
+
+/**
+ * Describes the cyclic telemetry, the signals are
+ * sampled on the control tick they are sent from,
+ * all signals of a frame come from the same tick.
+ */
+typedef struct {
+    _telem_frame_t frame[Telem_Frame_NUM];
+} _can_telem_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void can_telem_set(uint8_t _index, uint16_t _period, bool _sync, 
+    const uint8_t * _map);
+void can_telem_tick_work();
+void can_telem_sync();
+
+#endif /*__CAN_TELEM_H__*/
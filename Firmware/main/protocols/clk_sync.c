@@ -0,0 +1,192 @@
+/**
+ * @file clk_sync.c
+ *
+ * Control tick clock synchronisation. Each drive runs TIM2 from its
+ * own crystal, the ticks of the axes drift apart by up to 100ppm. A
+ * master (the host or one drive) broadcasts its time, each node
+ * takes the offset of its clock at the reception in the receive
+ * interrupt and trims the TIM2 period with a PI servo, the integral
+ * settles on the crystal skew. A large offset (power-up, master
+ * change) steps the clock by whole ticks, the ticks of all nodes
+ * then fall on the same multiples of CONTROL_PERIOD_US of the
+ * master's time.
+ *
+ * The offset includes the transmission of the time stamp frame,
+ * which is the same for all nodes. The receive interrupt waits for
+ * the control tick interrupt it may coincide with, the servo
+ * averages this jitter out.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "clk_sync.h"
+#include "setup.h"
+#include "tim.h"
+#include "can.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+_clk_sync_t clk_sync = {
+    .arr_run = CONTROL_PERIOD_US - 1,
+    .arr_next = CONTROL_PERIOD_US - 1,
+    .state = CLK_STATE_FREE,
+};
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static int32_t _clk_clamp(int32_t _val, int32_t _max);
+static void _clk_master(_clk_sync_t * clk_p);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Send the time as the master.
+ * @param _ms Time stamp period (ms, 0 = off).
+ */
+void clk_sync_set_master(uint16_t _ms)
+{
+    clk_sync.master_count = 0;
+    clk_sync.master = (uint16_t)(_ms * (CONTROL_FREQ_HZ / 1000));
+}
+
+/**
+ * Advance the clock and load the trimmed period of the
+ * next tick, called at 20kHz before anything else.
+ * The auto-reload is preloaded, the period written now
+ * runs after the one that just started.
+ */
+void clk_sync_tick_work()
+{
+    clk_sync.time_us += CONTROL_PERIOD_US;
+    clk_sync.ticks++;
+
+    int32_t _len = ((int32_t)CONTROL_PERIOD_US << CLK_FRAC_SHIFT) +
+        clk_sync.adj + clk_sync.frac;
+    clk_sync.arr_run = clk_sync.arr_next;
+    clk_sync.arr_next = (uint16_t)((_len >> CLK_FRAC_SHIFT) - 1);
+    clk_sync.frac = (uint16_t)(_len & ((1L << CLK_FRAC_SHIFT) - 1));
+    __HAL_TIM_SET_AUTORELOAD(&htim2, clk_sync.arr_next);
+
+    _clk_master(&clk_sync);
+}
+
+/**
+ * Time since the last tick, called from an interrupt of
+ * the control tick priority (no preemption by the tick).
+ * @return Microseconds from the last tick, one period
+ * more if the update is pending.
+ */
+uint32_t clk_sync_elapsed()
+{
+    /*The TIM2 counter runs at 1MHz*/
+    uint32_t _dt = __HAL_TIM_GET_COUNTER(&htim2);
+
+    /*The update of this period is pending (this interrupt
+    was served first), the counter is read again as it may
+    have wrapped meanwhile*/
+    if (__HAL_TIM_GET_FLAG(&htim2, TIM_FLAG_UPDATE))
+        _dt = __HAL_TIM_GET_COUNTER(&htim2) + clk_sync.arr_run + 1;
+    return _dt;
+}
+
+/**
+ * Take a time stamp of the master, called from the
+ * CAN receive interrupt.
+ * @param _data Byte0~3 time of the master (uint32, us).
+ */
+void clk_sync_rx(const uint8_t * _data)
+{
+    uint32_t _master_us = _data[0] | (_data[1] << 8) |
+        (_data[2] << 16) | ((uint32_t)_data[3] << 24);
+    /*The master does not follow other masters*/
+    if (clk_sync.master) return;
+
+    uint32_t _dt = clk_sync_elapsed();
+    uint32_t _ticks = clk_sync.ticks - clk_sync.rx_ticks;
+    int32_t _e = (int32_t)(clk_sync.time_us + _dt - _master_us);
+
+    if (_dt > CONTROL_PERIOD_US) _ticks++;
+    clk_sync.rx_ticks = clk_sync.ticks;
+    clk_sync.offset = _e;
+
+    if ((clk_sync.state == CLK_STATE_FREE) || (_ticks > CLK_GAP_TICK) ||
+        (_e > CLK_STEP_US) || (_e < -CLK_STEP_US)) {
+        /*Step by whole ticks, the ticks stay on multiples
+        of the period, the servo takes the rest*/
+        int32_t _step = (_e + ((_e >= 0) ? 1 : -1) *
+            (CONTROL_PERIOD_US / 2)) / CONTROL_PERIOD_US;
+        clk_sync.time_us -= (uint32_t)(_step * CONTROL_PERIOD_US);
+        clk_sync.state = CLK_STATE_LOCKING;
+        clk_sync.lock_count = 0;
+        clk_sync.steps++;
+        return;
+    }
+    if (_ticks == 0) return;
+
+    /*The correction is spread over the interval to the
+    next time stamp, taken as long as the last one*/
+    int32_t _eq = _e * (1L << CLK_FRAC_SHIFT);
+    clk_sync.integ = _clk_clamp(clk_sync.integ +
+        _eq / (CLK_KI_DIV * (int32_t)_ticks), CLK_ADJ_MAX);
+    clk_sync.adj = _clk_clamp(clk_sync.integ +
+        _eq / (CLK_KP_DIV * (int32_t)_ticks), CLK_ADJ_MAX);
+
+    int32_t _abs = (_e >= 0) ? _e : -_e;
+    if (clk_sync.state == CLK_STATE_LOCKING) {
+        if (_abs > CLK_LOCK_US) clk_sync.lock_count = 0;
+        else if (++clk_sync.lock_count >= CLK_LOCK_NUM) {
+            clk_sync.state = CLK_STATE_LOCKED;
+            clk_sync.jitter = _abs << 4;
+            clk_sync.offset_max = _abs;
+        }
+        return;
+    }
+
+    clk_sync.jitter += ((_abs << 4) - clk_sync.jitter) >> 4;
+    if (_abs > clk_sync.offset_max) clk_sync.offset_max = _abs;
+}
+
+/**
+ * Clamp to +-_max.
+ */
+static int32_t _clk_clamp(int32_t _val, int32_t _max)
+{
+    if (_val > _max) return _max;
+    if (_val < -_max) return -_max;
+    return _val;
+}
+
+/**
+ * Broadcast the time of this tick as the master.
+ */
+static void _clk_master(_clk_sync_t * clk_p)
+{
+    if (clk_p->master == 0) return;
+    if (++clk_p->master_count < clk_p->master) return;
+    clk_p->master_count = 0;
+
+    uint8_t _frame[8] = {0};
+    CAN_TxHeaderTypeDef _header = {
+        .StdId = CLK_CMD, .ExtId = 0x00,
+        .IDE = CAN_ID_STD, .RTR = CAN_RTR_DATA, .DLC = 4,
+        .TransmitGlobalTime = DISABLE,
+    };
+
+    _frame[0] = (uint8_t)(clk_p->time_us);
+    _frame[1] = (uint8_t)(clk_p->time_us >> 8);
+    _frame[2] = (uint8_t)(clk_p->time_us >> 16);
+    _frame[3] = (uint8_t)(clk_p->time_us >> 24);
+    CAN_Send(&_header, _frame);
+}
@@ -0,0 +1,88 @@
+/**
+ * @file clk_sync.h
+ *
+ */
+
+#ifndef __CLK_SYNC_H__
+#define __CLK_SYNC_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "control_config.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define CLK_CMD 0x34U /*Time stamp, broadcast (node 0)*/
+#define CLK_FRAC_SHIFT 16U /*Period adjustment in 1/65536us*/
+#define CLK_ADJ_MAX (1L << 15) /*At most 0.5us per tick (1%)*/
+#define CLK_STEP_US 500 /*Larger offsets step the clock*/
+#define CLK_GAP_TICK 20000U /*No time stamp for 1s, locks again*/
+#define CLK_KP_DIV 4 /*A quarter of the offset removed per interval*/
+#define CLK_KI_DIV 32
+#define CLK_LOCK_US 25 /*Locked within half a tick ...*/
+#define CLK_LOCK_NUM 8U /*... for 8 time stamps in a row*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+enum {
+    CLK_STATE_FREE = 0,
+    CLK_STATE_LOCKING,
+    CLK_STATE_LOCKED,
+};
+
+/**
+ * Describes the control tick clock. The time advances
+ * CONTROL_PERIOD_US per tick, the TIM2 period is trimmed
+ * by a PI servo so that the ticks fall on the master's
+ * time, on multiples of CONTROL_PERIOD_US. The TIM2
+ * counter has a 1us step, fractions of a microsecond
+ * are dithered over the ticks.
+ */
+typedef struct {
+    /**< Time of the last tick (us)*/
+    volatile uint32_t time_us;
+    uint32_t ticks;
+    /**< Auto-reload of the running period and of the next*/
+    uint16_t arr_run;
+    uint16_t arr_next;
+    /**< Dithered fraction (1/65536us)*/
+    uint16_t frac;
+    /**< Period adjustment and its integral (1/65536us per tick)*/
+    int32_t adj;
+    int32_t integ;
+    /**< Tick of the last time stamp*/
+    uint32_t rx_ticks;
+    uint8_t state;
+    uint8_t lock_count;
+    /**< Offset to the master at the last time stamp (us)*/
+    int32_t offset;
+    /**< Mean absolute offset while locked (1/16us)*/
+    int32_t jitter;
+    /**< Largest absolute offset while locked (us)*/
+    int32_t offset_max;
+    uint16_t steps;
+    /**< Time stamp period as the master (control ticks, 0 = off)*/
+    uint16_t master;
+    uint16_t master_count;
+} _clk_sync_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void clk_sync_set_master(uint16_t _ms);
+void clk_sync_tick_work();
+uint32_t clk_sync_elapsed();
+void clk_sync_rx(const uint8_t * _data);
+
+extern _clk_sync_t clk_sync;
+
+#endif /*__CLK_SYNC_H__*/
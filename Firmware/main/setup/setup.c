@@ -9,7 +9,11 @@
 
 #include "control_config.h"
 #include "motor_control.h"
+#include "Speed_Tracker.h"
+#include "homing.h"
+#include "can.h"
 #include <string.h>
+#include <stddef.h>
 #include "romf103cb.h"
 #include "setup.h"
 #include "time.h"
@@ -37,16 +41,66 @@ const _setup_t _setup_def = {
     .current_up_acc = 2 * 1000, /*(mA/s)*/
     .current_rated = 1000,
     .cali_current = 2000,
-
-    .dce_kp = 200,
-    .dce_kv = 80,
-    .dce_ki = 300,
-    .dce_kd = 250,
+    .i_sat = 0, /*(mA) Not identified*/
+    .out_scale = _Current_Out_Scale,
+    .lead_table = {0},
+    .lead_valid = false, /*Use the DPS table*/
+    .fw_speed = {0},
+    .fw_angle = {0}, /*No commutation advance*/
+    .filter_coef = {{0}},
+    .filter_enable = 0x00, /*Bypass the filter bank*/
+
+    .dce_kp = De_DCE_KP,
+    .dce_kv = De_DCE_KV,
+    .dce_ki = De_DCE_KI,
+    .dce_kd = De_DCE_KD,
+    .inertia_ref = 0, /*Not tuned*/
+    .gain_sched = false,
+    .pid_kp = De_PID_KP,
+    .pid_ki = De_PID_KI,
+    .casc_kp = De_CASC_KP,
+    .casc_enable = false, /*DCE*/
+    .load_comp = false,
+    .ferr_window = 0, /*Off*/
+    .ferr_debounce = De_Ferr_Debounce,
+    .ferr_react = Fault_React_Disable,
+    .qstop_acc = DE_QSTOP_ACC,
+    .hb_timeout = 0, /*Off*/
+    .home_method = HOME_METHOD_ABS_ANGLE, /*No search*/
+    .home_dir = 1, /*Negative*/
+    .home_polarity = false, /*Switch to GND*/
+    .home_search = Move_Pulse_NUM / 2,
+    .home_latch = Move_Pulse_NUM / 20,
+    .home_current = 500,
+    .home_pos = 0,
+    .home_range = 10 * Move_Pulse_NUM,
+    .home_angle = 0,
+    .pos_keep = false,
+    .pos_limit = false,
+    .pos_min = -10 * Move_Pulse_NUM,
+    .pos_max = 10 * Move_Pulse_NUM,
+    .telem_period = {0}, /*No cyclic frames*/
+    .telem_map = {{0}},
+    .telem_sync = 0x00,
+    .sync_mode = false, /*Setpoints applied at once*/
+    .clk_master = 0, /*Follow the master's time stamps*/
+    .can_baud = CAN_BAUD_DEF,
+    .can_detect = true,
+    .can_react = CAN_REACT_NONE,
 
     .motor_onboot = false,
     .stall_protect = false,
 
     .ssid = {".Bin-X42"},
+    .layout = SETUP_LAYOUT,
+};
+
+/*End of the record in each layout, a record of an older 
+layout keeps its fields and takes the appended ones from 
+the defaults*/
+static const uint16_t _layout_end[SETUP_LAYOUT + 1] = {
+    offsetof(_setup_t, layout), /*0, up to the ssid*/
+    sizeof(_setup_t),
 };
 
 /**********************
@@ -63,6 +117,8 @@ _setup_t _setup = {0};
  **********************/
 
 static bool verify(void * p1, void * p2, uint32_t n);
+static void store(void);
+static void migrate(const uint8_t * data_p);
 
 /**********************
  *   GLOBAL FUNCTIONS
@@ -179,21 +235,13 @@ void read_file()
         (res2 != true)) {
         memcpy(&_setup, &_setup_def, 
             file_size);
-
-        __disable_irq();
-        /*Erase the data area*/
-        rom_data_clear(&stockpile_data);
-        /*Start writing the data area*/
-        rom_data_begin(&stockpile_data);
-
-        rom_write_data16(&stockpile_data, 
-            (uint16_t *)&_setup, 
-            sizeof(_setup_t) / 2);
-
-        /*Finish writing the data area*/
-        rom_data_end(&stockpile_data);
-
-        __enable_irq();
+        store();
+    }
+    else if (_setup.layout != SETUP_LAYOUT) {
+        /*Written by an older firmware, keep the 
+        node ID, home offset and user settings*/
+        migrate(data_p);
+        store();
     }
 
     /*Reads data from a permanent storage 
@@ -220,24 +268,48 @@ void read_file()
     if (inv_file) {
         memcpy(&_setup, &_setup_def, 
             file_size);
+        store();
+    }
 
-        __disable_irq();
-        /*Erase the data area*/
-        rom_data_clear(&stockpile_data);
-        /*Start writing the data area*/
-        rom_data_begin(&stockpile_data);
+    memcpy(&setup_verify, &_setup, file_size);
+}
 
-        rom_write_data16(&stockpile_data, 
-            (uint16_t *)&_setup, 
-            sizeof(_setup_t) / 2);
+/**
+ * Rewrite the data area with the settings in memory.
+ */
+static void store(void)
+{
+    __disable_irq();
+    /*Erase the data area*/
+    rom_data_clear(&stockpile_data);
+    /*Start writing the data area*/
+    rom_data_begin(&stockpile_data);
 
-        /*Finish writing the data area*/
-        rom_data_end(&stockpile_data);
+    rom_write_data16(&stockpile_data, 
+        (uint16_t *)&_setup, 
+        sizeof(_setup_t) / 2);
 
-        __enable_irq();
-    }
+    /*Finish writing the data area*/
+    rom_data_end(&stockpile_data);
 
-    memcpy(&setup_verify, &_setup, file_size);
+    __enable_irq();
+}
+
+/**
+ * Bring a record of an older layout up to date, the fields 
+ * it has are kept, the appended ones take their defaults. 
+ * The original record has no layout field, erased flash 
+ * (0xFFFF) or an unknown layout is read as that one.
+ * @param data_p pointer to the stored record.
+ */
+static void migrate(const uint8_t * data_p)
+{
+    uint16_t _layout = _setup.layout;
+
+    if (_layout > SETUP_LAYOUT) _layout = 0;
+    memcpy(&_setup, &_setup_def, sizeof(_setup_t));
+    memcpy(&_setup, data_p, _layout_end[_layout]);
+    _setup.layout = SETUP_LAYOUT;
 }
 
 /**
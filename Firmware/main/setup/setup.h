@@ -10,6 +10,7 @@
  *      INCLUDES
  *********************/
 
+#include "control_config.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -17,6 +18,8 @@
  *      DEFINES
  *********************/
 
+#define SETUP_LAYOUT 1U /*Record layout, 0 is the original without the field*/
+
 /**********************
  *      TYPEDEFS
  **********************/
@@ -45,6 +48,53 @@ typedef struct {
     bool motor_onboot;
     bool stall_protect;
     uint8_t ssid[8 + 1];
+
+    /*Fields are only appended from here on, bump 
+    SETUP_LAYOUT and add the end of the new layout 
+    to the table in setup.c*/
+    uint16_t layout;
+    int32_t inertia_ref; /*(Q16, EST_INERTIA_SCALE)*/
+    bool gain_sched;
+    int32_t pid_kp;
+    int32_t pid_ki;
+    int32_t casc_kp; /*(1/s)*/
+    bool casc_enable;
+    bool load_comp;
+    int32_t ferr_window; /*(pulse, 0 = off)*/
+    uint16_t ferr_debounce; /*(control tick)*/
+    uint8_t ferr_react; /*(Motor_Fault_React)*/
+    int32_t qstop_acc; /*(pulse/s^2)*/
+    uint16_t hb_timeout; /*(ms, 0 = off)*/
+    uint8_t home_method; /*(0 hard stop, 1 switch, 2 absolute angle)*/
+    uint8_t home_dir; /*(0 positive, 1 negative)*/
+    bool home_polarity; /*(switch active high)*/
+    int32_t home_search; /*(pulse/s)*/
+    int32_t home_latch; /*(pulse/s)*/
+    int32_t home_current; /*(mA)*/
+    int32_t home_pos; /*(pulse, user position of the reference)*/
+    int32_t home_range; /*(pulse)*/
+    int32_t home_angle; /*(pulse, single-turn encoder angle)*/
+    bool pos_keep; /*(multi-turn position kept over power cycles)*/
+    bool pos_limit; /*(software position limits enabled)*/
+    int32_t pos_min; /*(pulse, user position)*/
+    int32_t pos_max; /*(pulse, user position)*/
+    uint16_t telem_period[Telem_Frame_NUM]; /*(control tick, 0 = off)*/
+    uint8_t telem_map[Telem_Frame_NUM][Telem_Map_NUM]; /*(TELEM_SIG_x)*/
+    uint8_t telem_sync; /*(bit mask, frames also sent on SYNC)*/
+    bool sync_mode; /*(setpoints wait for the SYNC broadcast)*/
+    uint16_t clk_master; /*(ms, time stamp period as the clock master, 0 = off)*/
+    uint32_t can_baud; /*(bit/s)*/
+    bool can_detect; /*(bit rate detected at power-up)*/
+    uint8_t can_react; /*(bus-off reaction, CAN_REACT_x)*/
+
+    int32_t i_sat; /*(mA) Saturated phase current*/
+    uint16_t out_scale; /*(1024 = 1.0)*/
+    int16_t lead_table[Lead_Table_NUM];
+    bool lead_valid;
+    int32_t fw_speed[Fw_Point_NUM]; /*(pulse/s)*/
+    int16_t fw_angle[Fw_Point_NUM]; /*(1024 = 360deg)*/
+    int32_t filter_coef[Out_Filter_NUM][5]; /*(Q24)*/
+    uint8_t filter_enable; /*(bit mask)*/
 } _setup_t;
 
 /**********************
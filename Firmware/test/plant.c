@@ -0,0 +1,233 @@
+/**
+ * @file plant.c
+ *
+ * Closed loop around the real motor control callback, trackers,
+ * output filter, load observer and inertia estimate. The encoder
+ * reads the simulated rotor, the driver applies the commanded
+ * current as torque. Hardware modules the control code touches
+ * are replaced here.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "plant.h"
+#include "mt6816.h"
+#include "enc_cali.h"
+#include "tb67h450.h"
+#include "temp.h"
+#include "sys_ident.h"
+#include "pos_journal.h"
+#include "inertia_est.h"
+#include "load_obs.h"
+#include "out_filter.h"
+#include "Location_Tracker.h"
+#include "Speed_Tracker.h"
+#include "Move_Reconstruct.h"
+#include <math.h>
+#include <string.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define SUB_STEP 10 /*Integration steps per control tick*/
+#define BRAKE_VISC 0.05 /*Shorted windings (mA per pulse/s)*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+_plant_t plant;
+
+_setup_t _setup;
+_cali_attr_t cali;
+_angle_t _angle;
+
+extern _inertia_est_t inertia_est;
+extern _load_obs_t load_obs;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static void _plant_step(double _dt);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Start a new run with the power-up settings of main.c
+ * (setup defaults), the axis at rest in position mode.
+ * @param _m Inertia (mA per pulse/s^2).
+ * @param _load Constant load (mA).
+ * @param _pos Start position, within half a turn.
+ */
+void plant_init(double _m, double _load, double _pos)
+{
+    static const int32_t _coef_none[OUT_FILTER_COEF_NUM] = {0};
+    static bool first_call = true;
+
+    memset(&plant, 0, sizeof(plant));
+    plant.m = _m;
+    plant.load = _load;
+    plant.pos = _pos;
+
+    memset(&_setup, 0, sizeof(_setup));
+    _setup.current_rated = 1000;
+    _setup.speed_rated = 30 * Move_Pulse_NUM;
+    _setup.speed_up_acc = 100 * Move_Pulse_NUM;
+    _setup.speed_down_acc = 100 * Move_Pulse_NUM;
+    _setup.qstop_acc = DE_QSTOP_ACC;
+    _setup.out_scale = _Current_Out_Scale;
+
+    Move_Home_Offset = 0;
+    Move_Rated_Speed = _setup.speed_rated;
+    Move_Rated_UpAcc = _setup.speed_up_acc;
+    Move_Rated_DownAcc = _setup.speed_down_acc;
+    Current_Rated_Current = _setup.current_rated;
+    Speed_Tracker_Set_UpAcc(_setup.speed_up_acc);
+    Speed_Tracker_Set_DownAcc(_setup.speed_down_acc);
+    Speed_Tracker_Set_QuickStopAcc(_setup.qstop_acc);
+    Location_Tracker_Set_MaxSpeed(_setup.speed_rated);
+    Location_Tracker_Set_UpAcc(_setup.speed_up_acc);
+    Location_Tracker_Set_DownAcc(_setup.speed_down_acc);
+    Move_Reconstruct_Set_Default();
+    Motor_Control_SetMotorMode(Control_Mode_Stop);
+    Motor_Control_Init();
+    Motor_Control_SetOutScale(_setup.out_scale);
+    Motor_Control_SetFollowError(0, De_Ferr_Debounce, Fault_React_Disable);
+    Motor_Control_SetPosLimit(false, 0, 0);
+
+    Control_DCE_Set_Default();
+    Control_PID_Set_Default();
+    Control_Cascade_SetKP(De_CASC_KP);
+    Control_Cascade_SetEnable(false);
+    for (uint8_t i = 0; i < Out_Filter_NUM; i++)
+        out_filter_set(i, _coef_none, false);
+    out_filter_reset();
+    memset(&inertia_est, 0, sizeof(inertia_est));
+    inertia_est.gain = 1024;
+    load_obs_set_enable(false);
+    load_obs_reset();
+
+    _angle.rectify_valid = 1;
+    cali._start = false;
+    /*The first callback only reads the encoder*/
+    if (first_call) {
+        plant_run(1);
+        first_call = false;
+    }
+    /*Motor_Control_Init() cleared the location, the first
+    tick unwraps the single-turn angle against 0*/
+    plant_run(1);
+}
+
+/**
+ * Change the mode as CAN 0x05 (0x04 ...) does.
+ */
+void plant_mode(Motor_Mode _mode)
+{
+    Motor_Control_SetMotorMode(_mode);
+}
+
+/**
+ * Run control ticks, each reads the encoder, runs the
+ * control callback, then drives the plant for 50us with
+ * the current commanded.
+ */
+void plant_run(uint32_t _ticks)
+{
+    for (uint32_t i = 0; i < _ticks; i++) {
+        int32_t _lap = (int32_t)floor(plant.pos) % Move_Pulse_NUM;
+        if (_lap < 0) _lap += Move_Pulse_NUM;
+        _angle.rectified = (uint16_t)_lap;
+
+        Motor_Control_Callback();
+        inertia_est_tick_work();
+        if (plant.tick_hook) plant.tick_hook();
+
+        for (uint8_t s = 0; s < SUB_STEP; s++)
+            _plant_step(1.0 / (CONTROL_FREQ_HZ * SUB_STEP));
+    }
+}
+
+/**
+ * The driver applies the commanded current, the FOC
+ * vector leads the rotor so all of it makes torque.
+ */
+void tb_foc_set_current_vector(uint32_t _dir_inCNT, int32_t _I_mA)
+{
+    (void)_dir_inCNT;
+    plant.cur = _I_mA;
+    plant.on = true;
+    plant.brake = false;
+}
+
+void tb_foc_set_out_scale(uint16_t _scale)
+{
+    (void)_scale;
+}
+
+void tb_driver_sleep()
+{
+    plant.cur = 0;
+    plant.on = false;
+    plant.brake = false;
+}
+
+void tb_driver_brake()
+{
+    plant.cur = 0;
+    plant.on = false;
+    plant.brake = true;
+}
+
+/**
+ * Cold unless the test heats it, the overtemperature
+ * trip needs a raw reading above 3200.
+ */
+uint16_t _overtemp()
+{
+    return plant.temp_raw;
+}
+
+/**
+ * The identification needs CMSIS-DSP and is
+ * not linked, it never excites.
+ */
+int32_t sys_ident_excite()
+{
+    return 0;
+}
+
+/**
+ * The multi-turn journal is off.
+ */
+int32_t pos_journal_reconcile(int32_t _lap)
+{
+    return _lap;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static void _plant_step(double _dt)
+{
+    double _drive = plant.cur - plant.load - plant.visc * plant.vel;
+    if (plant.brake) _drive -= BRAKE_VISC * plant.vel;
+
+    /*Coulomb friction holds the rotor while it can*/
+    if ((plant.vel == 0) && (fabs(_drive) <= plant.fric)) return;
+    double _f = (plant.vel > 0) ? plant.fric : (plant.vel < 0) ?
+        -plant.fric : ((_drive > 0) ? plant.fric : -plant.fric);
+
+    double _v = plant.vel + (_drive - _f) / plant.m * _dt;
+    /*Friction stops the rotor, it does not reverse it*/
+    if ((plant.vel != 0) && ((_v > 0) != (plant.vel > 0))) _v = 0;
+    plant.pos += (plant.vel + _v) * 0.5 * _dt;
+    plant.vel = _v;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file plant.h
+ *
+ */
+
+#ifndef __PLANT_H__
+#define __PLANT_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "motor_control.h"
+#include "setup.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * Describes the simulated axis, a rigid inertia driven by
+ * the commanded phase current (mA stands for torque) against
+ * a constant load, viscous and Coulomb friction.
+ */
+typedef struct {
+    /**< Inertia (mA per pulse/s^2)*/
+    double m;
+    /**< Constant load, gravity (mA, positive pulls backwards)*/
+    double load;
+    /**< Viscous friction (mA per pulse/s)*/
+    double visc;
+    /**< Coulomb friction (mA)*/
+    double fric;
+    /**< Position (pulse) and speed (pulse/s)*/
+    double pos;
+    double vel;
+    /**< Current driven, 0 while the driver sleeps*/
+    double cur;
+    bool on;
+    bool brake;
+    /**< Raw temperature reading, trips above 3200*/
+    uint16_t temp_raw;
+    /**< Called each tick after the control callback*/
+    void (*tick_hook)(void);
+} _plant_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void plant_init(double _m, double _load, double _pos);
+void plant_run(uint32_t _ticks);
+void plant_mode(Motor_Mode _mode);
+
+extern _plant_t plant;
+
+#endif /*__PLANT_H__*/
@@ -0,0 +1,8 @@
+/**
+ * @file Control_Config.h
+ *
+ * The XDrive trackers include the config header capitalised,
+ * which only resolves on a case-insensitive file system.
+ */
+
+#include "control_config.h"
@@ -0,0 +1,37 @@
+/**
+ * @file can.h
+ *
+ * Host stand-in of hal/inc/can.h, the sent frames
+ * are counted and the last one kept.
+ */
+
+#ifndef __CAN_H__
+#define __CAN_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "main.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define CAN_BAUD_DEF 500000U /*Bit rate without a valid setting (bit/s)*/
+
+/*Reaction of the motor to a bus-off*/
+#define CAN_REACT_NONE 0U /*Keeps the last setpoint*/
+#define CAN_REACT_QSTOP 1U /*Quick-stops and disables, as 0x01*/
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void CAN_Send(CAN_TxHeaderTypeDef * pHeader, uint8_t * data);
+
+extern uint32_t can_sent_num;
+extern CAN_TxHeaderTypeDef can_sent_header;
+extern uint8_t can_sent_data[8];
+
+#endif /*__CAN_H__*/
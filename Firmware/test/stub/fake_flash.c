@@ -0,0 +1,169 @@
+/**
+ * @file fake_flash.c
+ *
+ * Flash of the STM32F103CB on the host. A page erase sets it to
+ * 0xFF, programming is by halfword and only into an erased
+ * halfword as the flash controller does (PGERR otherwise). The
+ * supply can be cut after a number of programmed halfwords to
+ * leave a record torn the way a power failure does.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "fake_flash.h"
+#include "stm32f1xx_hal.h"
+#include <string.h>
+#include <sys/mman.h>
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static uint8_t * flash_mem = NULL;
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+_fake_flash_t fake_flash = {
+    .cut = -1,
+};
+
+FLASH_TypeDef fake_flash_reg;
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+static bool _flash_in(uint32_t _addr, uint32_t _size);
+static HAL_StatusTypeDef _flash_prog16(uint32_t _addr, uint16_t _data);
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Map the fake flash at the flash address,
+ * erased as a new chip.
+ * @return Whether the address range was free.
+ */
+bool fake_flash_init(void)
+{
+    if (flash_mem == NULL) {
+        void * _p = mmap((void *)(uintptr_t)FAKE_FLASH_BASE, FAKE_FLASH_SIZE,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS |
+            MAP_FIXED_NOREPLACE, -1, 0);
+        if (_p != (void *)(uintptr_t)FAKE_FLASH_BASE) return false;
+        flash_mem = (uint8_t *)_p;
+    }
+    memset(flash_mem, 0xFF, FAKE_FLASH_SIZE);
+    memset(&fake_flash, 0, sizeof(fake_flash));
+    fake_flash.cut = -1;
+    return true;
+}
+
+/**
+ * Cut the supply after a number of halfwords.
+ * @param _halfwords Halfwords still programmed, 0 cuts
+ * at once, -1 never.
+ */
+void fake_flash_cut(int32_t _halfwords)
+{
+    fake_flash.cut = _halfwords;
+    fake_flash.off = (_halfwords == 0);
+}
+
+/**
+ * Supply back, the flash keeps its content.
+ */
+void fake_flash_power_on(void)
+{
+    fake_flash.cut = -1;
+    fake_flash.off = false;
+    fake_flash.unlocked = false;
+}
+
+uint16_t fake_flash_read16(uint32_t _addr)
+{
+    uint16_t _v;
+    memcpy(&_v, flash_mem + (_addr - FAKE_FLASH_BASE), 2);
+    return _v;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+    fake_flash.unlocked = true;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+    fake_flash.unlocked = false;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+    uint8_t _n = (TypeProgram == FLASH_TYPEPROGRAM_HALFWORD) ? 1 :
+        (TypeProgram == FLASH_TYPEPROGRAM_WORD) ? 2 : 4;
+
+    if (!fake_flash.unlocked) return HAL_ERROR;
+    if ((Address & 1U) || !_flash_in(Address, _n * 2U)) return HAL_ERROR;
+
+    for (uint8_t i = 0; i < _n; i++) {
+        HAL_StatusTypeDef _res = _flash_prog16(Address + i * 2U,
+            (uint16_t)(Data >> (16 * i)));
+        if (_res != HAL_OK) return _res;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef * pEraseInit, uint32_t * PageError)
+{
+    uint32_t _addr = pEraseInit->PageAddress;
+    uint32_t _size = pEraseInit->NbPages * FLASH_PAGE_SIZE;
+
+    *PageError = 0xFFFFFFFFU;
+    if (!fake_flash.unlocked) return HAL_ERROR;
+    if ((_addr % FLASH_PAGE_SIZE) || !_flash_in(_addr, _size)) return HAL_ERROR;
+    /*An erase cut by the supply leaves the page as it was*/
+    if (fake_flash.off) return HAL_ERROR;
+
+    memset(flash_mem + (_addr - FAKE_FLASH_BASE), 0xFF, _size);
+    fake_flash.erases += pEraseInit->NbPages;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef FLASH_WaitForLastOperation(uint32_t Timeout)
+{
+    (void)Timeout;
+    return HAL_OK;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static bool _flash_in(uint32_t _addr, uint32_t _size)
+{
+    return (_addr >= FAKE_FLASH_BASE) &&
+        (_addr + _size <= FAKE_FLASH_BASE + FAKE_FLASH_SIZE);
+}
+
+static HAL_StatusTypeDef _flash_prog16(uint32_t _addr, uint16_t _data)
+{
+    if (fake_flash.off) return HAL_ERROR;
+    if (fake_flash.cut > 0 && --fake_flash.cut == 0)
+        fake_flash.off = true;
+
+    uint8_t * _p = flash_mem + (_addr - FAKE_FLASH_BASE);
+    if ((_p[0] != 0xFF) || (_p[1] != 0xFF)) {
+        fake_flash.prog_errs++;
+        return HAL_ERROR;
+    }
+    memcpy(_p, &_data, 2);
+    fake_flash.programs++;
+    return HAL_OK;
+}
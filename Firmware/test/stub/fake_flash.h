@@ -0,0 +1,55 @@
+/**
+ * @file fake_flash.h
+ *
+ */
+
+#ifndef __FAKE_FLASH_H__
+#define __FAKE_FLASH_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define FAKE_FLASH_BASE 0x08000000U
+#define FAKE_FLASH_SIZE 0x00020000U /*128K, STM32F103CB*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * Describes the fake flash, the array is mapped at the
+ * real flash address so that code reading the flash
+ * through a pointer works unchanged.
+ */
+typedef struct {
+    /**< Halfwords programmed before the supply is cut, -1 never*/
+    int32_t cut;
+    /**< Supply cut, programming and erasing are ignored*/
+    bool off;
+    uint32_t programs;
+    uint32_t erases;
+    /**< Programming over a not erased halfword*/
+    uint32_t prog_errs;
+    bool unlocked;
+} _fake_flash_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+bool fake_flash_init(void);
+void fake_flash_cut(int32_t _halfwords);
+void fake_flash_power_on(void);
+uint16_t fake_flash_read16(uint32_t _addr);
+
+extern _fake_flash_t fake_flash;
+
+#endif /*__FAKE_FLASH_H__*/
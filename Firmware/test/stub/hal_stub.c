@@ -0,0 +1,52 @@
+/**
+ * @file hal_stub.c
+ *
+ * Host stand-ins of the timer handles, the CAN transmit and
+ * the system tick. The timer registers are plain memory the
+ * tests advance, the sent CAN frames are counted and the last
+ * one is kept.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "tim.h"
+#include "can.h"
+#include <string.h>
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static TIM_TypeDef tim2_reg = {.ARR = 49};
+static TIM_TypeDef tim4_reg;
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+TIM_HandleTypeDef htim2 = {.Instance = &tim2_reg, .Init = {.Period = 49}};
+TIM_HandleTypeDef htim4 = {.Instance = &tim4_reg};
+
+uint32_t hal_tick_ms = 0;
+
+uint32_t can_sent_num = 0;
+CAN_TxHeaderTypeDef can_sent_header;
+uint8_t can_sent_data[8];
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+uint32_t HAL_GetTick(void)
+{
+    return hal_tick_ms;
+}
+
+void CAN_Send(CAN_TxHeaderTypeDef * pHeader, uint8_t * data)
+{
+    can_sent_num++;
+    can_sent_header = *pHeader;
+    memcpy(can_sent_data, data, sizeof(can_sent_data));
+}
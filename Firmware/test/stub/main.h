@@ -0,0 +1,16 @@
+/**
+ * @file main.h
+ *
+ * Host stand-in of main/main.h.
+ */
+
+#ifndef __MAIN_H__
+#define __MAIN_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "stm32f1xx_hal.h"
+
+#endif /*__MAIN_H__*/
@@ -0,0 +1,120 @@
+/**
+ * @file stm32f1xx_hal.h
+ *
+ * Host stand-in of the HAL, only the types, registers and
+ * macros the firmware modules under test touch. The
+ * registers are plain memory the tests set and read.
+ */
+
+#ifndef __STM32F1XX_HAL_H__
+#define __STM32F1XX_HAL_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define ENABLE 1U
+#define DISABLE 0U
+
+#define FLASH_PAGE_SIZE 0x400U
+#define FLASH_TYPEERASE_PAGES 0x00U
+#define FLASH_TYPEPROGRAM_HALFWORD 0x01U
+#define FLASH_TYPEPROGRAM_WORD 0x02U
+#define FLASH_TYPEPROGRAM_DOUBLEWORD 0x03U
+#define FLASH_CR_PER 0x00000002U
+#define FLASH (&fake_flash_reg)
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+
+#define CLEAR_BIT(reg, bit) ((reg) &= ~(bit))
+
+#define TIM_FLAG_UPDATE 0x0001U
+#define TIM_CHANNEL_1 0x0000U
+#define TIM_CHANNEL_2 0x0004U
+
+#define CAN_ID_STD 0x00000000U
+#define CAN_RTR_DATA 0x00000000U
+
+#define GPIO_PIN_0 0x0001U
+#define GPIO_PIN_1 0x0002U
+
+#define __HAL_TIM_GET_COUNTER(h) ((h)->Instance->CNT)
+#define __HAL_TIM_GET_FLAG(h, f) (((h)->Instance->SR & (f)) == (f))
+#define __HAL_TIM_SET_AUTORELOAD(h, a) \
+    do { (h)->Instance->ARR = (a); (h)->Init.Period = (a); } while (0)
+#define __HAL_TIM_SET_COMPARE(h, c, v) ((void)(h), (void)(c), (void)(v))
+
+#define __disable_irq() ((void)0)
+#define __enable_irq() ((void)0)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef enum {
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U,
+} HAL_StatusTypeDef;
+
+typedef struct {
+    volatile uint32_t CR;
+} FLASH_TypeDef;
+
+typedef struct {
+    uint32_t TypeErase;
+    uint32_t Banks;
+    uint32_t PageAddress;
+    uint32_t NbPages;
+} FLASH_EraseInitTypeDef;
+
+typedef struct {
+    volatile uint32_t SR;
+    volatile uint32_t CNT;
+    volatile uint32_t ARR;
+} TIM_TypeDef;
+
+typedef struct {
+    uint32_t Period;
+} TIM_Base_InitTypeDef;
+
+typedef struct {
+    TIM_TypeDef * Instance;
+    TIM_Base_InitTypeDef Init;
+} TIM_HandleTypeDef;
+
+typedef struct {
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    uint32_t TransmitGlobalTime;
+} CAN_TxHeaderTypeDef;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+uint32_t HAL_GetTick(void);
+extern uint32_t hal_tick_ms; /*Advanced by the tests*/
+
+void HAL_NVIC_SystemReset(void);
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef * pEraseInit, uint32_t * PageError);
+HAL_StatusTypeDef FLASH_WaitForLastOperation(uint32_t Timeout);
+
+extern FLASH_TypeDef fake_flash_reg;
+
+#endif /*__STM32F1XX_HAL_H__*/
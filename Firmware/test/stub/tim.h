@@ -0,0 +1,24 @@
+/**
+ * @file tim.h
+ *
+ * Host stand-in of hal/inc/tim.h, TIM2 is a plain
+ * register block the tests advance.
+ */
+
+#ifndef __TIM_H__
+#define __TIM_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "main.h"
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+extern TIM_HandleTypeDef htim2;
+extern TIM_HandleTypeDef htim4;
+
+#endif /*__TIM_H__*/
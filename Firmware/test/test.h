@@ -0,0 +1,36 @@
+/**
+ * @file test.h
+ *
+ * Minimal checks for the host tests, a failed check
+ * prints where and why and makes main() return 1.
+ */
+
+#ifndef __TEST_H__
+#define __TEST_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdio.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+static int test_fails = 0;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            test_fails++; \
+            printf("%s:%d: FAIL %s: ", __FILE__, __LINE__, #cond); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+#define TEST_END() \
+    (printf("%s\n", test_fails ? "FAILED" : "PASSED"), test_fails ? 1 : 0)
+
+#endif /*__TEST_H__*/
@@ -0,0 +1,172 @@
+/**
+ * @file test_bumpless.c
+ *
+ * Mode switches under a gravity load on the simulated axis.
+ * The integrators are preloaded with the output before the
+ * switch, so position, speed and current mode hand the holding
+ * torque over without a dip, where clearing them (the old
+ * behaviour, replayed here) lets the load drop the axis. Also
+ * a stalled speed command, where the back-calculation keeps the
+ * integrator off the clamp and the release overshoots less.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "plant.h"
+#include <math.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define P Move_Pulse_NUM
+#define M_AXIS 2e-5 /*mA per pulse/s^2*/
+#define LOAD 400 /*Gravity (mA)*/
+#define FRIC 10 /*Coulomb friction (mA)*/
+#define WATCH (CONTROL_FREQ_HZ * 3 / 10) /*Sag window after a switch*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    double sag; /*Largest travel from the switch point (pulse)*/
+    int32_t jump; /*Largest current change from before the switch (mA)*/
+} _switch_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static bool _clear_once;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Replays the old new-curve handling, the integrators
+ * are cleared right after the switch is applied.
+ */
+static void _clear_hook(void)
+{
+    if (!_clear_once) return;
+    _clear_once = false;
+    Motor_Control_Clear_Integral();
+}
+
+static void _switch(_switch_t * sw_p, Motor_Mode _mode, bool _old)
+{
+    double _p0 = plant.pos;
+    int32_t _i0 = motor_control.foc_current;
+
+    sw_p->sag = 0;
+    sw_p->jump = 0;
+    _clear_once = _old;
+    plant_mode(_mode);
+    for (uint32_t i = 0; i < WATCH; i++) {
+        plant_run(1);
+        if (fabs(plant.pos - _p0) > sw_p->sag) sw_p->sag = fabs(plant.pos - _p0);
+        /*The first 5ms, before the loop has corrected anything*/
+        if ((i < CONTROL_FREQ_HZ / 200) && (abs(motor_control.foc_current - _i0) > sw_p->jump))
+            sw_p->jump = abs(motor_control.foc_current - _i0);
+    }
+}
+
+static void _hold(void)
+{
+    plant_init(M_AXIS, LOAD, 0);
+    plant.fric = FRIC;
+    plant.tick_hook = _clear_hook;
+    plant_mode(Motor_Mode_Digital_Location);
+    Motor_Control_Write_Goal_Location(0);
+    Motor_Control_Write_Goal_Speed(0);
+    Motor_Control_Write_Goal_Current(LOAD);
+    plant_run(CONTROL_FREQ_HZ / 2);
+}
+
+/**
+ * Location (0x20) -> speed (0x21) -> current (0x22) -> location.
+ */
+static void test_gravity(void)
+{
+    static const Motor_Mode _seq[] = {
+        Motor_Mode_Digital_Speed, Motor_Mode_Digital_Current,
+        Motor_Mode_Digital_Location, Motor_Mode_Digital_Track,
+        Motor_Mode_Digital_Speed, Motor_Mode_Digital_Location,
+    };
+    _switch_t _new, _old;
+
+    for (uint8_t k = 0; k < sizeof(_seq) / sizeof(_seq[0]); k++) {
+        /*From a fresh hold to the k-th mode of the chain, new and old*/
+        _hold();
+        for (uint8_t j = 0; j < k; j++) _switch(&_new, _seq[j], false);
+        _switch(&_new, _seq[k], false);
+        _hold();
+        for (uint8_t j = 0; j < k; j++) _switch(&_old, _seq[j], false);
+        _switch(&_old, _seq[k], true);
+
+        printf("-> 0x%02X: sag %.0f (cleared %.0f), jump %dmA (cleared %dmA)\n",
+            _seq[k], _new.sag, _old.sag, _new.jump, _old.jump);
+        CHECK(_new.sag < P / 1000, "0x%02X sag %.0f", _seq[k], _new.sag);
+        CHECK(_new.jump < LOAD / 20, "0x%02X current jump %dmA", _seq[k], _new.jump);
+        /*Current mode does not use the integrators*/
+        if (_seq[k] != Motor_Mode_Digital_Current)
+            CHECK(_old.sag > 10 * _new.sag, "0x%02X replay sag %.0f", _seq[k], _old.sag);
+    }
+}
+
+/**
+ * A speed command against a stuck rotor saturates the output,
+ * the integrator is fed back the excess and stays off the
+ * clamp. On release the speed overshoot is compared with the
+ * integrator wound up to the clamp, what accumulating without
+ * the back-calculation gives.
+ */
+static double _stall_release(bool _wound)
+{
+    const double _goal = 10 * P;
+    double _peak = 0;
+
+    plant_init(M_AXIS, 0, 0);
+    plant.fric = 5000; /*Stuck, beyond the rated current*/
+    plant_mode(Motor_Mode_Digital_Speed);
+    Motor_Control_Write_Goal_Speed((int32_t)_goal);
+    plant_run(CONTROL_FREQ_HZ / 2);
+
+    CHECK(motor_control.foc_current == Current_Rated_Current,
+        "not saturated %d", motor_control.foc_current);
+    if (_wound) pid.oi = Current_Rated_Current << 10;
+    else printf("stalled: oi %.0fmA\n", pid.oi / 1024.0);
+
+    plant.fric = FRIC;
+    for (uint32_t i = 0; i < CONTROL_FREQ_HZ; i++) {
+        plant_run(1);
+        if (plant.vel - _goal > _peak) _peak = plant.vel - _goal;
+    }
+    CHECK(fabs(plant.vel - _goal) < P / 10, "not settled %.0f", plant.vel - _goal);
+    return _peak;
+}
+
+static void test_windup(void)
+{
+    double _new = _stall_release(false);
+    double _old = _stall_release(true);
+
+    printf("release overshoot %.2fr/s (wound up %.2fr/s)\n", _new / P, _old / P);
+    CHECK(_new < 0.8 * _old, "overshoot %.0f, wound up %.0f", _new, _old);
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(void)
+{
+    test_gravity();
+    test_windup();
+    return TEST_END();
+}
@@ -0,0 +1,150 @@
+/**
+ * @file test_can_ring.c
+ *
+ * Frame ring between the CAN receive interrupt and the main
+ * loop: wrap of the indexes, a full ring dropping and counting
+ * frames, the depth counters and the frame order.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "can_ring.h"
+#include <string.h>
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static _can_ring_t ring;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static void _frame_make(_can_frame_t * frame_p, uint32_t seq)
+{
+    memset(frame_p, 0, sizeof(_can_frame_t));
+    frame_p->std_id = seq & 0x7FFU;
+    frame_p->dlc = 8;
+    for (uint8_t i = 0; i < 8; i++)
+        frame_p->data[i] = (uint8_t)(seq + i);
+}
+
+static bool _frame_is(const _can_frame_t * frame_p, uint32_t seq)
+{
+    _can_frame_t _want;
+    _frame_make(&_want, seq);
+    return (frame_p->std_id == _want.std_id) && (frame_p->dlc == _want.dlc) &&
+        (memcmp(frame_p->data, _want.data, 8) == 0);
+}
+
+/**
+ * Push and pop in steps of 1..3 frames so the indexes
+ * pass the end of the ring many times at every offset,
+ * nothing is lost or reordered.
+ */
+static void test_wrap(void)
+{
+    _can_frame_t _frame;
+    uint32_t _in = 0, _out = 0;
+
+    can_ring_init(&ring);
+    for (uint32_t round = 0; round < 100; round++) {
+        uint32_t _n = round % 3 + 1;
+        for (uint32_t i = 0; i < _n; i++) {
+            _frame_make(&_frame, _in++);
+            CHECK(can_ring_push(&ring, &_frame), "push %u", _in - 1);
+        }
+        CHECK(can_ring_depth(&ring) == _in - _out, "depth %u", can_ring_depth(&ring));
+        while (can_ring_pop(&ring, &_frame)) {
+            CHECK(_frame_is(&_frame, _out), "frame %u out of order", _out);
+            _out++;
+        }
+    }
+    CHECK(_in == _out, "%u in %u out", _in, _out);
+    CHECK(ring.drops == 0, "drops %u", ring.drops);
+    CHECK(ring.depth_max == 3, "depth_max %u", ring.depth_max);
+}
+
+/**
+ * One slot stays free, so a ring of CAN_RING_NUM slots
+ * holds CAN_RING_NUM - 1 frames, later frames are
+ * dropped and counted, the queued ones stay intact.
+ */
+static void test_full(void)
+{
+    _can_frame_t _frame;
+    uint32_t _seq = 0;
+
+    can_ring_init(&ring);
+    /*Start off slot 0 so the full ring spans the wrap*/
+    for (uint32_t i = 0; i < 5; i++) {
+        _frame_make(&_frame, 0);
+        can_ring_push(&ring, &_frame);
+        can_ring_pop(&ring, &_frame);
+    }
+
+    for (uint32_t i = 0; i < CAN_RING_NUM - 1; i++) {
+        _frame_make(&_frame, _seq++);
+        CHECK(can_ring_push(&ring, &_frame), "push %u", i);
+    }
+    CHECK(can_ring_depth(&ring) == CAN_RING_NUM - 1, "depth %u", can_ring_depth(&ring));
+
+    for (uint32_t i = 0; i < 4; i++) {
+        _frame_make(&_frame, 1000 + i);
+        CHECK(!can_ring_push(&ring, &_frame), "push into a full ring");
+    }
+    CHECK(ring.drops == 4, "drops %u", ring.drops);
+    CHECK(ring.depth_max == CAN_RING_NUM - 1, "depth_max %u", ring.depth_max);
+
+    /*One pop frees one slot, and only one*/
+    CHECK(can_ring_pop(&ring, &_frame) && _frame_is(&_frame, 0), "oldest frame");
+    _frame_make(&_frame, _seq++);
+    CHECK(can_ring_push(&ring, &_frame), "push after a pop");
+    CHECK(!can_ring_push(&ring, &_frame), "push into a full ring");
+    CHECK(ring.drops == 5, "drops %u", ring.drops);
+
+    for (uint32_t i = 1; i < _seq; i++)
+        CHECK(can_ring_pop(&ring, &_frame) && _frame_is(&_frame, i), "frame %u", i);
+    CHECK(!can_ring_pop(&ring, &_frame), "pop from an empty ring");
+    CHECK(can_ring_depth(&ring) == 0, "depth %u", can_ring_depth(&ring));
+}
+
+/**
+ * depth_max keeps the deepest fill after the ring
+ * drains, init clears it with the drop count.
+ */
+static void test_depth_max(void)
+{
+    _can_frame_t _frame;
+
+    can_ring_init(&ring);
+    for (uint32_t i = 0; i < 7; i++) {
+        _frame_make(&_frame, i);
+        can_ring_push(&ring, &_frame);
+    }
+    while (can_ring_pop(&ring, &_frame));
+    _frame_make(&_frame, 0);
+    can_ring_push(&ring, &_frame);
+    CHECK(can_ring_depth(&ring) == 1, "depth %u", can_ring_depth(&ring));
+    CHECK(ring.depth_max == 7, "depth_max %u", ring.depth_max);
+
+    can_ring_init(&ring);
+    CHECK(ring.depth_max == 0 && ring.drops == 0, "init keeps counters");
+    CHECK(!can_ring_pop(&ring, &_frame), "pop after init");
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(void)
+{
+    test_wrap();
+    test_full();
+    test_depth_max();
+    return TEST_END();
+}
@@ -0,0 +1,136 @@
+/**
+ * @file test_cascade.c
+ *
+ * Disturbance rejection of the position controllers on the
+ * simulated axis: DCE against the cascade (P position loop
+ * into the PI speed loop) at default gains and with a stiffer
+ * speed loop, holding position under an 800mA load step. The
+ * peak error and the recovery time are compared, and each
+ * controller must still make a clean point-to-point move.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "plant.h"
+#include <math.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define P Move_Pulse_NUM
+#define M_AXIS 2e-5 /*mA per pulse/s^2*/
+#define STEP 800 /*Load step (mA)*/
+#define BAND 50 /*Recovered within 0.35 degrees*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef enum {
+    Ctrl_DCE = 0,
+    Ctrl_Casc,
+    Ctrl_Casc_Stiff,
+} _ctrl_t;
+
+typedef struct {
+    double peak; /*Largest position error (pulse)*/
+    double recover_ms; /*Until the error stays within BAND*/
+} _reject_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static const char * _name[] = {"DCE", "cascade", "cascade, stiff"};
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static void _start(_ctrl_t _ctrl)
+{
+    plant_init(M_AXIS, 0, 0);
+    plant.fric = 10;
+    if (_ctrl != Ctrl_DCE) Control_Cascade_SetEnable(true);
+    if (_ctrl == Ctrl_Casc_Stiff) {
+        Control_Cascade_SetKP(300);
+        Control_PID_SetKP(40);
+        Control_PID_SetKI(300);
+    }
+    plant_mode(Motor_Mode_Digital_Location);
+    Motor_Control_Write_Goal_Location(0);
+    plant_run(CONTROL_FREQ_HZ / 5);
+}
+
+static void _load_step(_reject_t * rj_p)
+{
+    uint32_t _last_out = 0;
+
+    rj_p->peak = 0;
+    plant.load = STEP;
+    for (uint32_t i = 0; i < CONTROL_FREQ_HZ; i++) {
+        plant_run(1);
+        double _e = fabs(plant.pos);
+        if (_e > rj_p->peak) rj_p->peak = _e;
+        if (_e >= BAND) _last_out = i + 1;
+    }
+    rj_p->recover_ms = _last_out * 1e3 / CONTROL_FREQ_HZ;
+}
+
+static void test_reject(void)
+{
+    _reject_t _rj[3];
+
+    for (uint8_t c = Ctrl_DCE; c <= Ctrl_Casc_Stiff; c++) {
+        _start((_ctrl_t)c);
+        _load_step(&_rj[c]);
+        printf("%s: peak %.0f, recovered in %.1fms\n", _name[c], _rj[c].peak, _rj[c].recover_ms);
+        CHECK(fabs(plant.pos) < BAND, "%s not recovered, %.0f", _name[c], plant.pos);
+        CHECK(abs(motor_control.foc_current - STEP) < 20,
+            "%s holds %dmA", _name[c], motor_control.foc_current);
+    }
+    CHECK(_rj[Ctrl_Casc].peak < 0.6 * _rj[Ctrl_DCE].peak,
+        "cascade peak %.0f, DCE %.0f", _rj[Ctrl_Casc].peak, _rj[Ctrl_DCE].peak);
+    CHECK(_rj[Ctrl_Casc_Stiff].peak < 0.2 * _rj[Ctrl_Casc].peak,
+        "stiff cascade peak %.0f, default %.0f", _rj[Ctrl_Casc_Stiff].peak, _rj[Ctrl_Casc].peak);
+    CHECK(_rj[Ctrl_Casc_Stiff].recover_ms < _rj[Ctrl_DCE].recover_ms,
+        "stiff cascade recovers in %.1fms, DCE %.1fms",
+        _rj[Ctrl_Casc_Stiff].recover_ms, _rj[Ctrl_DCE].recover_ms);
+}
+
+/**
+ * Both controllers follow a 5 turn trapezoid and settle on
+ * the goal without a large overshoot.
+ */
+static void test_move(void)
+{
+    for (uint8_t c = Ctrl_DCE; c <= Ctrl_Casc_Stiff; c++) {
+        double _over = 0;
+
+        _start((_ctrl_t)c);
+        Motor_Control_Write_Goal_Location(5 * P);
+        for (uint32_t i = 0; i < CONTROL_FREQ_HZ * 3 / 2; i++) {
+            plant_run(1);
+            if (plant.pos - 5 * P > _over) _over = plant.pos - 5 * P;
+        }
+        printf("%s move: overshoot %.0f, final %.0f\n", _name[c], _over, plant.pos - 5 * P);
+        CHECK(_over < 200, "%s overshoot %.0f", _name[c], _over);
+        CHECK(fabs(plant.pos - 5 * P) < 20, "%s final error %.0f", _name[c], plant.pos - 5 * P);
+        CHECK(motor_control.state == Control_State_Finish, "%s state %u", _name[c], motor_control.state);
+    }
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(void)
+{
+    test_reject();
+    test_move();
+    return TEST_END();
+}
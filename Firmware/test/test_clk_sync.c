@@ -0,0 +1,232 @@
+/**
+ * @file test_clk_sync.c
+ *
+ * Control tick clock servo against a simulated TIM2 running from
+ * a crystal off by up to 100ppm. The master's time stamps reach
+ * the node after the frame time plus the receive jitter, the lock
+ * time, the phase error of the ticks (to the master's time less the
+ * mean latency) and the settled period trim are checked.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "clk_sync.h"
+#include "tim.h"
+#include "can.h"
+#include <math.h>
+#include <string.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define FRAME_NS 100000 /*Time stamp frame at 1Mbit/s and the receive interrupt*/
+#define MASTER_US 123456789U /*Master time at power-up of the node*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    int32_t ppm; /*Crystal of the node*/
+    uint32_t stamp_ms; /*Time stamp period*/
+    uint32_t jitter_us; /*Receive latency spread 0..jitter_us*/
+    uint32_t run_s;
+    /*Results*/
+    double lock_s;
+    double rms_us; /*Tick phase error, last half of the run*/
+    double max_us;
+    double trim_ppm; /*Mean integral of the servo, last half of the run*/
+} _sim_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static uint32_t rand_seed = 1;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static uint32_t _rand(void)
+{
+    rand_seed = rand_seed * 1103515245U + 12345U;
+    return rand_seed >> 8;
+}
+
+static void _clk_reset(void)
+{
+    memset(&clk_sync, 0, sizeof(clk_sync));
+    clk_sync.arr_run = CONTROL_PERIOD_US - 1;
+    clk_sync.arr_next = CONTROL_PERIOD_US - 1;
+    htim2.Instance->ARR = CONTROL_PERIOD_US - 1;
+    htim2.Instance->CNT = 0;
+    htim2.Instance->SR = 0;
+}
+
+/**
+ * Local microseconds of the node counted in a true
+ * time span (ns).
+ */
+static uint32_t _local_us(const _sim_t * sim_p, double _ns)
+{
+    return (uint32_t)floor(_ns * (1.0 + sim_p->ppm * 1e-6) / 1000.0);
+}
+
+/**
+ * Run the node against the master. The true time is the
+ * master's time less MASTER_US, the node follows the master
+ * with the frame time, so its ticks ideally fall at
+ * time_us - MASTER_US + FRAME_NS.
+ */
+static void _sim_run(_sim_t * sim_p)
+{
+    double _t_upd = 0; /*True time of the last update (ns)*/
+    double _len = CONTROL_PERIOD_US * 1000.0 / (1.0 + sim_p->ppm * 1e-6);
+    uint64_t _stamp = 1;
+    double _t_rx = -1;
+    double _sum = 0, _integ = 0;
+    uint32_t _n = 0;
+    double _end = sim_p->run_s * 1e9;
+    /*Mean latency of the time stamps*/
+    double _lag = FRAME_NS + sim_p->jitter_us * 500.0;
+
+    _clk_reset();
+    sim_p->lock_s = -1;
+    sim_p->max_us = 0;
+
+    while (_t_upd < _end) {
+        double _t_next = _t_upd + _len;
+        if (_t_rx < 0) {
+            _t_rx = _stamp * sim_p->stamp_ms * 1e6 + FRAME_NS +
+                (sim_p->jitter_us ? (_rand() % (sim_p->jitter_us * 1000)) : 0);
+        }
+
+        /*A time stamp received just after the update may be
+        served before the tick interrupt, the update is then
+        pending*/
+        bool _pending = (_t_rx >= _t_next) && (_t_rx < _t_next + 2000) &&
+            (_rand() & 1);
+        if ((_t_rx < _t_next) || _pending) {
+            uint32_t _master = MASTER_US + (uint32_t)(_stamp * sim_p->stamp_ms * 1000);
+            uint8_t _data[4] = {
+                (uint8_t)_master, (uint8_t)(_master >> 8),
+                (uint8_t)(_master >> 16), (uint8_t)(_master >> 24),
+            };
+            if (_pending) {
+                htim2.Instance->SR = TIM_FLAG_UPDATE;
+                htim2.Instance->CNT = _local_us(sim_p, _t_rx - _t_next);
+            } else {
+                htim2.Instance->SR = 0;
+                htim2.Instance->CNT = _local_us(sim_p, _t_rx - _t_upd);
+            }
+            clk_sync_rx(_data);
+            _stamp++;
+            _t_rx = -1;
+            continue;
+        }
+
+        /*Update event, the period preloaded by the previous
+        tick starts*/
+        _t_upd = _t_next;
+        _len = (htim2.Instance->ARR + 1) * 1000.0 / (1.0 + sim_p->ppm * 1e-6);
+        htim2.Instance->SR = 0;
+        clk_sync_tick_work();
+
+        if ((sim_p->lock_s < 0) && (clk_sync.state == CLK_STATE_LOCKED))
+            sim_p->lock_s = _t_upd * 1e-9;
+
+        double _err = ((double)(uint32_t)(clk_sync.time_us - MASTER_US) * 1000.0 +
+            _lag - _t_upd) / 1000.0;
+        if (_t_upd > _end / 2) {
+            _sum += _err * _err;
+            _integ += clk_sync.integ;
+            _n++;
+            if (fabs(_err) > sim_p->max_us) sim_p->max_us = fabs(_err);
+        }
+    }
+    sim_p->rms_us = sqrt(_sum / _n);
+    sim_p->trim_ppm = _integ / _n * 1e6 / 65536.0 / CONTROL_PERIOD_US;
+}
+
+/**
+ * Lock time, phase error and trim at +-100ppm and
+ * a few time stamp periods and receive jitters.
+ */
+static void test_lock(void)
+{
+    static const struct {
+        int32_t ppm;
+        uint32_t stamp_ms, jitter_us;
+        double lock_s, rms_us, max_us;
+    } cases[] = {
+        /*The TIM2 counter has a 1us step*/
+        {+100, 1, 0, 0.05, 1.5, 2.5},
+        {-100, 1, 0, 0.05, 1.5, 2.5},
+        {+100, 10, 0, 0.2, 1.5, 2.5},
+        {-100, 10, 0, 0.2, 1.5, 2.5},
+        {+100, 10, 30, 0.2, 6.0, 20.0},
+        {-100, 10, 30, 0.2, 6.0, 20.0},
+        {+100, 100, 0, 2.0, 1.5, 2.5},
+        {-100, 100, 0, 2.0, 1.5, 2.5},
+    };
+
+    for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        _sim_t _sim = {
+            .ppm = cases[i].ppm, .stamp_ms = cases[i].stamp_ms,
+            .jitter_us = cases[i].jitter_us, .run_s = 40,
+        };
+        _sim_run(&_sim);
+        printf("%+dppm %ums %uus: lock %.3fs, rms %.2fus, max %.2fus, trim %+.1fppm, steps %u\n",
+            _sim.ppm, _sim.stamp_ms, _sim.jitter_us, _sim.lock_s, _sim.rms_us,
+            _sim.max_us, _sim.trim_ppm, clk_sync.steps);
+
+        CHECK((_sim.lock_s >= 0) && (_sim.lock_s <= cases[i].lock_s),
+            "case %u: lock %.3fs", i, _sim.lock_s);
+        CHECK(_sim.rms_us <= cases[i].rms_us, "case %u: rms %.2fus", i, _sim.rms_us);
+        CHECK(_sim.max_us <= cases[i].max_us, "case %u: max %.2fus", i, _sim.max_us);
+        CHECK(fabs(_sim.trim_ppm - _sim.ppm) < 10, "case %u: trim %.1fppm", i, _sim.trim_ppm);
+        CHECK(clk_sync.state == CLK_STATE_LOCKED, "case %u: state %u", i, clk_sync.state);
+        CHECK(clk_sync.steps == 1, "case %u: %u steps", i, clk_sync.steps);
+    }
+}
+
+/**
+ * The master broadcasts the time of the tick at the
+ * period set, and does not follow time stamps itself.
+ */
+static void test_master(void)
+{
+    _clk_reset();
+    clk_sync_set_master(10);
+    can_sent_num = 0;
+
+    for (uint32_t i = 0; i < 10 * 200; i++)
+        clk_sync_tick_work();
+    CHECK(can_sent_num == 10, "%u time stamps", can_sent_num);
+    CHECK(can_sent_header.StdId == CLK_CMD && can_sent_header.DLC == 4, "header");
+
+    uint32_t _t = can_sent_data[0] | (can_sent_data[1] << 8) |
+        (can_sent_data[2] << 16) | ((uint32_t)can_sent_data[3] << 24);
+    CHECK(_t == clk_sync.time_us, "time %u, clock %u", _t, clk_sync.time_us);
+
+    uint8_t _data[4] = {0x00, 0x10, 0x00, 0x00};
+    clk_sync_rx(_data);
+    CHECK(clk_sync.state == CLK_STATE_FREE && clk_sync.steps == 0, "master followed");
+    clk_sync_set_master(0);
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(void)
+{
+    test_lock();
+    test_master();
+    return TEST_END();
+}
@@ -0,0 +1,215 @@
+/**
+ * @file test_dce_tune.c
+ *
+ * DCE autotune on simulated axes from a light bare rotor to a
+ * heavy load with friction: the relay experiment must recover
+ * the inertia and friction, and the designed gains must reject
+ * a load step as the pole placement predicts on every axis,
+ * with a bounded overshoot and settling on a position step.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "plant.h"
+#include "dce_tune.h"
+#include "inertia_est.h"
+#include "setup.h"
+#include <math.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define P Move_Pulse_NUM
+#define RELAY 300 /*Relay current (mA)*/
+#define BW 20 /*Target bandwidth (Hz)*/
+#define STEP_POS 400 /*Small position step, inside the error clamp (pulse)*/
+#define LOAD_STEP 100 /*Load step (mA)*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+extern _dce_tune_t dce_tune;
+
+typedef struct {
+    double m;
+    double fric;
+    double visc;
+} _axis_t;
+
+typedef struct {
+    double settle_ms; /*Step within 2%*/
+    double overshoot; /*Of the step*/
+    double load_peak; /*Peak error under LOAD_STEP (pulse)*/
+} _resp_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static const _axis_t _axis[] = {
+    {1e-5, 10, 0},      /*Bare rotor*/
+    {2e-5, 30, 5e-5},
+    {5e-5, 20, 2e-4},   /*Belt and carriage*/
+    {1.5e-4, 60, 1e-4}, /*Heavy load*/
+};
+
+static uint32_t _saved;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * The setup is not stored on the host.
+ */
+void operate_file(uint8_t operate)
+{
+    (void)operate;
+    _saved++;
+}
+
+/**
+ * Main loop part, once after every tick.
+ */
+static void _run(uint32_t _ticks)
+{
+    for (uint32_t i = 0; i < _ticks; i++) {
+        plant_run(1);
+        dce_tune_solve();
+    }
+}
+
+static bool _tune(const _axis_t * ax_p)
+{
+    plant_init(ax_p->m, 0, 0);
+    plant.fric = ax_p->fric;
+    plant.visc = ax_p->visc;
+    plant.tick_hook = dce_tune_tick_work;
+    plant_mode(Motor_Mode_Digital_Location);
+    Motor_Control_Write_Goal_Location(0);
+    _run(CONTROL_FREQ_HZ / 5);
+
+    _saved = 0;
+    if (!dce_tune_start(RELAY, BW)) return false;
+    for (uint32_t i = 0; (i < 2 * TUNE_RUN_TICK) && dce_tune._start; i++)
+        _run(1);
+    return dce_tune.state == TUNE_STATE_DONE;
+}
+
+/**
+ * Step response and load step with the tuned gains.
+ */
+static void _response(_resp_t * rs_p)
+{
+    double _p0;
+    uint32_t _last_out = 0;
+
+    plant.tick_hook = NULL;
+    _run(CONTROL_FREQ_HZ / 2); /*Back home after the relay*/
+    _p0 = plant.pos;
+
+    rs_p->overshoot = 0;
+    Motor_Control_Write_Goal_Location((int32_t)lround(_p0) + STEP_POS);
+    /*The step goes through the tracker at the rated acceleration,
+    some 0.5ms, the settling is dominated by the loop*/
+    for (uint32_t i = 0; i < CONTROL_FREQ_HZ / 2; i++) {
+        _run(1);
+        double _x = (plant.pos - _p0) / STEP_POS;
+        if (_x - 1.0 > rs_p->overshoot) rs_p->overshoot = _x - 1.0;
+        if (fabs(_x - 1.0) > 0.02) _last_out = i + 1;
+    }
+    rs_p->settle_ms = _last_out * 1e3 / CONTROL_FREQ_HZ;
+
+    _p0 = plant.pos;
+    rs_p->load_peak = 0;
+    plant.load = LOAD_STEP;
+    for (uint32_t i = 0; i < CONTROL_FREQ_HZ / 2; i++) {
+        _run(1);
+        if (fabs(plant.pos - _p0) > rs_p->load_peak) rs_p->load_peak = fabs(plant.pos - _p0);
+    }
+    plant.load = 0;
+}
+
+static void test_axes(void)
+{
+    for (uint8_t k = 0; k < sizeof(_axis) / sizeof(_axis[0]); k++) {
+        const _axis_t * ax_p = &_axis[k];
+        _resp_t _rs;
+
+        bool _done = _tune(ax_p);
+        printf("m %.1e: state %u, m %.2e (%+.1f%%), f %.1f of %.0f, b %.1e of %.1e\n",
+            ax_p->m, dce_tune.state, dce_tune.inertia,
+            100.0 * (dce_tune.inertia / ax_p->m - 1.0),
+            dce_tune.friction, ax_p->fric, dce_tune.viscous, ax_p->visc);
+        CHECK(_done, "m %.1e autotune state %u", ax_p->m, dce_tune.state);
+        if (!_done) continue;
+
+        CHECK(fabs(dce_tune.inertia / ax_p->m - 1.0) < 0.15,
+            "m %.1e estimated %.2e", ax_p->m, dce_tune.inertia);
+        CHECK(fabs(dce_tune.friction - ax_p->fric) < 0.3 * ax_p->fric + 5,
+            "m %.1e friction %.1f", ax_p->m, dce_tune.friction);
+        CHECK(fabs(dce_tune.viscous - ax_p->visc) < 0.3 * ax_p->visc + 3e-5,
+            "m %.1e viscous %.1e", ax_p->m, dce_tune.viscous);
+        CHECK(_saved == 1, "setup saved %u times", _saved);
+        CHECK(_setup.dce_kp == dce.kp && _setup.dce_kd == dce.kd && _setup.dce_ki == dce.ki,
+            "gains not in the setup");
+        CHECK(_setup.inertia_ref == (int32_t)(dce_tune.inertia * EST_INERTIA_SCALE),
+            "reference inertia %d", _setup.inertia_ref);
+
+        _response(&_rs);
+        /*Three poles at -wc, a load step D peaks at 2e^-2 D / (m wc^2)*/
+        double wc = 2.0 * M_PI * BW;
+        double _peak = 2.0 * exp(-2.0) * LOAD_STEP / (ax_p->m * wc * wc);
+        printf("  kp %d kd %d ki %d: settle %.1fms, overshoot %.1f%%, load peak %.0f (%.0f)\n",
+            dce.kp, dce.kd, dce.ki, _rs.settle_ms, 100.0 * _rs.overshoot, _rs.load_peak, _peak);
+        CHECK(fabs(_rs.load_peak / _peak - 1.0) < 0.25,
+            "m %.1e load peak %.0f, designed %.0f", ax_p->m, _rs.load_peak, _peak);
+        /*The zeros of the design overshoot by about 20% on a pure step*/
+        CHECK(_rs.overshoot < 0.25, "m %.1e overshoot %.1f%%", ax_p->m, 100.0 * _rs.overshoot);
+        CHECK(_rs.settle_ms < 100, "m %.1e settles in %.1fms", ax_p->m, _rs.settle_ms);
+    }
+}
+
+/**
+ * An axis pushed by a load the relay cannot hold runs away
+ * and the autotune aborts, the gains are left alone.
+ */
+static void test_abort(void)
+{
+    const _axis_t _ax = {2e-5, 10, 0};
+
+    plant_init(_ax.m, 0, 0);
+    plant.fric = _ax.fric;
+    plant.tick_hook = dce_tune_tick_work;
+    plant_mode(Motor_Mode_Digital_Location);
+    Motor_Control_Write_Goal_Location(0);
+    _run(CONTROL_FREQ_HZ / 5);
+
+    int32_t _kp = dce.kp;
+    _saved = 0;
+    CHECK(dce_tune_start(RELAY, BW), "not started");
+    plant.load = 2 * RELAY;
+    for (uint32_t i = 0; (i < 2 * TUNE_RUN_TICK) && dce_tune._start; i++)
+        _run(1);
+    _run(1); /*The mode order is applied by the next tick*/
+    CHECK(dce_tune.state == TUNE_STATE_ABORT, "state %u", dce_tune.state);
+    CHECK(dce.kp == _kp, "gains changed on abort");
+    CHECK(_saved == 0, "setup saved on abort");
+    CHECK(motor_control.mode_run == Motor_Mode_Digital_Location, "mode %u", motor_control.mode_run);
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(void)
+{
+    test_axes();
+    test_abort();
+    return TEST_END();
+}
@@ -0,0 +1,248 @@
+/**
+ * @file test_inertia_est.c
+ *
+ * Online inertia estimate on the simulated axis: it follows the
+ * inertia stepping 1x, 3x and back to 1x under repeated moves,
+ * the scheduled gain follows within its clamp, the estimate
+ * pauses while the output sleeps, and the 64 bit normal
+ * equations hold at full current and the largest regressor.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "plant.h"
+#include "inertia_est.h"
+#include <math.h>
+#include <string.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define P Move_Pulse_NUM
+#define M_AXIS 2e-5 /*mA per pulse/s^2*/
+#define FRIC 20 /*Coulomb friction (mA)*/
+#define MOVE_TICK (CONTROL_FREQ_HZ * 3 / 10) /*One turn and a dwell, 0.3s*/
+#define PHASE_S 10 /*Seconds at each inertia*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+extern _inertia_est_t inertia_est;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static bool move_far = false;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Hold at 0 in position mode, DCE with the default gains.
+ */
+static void _start(void)
+{
+    plant_init(M_AXIS, 0, 0);
+    plant.fric = FRIC;
+    plant_mode(Motor_Mode_Digital_Location);
+    Motor_Control_Write_Goal_Location(0);
+    move_far = false;
+    plant_run(CONTROL_FREQ_HZ / 10);
+}
+
+/**
+ * Move one turn back and forth, 100r/s^2 from plant_init().
+ * @param _s Seconds of moving.
+ */
+static void _cycle(uint32_t _s)
+{
+    for (uint32_t i = 0; i < _s * CONTROL_FREQ_HZ / MOVE_TICK; i++) {
+        move_far = !move_far;
+        Motor_Control_Write_Goal_Location(move_far ? P : 0);
+        plant_run(MOVE_TICK);
+    }
+}
+
+/**
+ * @return Estimated over true inertia.
+ */
+static double _ratio(void)
+{
+    return inertia_est.inertia / (plant.m * EST_INERTIA_SCALE);
+}
+
+/**
+ * The estimate follows a 3x step of the inertia and back.
+ */
+static void test_track(void)
+{
+    static const double _mul[] = {1.0, 3.0, 1.0};
+
+    _start();
+    for (uint8_t k = 0; k < sizeof(_mul) / sizeof(_mul[0]); k++) {
+        plant.m = M_AXIS * _mul[k];
+        _cycle(PHASE_S);
+        printf("%.0fx: estimate %.3f of the true inertia, friction %dmA\n",
+            _mul[k], _ratio(), inertia_est.friction);
+        CHECK(inertia_est.valid, "%.0fx no estimate", _mul[k]);
+        CHECK(fabs(_ratio() - 1.0) < 0.1, "%.0fx estimate %.3f", _mul[k], _ratio());
+        CHECK(abs(inertia_est.friction - FRIC) < FRIC / 2,
+            "%.0fx friction %dmA", _mul[k], inertia_est.friction);
+    }
+}
+
+/**
+ * The scheduled gain follows inertia / inertia_ref within
+ * EST_GAIN_MIN..EST_GAIN_MAX, 1.0 with the scheduling off.
+ * @param _ref Reference over the starting inertia.
+ */
+static void _gain_run(double _ref)
+{
+    static const double _mul[] = {1.0, 3.0, 1.0};
+
+    _start();
+    inertia_est_set_ref((int32_t)(M_AXIS * _ref * EST_INERTIA_SCALE));
+    inertia_est_set_sched(true);
+    for (uint8_t k = 0; k < sizeof(_mul) / sizeof(_mul[0]); k++) {
+        plant.m = M_AXIS * _mul[k];
+        _cycle(PHASE_S);
+
+        double _want = 1024.0 * _mul[k] / _ref;
+        if (_want < EST_GAIN_MIN) _want = EST_GAIN_MIN;
+        if (_want > EST_GAIN_MAX) _want = EST_GAIN_MAX;
+        printf("reference %.1fx, %.0fx: gain %u, expected %.0f\n",
+            _ref, _mul[k], inertia_est.gain, _want);
+        CHECK(fabs(inertia_est.gain - _want) < _want * 0.1,
+            "ref %.1fx %.0fx gain %u", _ref, _mul[k], inertia_est.gain);
+        CHECK(inertia_est.gain >= EST_GAIN_MIN && inertia_est.gain <= EST_GAIN_MAX,
+            "gain %u out of range", inertia_est.gain);
+        CHECK(inertia_est_gain() == inertia_est.gain, "gain not applied");
+    }
+
+    inertia_est_set_sched(false);
+    CHECK(inertia_est_gain() == 1024, "gain %d with the scheduling off",
+        (int)inertia_est_gain());
+}
+
+static void test_gain(void)
+{
+    _gain_run(1.0);
+    _gain_run(0.5); /*3x clamps at EST_GAIN_MAX*/
+    _gain_run(4.0); /*1x clamps at EST_GAIN_MIN*/
+}
+
+/**
+ * Asleep the current reads 0 while the axis coasts, the
+ * estimate must hold and pick up again after enabling.
+ */
+static void test_pause(void)
+{
+    _start();
+    _cycle(PHASE_S / 2);
+    Motor_Control_Write_Goal_Location(P);
+
+    Motor_Control_Write_Goal_Disable(1);
+    plant_run(CONTROL_FREQ_HZ / 2);
+    CHECK(!Motor_Control_OutputRunning(), "output running after disable");
+
+    _inertia_est_t _held = inertia_est;
+    double _p0 = plant.pos;
+    /*Pulled around with no current, a running estimate
+    would read it as an infinite inertia*/
+    plant.load = 40;
+    plant_run(CONTROL_FREQ_HZ);
+    printf("asleep: moved %.0f pulse, estimate %.3f\n",
+        fabs(plant.pos - _p0), _ratio());
+    CHECK(fabs(plant.pos - _p0) > P / 4, "axis did not move, %.0f",
+        fabs(plant.pos - _p0));
+    CHECK(_held.r11 == inertia_est.r11 && _held.q1 == inertia_est.q1 &&
+        _held.r22 == inertia_est.r22 && _held.q2 == inertia_est.q2,
+        "normal equations changed while asleep");
+    CHECK(_held.inertia == inertia_est.inertia && _held.gain == inertia_est.gain,
+        "estimate changed while asleep");
+    CHECK(inertia_est.seg_tick == 0 && !inertia_est.dth_valid,
+        "segment kept while asleep");
+
+    plant.load = 0;
+    plant.vel = 0;
+    Motor_Control_Write_Goal_Disable(0);
+    plant_run(CONTROL_FREQ_HZ / 10);
+    Motor_Control_Write_Goal_Location((int32_t)plant.pos);
+    plant_run(CONTROL_FREQ_HZ / 10);
+    CHECK(Motor_Control_OutputRunning(), "output not running after enable");
+    _cycle(1);
+    CHECK(_held.r11 != inertia_est.r11, "estimate not resumed");
+    CHECK(fabs(_ratio() - 1.0) < 0.1, "estimate %.3f after enable", _ratio());
+}
+
+/**
+ * Feed the estimator directly with the worst case: rated
+ * current 3000mA reversed every 4 segments on an inertia that
+ * puts the position second difference at the 8191 clamp, long
+ * enough (8s) for the weighted sums to reach their steady state.
+ */
+static void test_range(void)
+{
+    const int32_t _cur = 3000;
+    const double _m = _cur * 2.5e-5 / 8000.0; /*d2 = a * T^2 = 8000*/
+    double _pos = 0, _vel = 0;
+    __int128 _prod = 0;
+
+    _start();
+    memset(&inertia_est, 0, sizeof(inertia_est));
+    inertia_est.gain = 1024;
+    for (uint32_t i = 0; i < 8 * CONTROL_FREQ_HZ; i++) {
+        CHECK(Motor_Control_OutputRunning(), "output asleep");
+
+        int32_t _i = ((i / (4 * EST_SEG_TICK)) & 1) ? -_cur : _cur;
+        double _a = _i / _m;
+
+        _pos += _vel / CONTROL_FREQ_HZ + _a / (2.0 * CONTROL_FREQ_HZ * CONTROL_FREQ_HZ);
+        _vel += _a / CONTROL_FREQ_HZ;
+        motor_control.foc_current = _i;
+        motor_control.est_location = (int32_t)lround(_pos);
+        motor_control.est_speed = (int32_t)lround(_vel);
+        inertia_est_tick_work();
+
+        __int128 _p[] = {
+            (__int128)inertia_est.r11 * inertia_est.r22,
+            (__int128)inertia_est.r22 * inertia_est.q1,
+            (__int128)inertia_est.r12 * inertia_est.q2,
+            (__int128)inertia_est.r11 * inertia_est.q2,
+            (__int128)inertia_est.r12 * inertia_est.q1,
+        };
+        for (uint8_t k = 0; k < sizeof(_p) / sizeof(_p[0]); k++) {
+            if (_p[k] < 0) _p[k] = -_p[k];
+            if (_p[k] > _prod) _prod = _p[k];
+        }
+    }
+
+    double _ratio_m = inertia_est.inertia / (_m * EST_INERTIA_SCALE);
+    printf("full range: estimate %.3f, largest product 2^%.1f\n",
+        _ratio_m, log2((double)_prod));
+    CHECK(inertia_est.valid, "no estimate at full range");
+    CHECK(fabs(_ratio_m - 1.0) < 0.05, "estimate %.3f at full range", _ratio_m);
+    CHECK(inertia_est.r11 > 0 && inertia_est.r22 > 0, "normal equations wrapped");
+    CHECK(_prod < ((__int128)1 << 62), "product 2^%.1f near the 64 bit limit",
+        log2((double)_prod));
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(void)
+{
+    test_track();
+    test_gain();
+    test_pause();
+    test_range();
+    return TEST_END();
+}
@@ -0,0 +1,192 @@
+/**
+ * @file test_limits.c
+ *
+ * Software position limits on the simulated axis: targets beyond
+ * the limits in position, track (streamed setpoints) and speed
+ * mode. Each mode must plan its deceleration and stop at the
+ * limit, not clip the setpoint and run into it.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "plant.h"
+#include <math.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define P Move_Pulse_NUM
+#define LIM_MIN (-2 * P)
+#define LIM_MAX (3 * P)
+#define M_AXIS 1e-5 /*mA per pulse/s^2, rotor and a small load*/
+#define STOP_TOL 60 /*Settled within 0.4 degrees*/
+#define OVER_TOL 100 /*Transient overshoot beyond the limit*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    double pos_max;
+    double pos_min;
+    int32_t soft_max;
+    int32_t soft_min;
+} _trace_t;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static void _trace_reset(_trace_t * tr_p)
+{
+    tr_p->pos_max = plant.pos;
+    tr_p->pos_min = plant.pos;
+    tr_p->soft_max = motor_control.soft_location;
+    tr_p->soft_min = motor_control.soft_location;
+}
+
+static void _trace_run(_trace_t * tr_p, uint32_t _ticks)
+{
+    for (uint32_t i = 0; i < _ticks; i++) {
+        plant_run(1);
+        if (plant.pos > tr_p->pos_max) tr_p->pos_max = plant.pos;
+        if (plant.pos < tr_p->pos_min) tr_p->pos_min = plant.pos;
+        if (motor_control.soft_location > tr_p->soft_max)
+            tr_p->soft_max = motor_control.soft_location;
+        if (motor_control.soft_location < tr_p->soft_min)
+            tr_p->soft_min = motor_control.soft_location;
+    }
+}
+
+static void _start(Motor_Mode _mode)
+{
+    plant_init(M_AXIS, 0, 0);
+    Motor_Control_SetPosLimit(true, LIM_MIN, LIM_MAX);
+    plant_mode(_mode);
+    plant_run(100);
+}
+
+/**
+ * Position mode, the tracker decelerates at the rated rate
+ * onto the limit and stays there.
+ */
+static void test_location(void)
+{
+    _trace_t _tr;
+
+    _start(Motor_Mode_Digital_Location);
+    _trace_reset(&_tr);
+    Motor_Control_Write_Goal_Location(10 * P);
+    _trace_run(&_tr, 2 * CONTROL_FREQ_HZ);
+
+    printf("location +: stop %.0f, peak %.0f\n", plant.pos - LIM_MAX, _tr.pos_max - LIM_MAX);
+    CHECK(_tr.soft_max <= LIM_MAX, "soft location %d beyond the limit", _tr.soft_max);
+    CHECK(fabs(plant.pos - LIM_MAX) < STOP_TOL, "stopped at %.0f", plant.pos);
+    CHECK(_tr.pos_max < LIM_MAX + OVER_TOL, "peak %.0f", _tr.pos_max);
+    CHECK(fabs(plant.vel) < QStop_Rest_Speed, "still moving %.0f", plant.vel);
+    CHECK(motor_control.state == Control_State_Running,
+        "state %u, the goal is not reached", motor_control.state);
+
+    _trace_reset(&_tr);
+    Motor_Control_Write_Goal_Location(-10 * P);
+    _trace_run(&_tr, 3 * CONTROL_FREQ_HZ);
+
+    printf("location -: stop %.0f, peak %.0f\n", plant.pos - LIM_MIN, _tr.pos_min - LIM_MIN);
+    CHECK(_tr.soft_min >= LIM_MIN, "soft location %d beyond the limit", _tr.soft_min);
+    CHECK(fabs(plant.pos - LIM_MIN) < STOP_TOL, "stopped at %.0f", plant.pos);
+    CHECK(_tr.pos_min > LIM_MIN - OVER_TOL, "peak %.0f", _tr.pos_min);
+
+    /*A target inside the limits is reached as before*/
+    Motor_Control_Write_Goal_Location(P / 2);
+    _trace_run(&_tr, 2 * CONTROL_FREQ_HZ);
+    CHECK(fabs(plant.pos - P / 2) < STOP_TOL, "stopped at %.0f", plant.pos);
+    CHECK(motor_control.state == Control_State_Finish, "state %u", motor_control.state);
+}
+
+/**
+ * Track mode, the host streams a trajectory running through
+ * the limit at 10r/s, the reconstructed motion stops on it.
+ */
+static void test_track(void)
+{
+    _trace_t _tr;
+    int32_t _goal = 0;
+    const int32_t _speed = 10 * P;
+
+    _start(Motor_Mode_Digital_Track);
+    _trace_reset(&_tr);
+    /*Setpoints every 1ms for 1s, 10 turns*/
+    for (uint32_t i = 0; i < 1000; i++) {
+        _goal += _speed / 1000;
+        Motor_Control_Write_Goal_Location(_goal);
+        Motor_Control_Write_Goal_Speed(_speed);
+        _trace_run(&_tr, CONTROL_FREQ_HZ / 1000);
+    }
+    _trace_run(&_tr, CONTROL_FREQ_HZ / 2);
+
+    printf("track +: stop %.0f, peak %.0f\n", plant.pos - LIM_MAX, _tr.pos_max - LIM_MAX);
+    CHECK(_tr.soft_max <= LIM_MAX, "soft location %d beyond the limit", _tr.soft_max);
+    CHECK(fabs(plant.pos - LIM_MAX) < STOP_TOL, "stopped at %.0f", plant.pos);
+    CHECK(_tr.pos_max < LIM_MAX + OVER_TOL, "peak %.0f", _tr.pos_max);
+    CHECK(fabs(plant.vel) < QStop_Rest_Speed, "still moving %.0f", plant.vel);
+
+    /*Back through the lower limit*/
+    _trace_reset(&_tr);
+    for (uint32_t i = 0; i < 1500; i++) {
+        _goal -= _speed / 1000;
+        Motor_Control_Write_Goal_Location(_goal);
+        Motor_Control_Write_Goal_Speed(-_speed);
+        _trace_run(&_tr, CONTROL_FREQ_HZ / 1000);
+    }
+    _trace_run(&_tr, CONTROL_FREQ_HZ / 2);
+
+    printf("track -: stop %.0f, peak %.0f\n", plant.pos - LIM_MIN, _tr.pos_min - LIM_MIN);
+    CHECK(_tr.soft_min >= LIM_MIN, "soft location %d beyond the limit", _tr.soft_min);
+    CHECK(fabs(plant.pos - LIM_MIN) < STOP_TOL, "stopped at %.0f", plant.pos);
+    CHECK(_tr.pos_min > LIM_MIN - OVER_TOL, "peak %.0f", _tr.pos_min);
+}
+
+/**
+ * Speed mode has no soft position, the target speed is held
+ * under the braking envelope of the actual position.
+ */
+static void test_speed(void)
+{
+    _trace_t _tr;
+
+    _start(Motor_Mode_Digital_Speed);
+    _trace_reset(&_tr);
+    Motor_Control_Write_Goal_Speed(20 * P);
+    _trace_run(&_tr, 2 * CONTROL_FREQ_HZ);
+
+    printf("speed +: stop %.0f, peak %.0f\n", plant.pos - LIM_MAX, _tr.pos_max - LIM_MAX);
+    CHECK(_tr.pos_max < LIM_MAX + OVER_TOL, "peak %.0f", _tr.pos_max);
+    CHECK(plant.pos > LIM_MAX - 4 * STOP_TOL, "stopped short at %.0f", plant.pos);
+    CHECK(fabs(plant.vel) < QStop_Rest_Speed, "still moving %.0f", plant.vel);
+
+    /*Away from the limit is allowed, down to the other one*/
+    _trace_reset(&_tr);
+    Motor_Control_Write_Goal_Speed(-20 * P);
+    _trace_run(&_tr, 2 * CONTROL_FREQ_HZ);
+
+    printf("speed -: stop %.0f, peak %.0f\n", plant.pos - LIM_MIN, _tr.pos_min - LIM_MIN);
+    CHECK(_tr.pos_min > LIM_MIN - OVER_TOL, "peak %.0f", _tr.pos_min);
+    CHECK(plant.pos < LIM_MIN + 4 * STOP_TOL, "stopped short at %.0f", plant.pos);
+    CHECK(fabs(plant.vel) < QStop_Rest_Speed, "still moving %.0f", plant.vel);
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(void)
+{
+    test_location();
+    test_track();
+    test_speed();
+    return TEST_END();
+}
@@ -0,0 +1,204 @@
+/**
+ * @file test_load_obs.c
+ *
+ * Load observer on the simulated axis: the estimate follows a
+ * load step, the compensation cuts the peak position error of
+ * DCE and the cascade and the speed dip in speed mode, it stays
+ * stable with the model inertia from 0.7 to 3 times the true
+ * one, and it does nothing without a model inertia.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "plant.h"
+#include "inertia_est.h"
+#include "load_obs.h"
+#include <math.h>
+
+/**********************
+ *  STATIC PROTOTYPES
+ **********************/
+
+extern _inertia_est_t inertia_est;
+extern _load_obs_t load_obs;
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define P Move_Pulse_NUM
+#define M_AXIS 2e-5 /*mA per pulse/s^2*/
+#define STEP 800 /*Load step (mA)*/
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Hold position (or run at _speed in speed mode), the model
+ * inertia as autotune would leave it, _model times the true.
+ */
+static void _start(bool _obs, double _model, bool _casc, int32_t _speed)
+{
+    plant_init(M_AXIS, 0, 0);
+    plant.fric = 10;
+    inertia_est.inertia_ref = (int32_t)(M_AXIS * _model * EST_INERTIA_SCALE);
+    load_obs_set_enable(_obs);
+    Control_Cascade_SetEnable(_casc);
+    if (_speed) {
+        plant_mode(Motor_Mode_Digital_Speed);
+        Motor_Control_Write_Goal_Speed(_speed);
+    }
+    else {
+        plant_mode(Motor_Mode_Digital_Location);
+        Motor_Control_Write_Goal_Location(0);
+    }
+    plant_run(CONTROL_FREQ_HZ / 2);
+}
+
+/**
+ * Apply the load step and follow it for 0.5s.
+ * @return Peak position error (pulse), or the peak speed dip
+ * (pulse/s) in speed mode.
+ */
+static double _step(int32_t _speed)
+{
+    double _peak = 0;
+    double _p0 = plant.pos;
+
+    plant.load = STEP;
+    for (uint32_t i = 0; i < CONTROL_FREQ_HZ / 2; i++) {
+        plant_run(1);
+        double _e = _speed ? (_speed - plant.vel) :
+            fabs(plant.pos - _p0);
+        if (_e > _peak) _peak = _e;
+    }
+    return _peak;
+}
+
+static void test_estimate(void)
+{
+    int32_t _max = 0;
+
+    _start(false, 1.0, false, 0);
+    CHECK(abs(load_obs_read()) < 10, "idle estimate %dmA", load_obs_read());
+    _step(0);
+    printf("estimate %dmA of %dmA\n", load_obs_read(), STEP);
+    CHECK(abs(load_obs_read() - STEP) < STEP / 20, "estimate %dmA", load_obs_read());
+    CHECK(load_obs_comp() == 0, "compensating while disabled");
+
+    /*No model, no compensation, at rest the online
+    estimate is not excited*/
+    _start(true, 0.0, false, 0);
+    CHECK(!load_obs.valid, "model without autotune or estimate");
+    plant.load = STEP / 4;
+    for (uint32_t i = 0; i < CONTROL_FREQ_HZ / 10 && !inertia_est.valid; i++) {
+        plant_run(1);
+        if (abs(load_obs_comp()) > _max) _max = abs(load_obs_comp());
+    }
+    CHECK(_max == 0, "compensating %dmA without a model", _max);
+}
+
+static void test_reject(void)
+{
+    static const char * _name[] = {"DCE", "cascade"};
+
+    for (uint8_t c = 0; c < 2; c++) {
+        _start(false, 1.0, c == 1, 0);
+        double _off = _step(0);
+        _start(true, 1.0, c == 1, 0);
+        double _on = _step(0);
+
+        printf("%s: peak %.0f, with the observer %.0f (%.0f%% less)\n",
+            _name[c], _off, _on, 100.0 * (1.0 - _on / _off));
+        CHECK(_on < 0.75 * _off, "%s peak %.0f, without %.0f", _name[c], _on, _off);
+        CHECK(fabs(plant.pos) < 50, "%s not recovered, %.0f", _name[c], plant.pos);
+        /*The integrators hand the load to the feedforward*/
+        CHECK(abs(motor_control.foc_current - STEP) < 20,
+            "%s holds %dmA", _name[c], motor_control.foc_current);
+    }
+
+    _start(false, 1.0, false, 10 * P);
+    double _off = _step(10 * P);
+    _start(true, 1.0, false, 10 * P);
+    double _on = _step(10 * P);
+    printf("speed mode: dip %.2fr/s, with the observer %.2fr/s\n", _off / P, _on / P);
+    CHECK(_on < 0.75 * _off, "speed dip %.0f, without %.0f", _on, _off);
+    CHECK(fabs(plant.vel - 10 * P) < P / 10, "speed %.0f", plant.vel);
+}
+
+/**
+ * Keeps the online estimate out, the model is the
+ * autotune reference alone.
+ */
+static void _ref_only_hook(void)
+{
+    inertia_est.valid = false;
+}
+
+/**
+ * Hold for 0.1s after the step.
+ * @return Largest position error (pulse).
+ */
+static double _residual(void)
+{
+    double _ring = 0;
+
+    for (uint32_t i = 0; i < CONTROL_FREQ_HZ / 10; i++) {
+        plant_run(1);
+        if (fabs(plant.pos) > _ring) _ring = fabs(plant.pos);
+    }
+    return _ring;
+}
+
+/**
+ * Overestimating the model inertia up to 3x still settles,
+ * below half of it the loop limit-cycles.
+ */
+static void test_mismatch(void)
+{
+    static const double _model[] = {0.4, 0.7, 2.0, 3.0};
+
+    for (uint8_t k = 0; k < sizeof(_model) / sizeof(_model[0]); k++) {
+        _start(true, _model[k], false, 0);
+        plant.tick_hook = _ref_only_hook;
+        double _peak = _step(0);
+        double _ring = _residual();
+
+        printf("model %.1fx: peak %.0f, residual %.0f\n", _model[k], _peak, _ring);
+        if (_model[k] < 0.5) CHECK(_ring > 100, "model %.1fx settles %.0f", _model[k], _ring);
+        else CHECK(_ring < 50, "model %.1fx rings %.0f", _model[k], _ring);
+    }
+}
+
+/**
+ * The larger of the autotune reference and the online estimate
+ * is used, a low reference is lifted once the estimate is valid.
+ */
+static void test_model(void)
+{
+    _start(true, 0.4, false, 0);
+    double _peak = _step(0);
+    double _ring = _residual();
+
+    printf("model 0.4x, online estimate %.2fx: peak %.0f, residual %.0f\n",
+        inertia_est.inertia / (M_AXIS * EST_INERTIA_SCALE), _peak, _ring);
+    CHECK(inertia_est.valid, "no online estimate");
+    CHECK(_ring < 50, "rings %.0f with the online estimate", _ring);
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(void)
+{
+    test_estimate();
+    test_reject();
+    test_mismatch();
+    test_model();
+    return TEST_END();
+}
@@ -0,0 +1,221 @@
+/**
+ * @file test_out_filter.c
+ *
+ * Frequency response of the output filter bank with coefficients
+ * designed on the host (RBJ cookbook, 20kHz) and quantised to Q24
+ * the way CAN 0x1D does: notch depth and passband of a notch, the
+ * -3dB corner and roll-off of a low-pass, the two in series, and
+ * the steady state start after a preload.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "out_filter.h"
+#include <math.h>
+#include <stdlib.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define FS ((double)CONTROL_FREQ_HZ)
+#define AMP 1000 /*Test amplitude, rated current (mA)*/
+#define AMP_DEEP 30000 /*Near the Q8 signal limit, resolves the notch depth*/
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Normalise by a0 and quantise through float as CAN 0x1D does.
+ */
+static void _quantise(int32_t * coef_p, const double * b, const double * a)
+{
+    const double _c[OUT_FILTER_COEF_NUM] = {
+        b[0] / a[0], b[1] / a[0], b[2] / a[0], a[1] / a[0], a[2] / a[0]
+    };
+
+    for (uint8_t i = 0; i < OUT_FILTER_COEF_NUM; i++)
+        coef_p[i] = (int32_t)((float)_c[i] * (float)(1UL << OUT_FILTER_Q));
+}
+
+static void _notch(int32_t * coef_p, double f0, double q)
+{
+    double w = 2.0 * M_PI * f0 / FS;
+    double alpha = sin(w) / (2.0 * q);
+    double b[3] = {1.0, -2.0 * cos(w), 1.0};
+    double a[3] = {1.0 + alpha, -2.0 * cos(w), 1.0 - alpha};
+
+    _quantise(coef_p, b, a);
+}
+
+static void _lowpass(int32_t * coef_p, double fc, double q)
+{
+    double w = 2.0 * M_PI * fc / FS;
+    double alpha = sin(w) / (2.0 * q);
+    double b[3] = {(1.0 - cos(w)) / 2.0, 1.0 - cos(w), (1.0 - cos(w)) / 2.0};
+    double a[3] = {1.0 + alpha, -2.0 * cos(w), 1.0 - alpha};
+
+    _quantise(coef_p, b, a);
+}
+
+static void _bank_clear(void)
+{
+    static const int32_t _none[OUT_FILTER_COEF_NUM] = {0};
+
+    for (uint8_t i = 0; i < Out_Filter_NUM; i++)
+        out_filter_set(i, _none, false);
+}
+
+/**
+ * Gain in dB at frequency f, a sine of _amp mA (rounded to mA
+ * like the controller output) is settled for 0.5s and then
+ * projected onto sin/cos over a whole number of periods.
+ */
+static double _gain_amp_db(double f, int32_t _amp)
+{
+    const uint32_t _settle = (uint32_t)(FS / 2);
+    uint32_t _n = (uint32_t)(FS / f * ceil(f / 10.0)); /*>= 0.1s*/
+    double _s = 0, _c = 0;
+
+    out_filter_reset();
+    for (uint32_t k = 0; k < _settle + _n; k++) {
+        double ph = 2.0 * M_PI * f * k / FS;
+        int32_t y = out_filter_apply((int32_t)lround(_amp * sin(ph)));
+        if (k < _settle) continue;
+        _s += y * sin(ph);
+        _c += y * cos(ph);
+    }
+    /*Whole periods up to the rounding of _n*/
+    return 20.0 * log10(2.0 * hypot(_s, _c) / _n / _amp);
+}
+
+static double _gain_db(double f)
+{
+    return _gain_amp_db(f, AMP);
+}
+
+static void test_bypass(void)
+{
+    _bank_clear();
+    CHECK(out_filter_apply(1234) == 1234, "bypass changed the output");
+    CHECK(out_filter_apply(-77) == -77, "bypass changed the output");
+}
+
+static void test_notch(void)
+{
+    int32_t _coef[OUT_FILTER_COEF_NUM];
+    const double f0 = 800.0;
+
+    _bank_clear();
+    _notch(_coef, f0, 2.0);
+    out_filter_set(0, _coef, true);
+
+    double g0 = _gain_amp_db(f0, AMP_DEEP);
+    double g_lo = _gain_db(f0 / 8);
+    double g_hi = _gain_db(f0 * 4);
+    double g_dc = _gain_db(5.0);
+
+    printf("notch %.0fHz: depth %.1fdB, f0/8 %.2fdB, 4f0 %.2fdB, 5Hz %.2fdB\n",
+        f0, g0, g_lo, g_hi, g_dc);
+    CHECK(g0 < -40.0, "notch depth %.1fdB", g0);
+    CHECK(fabs(g_lo) < 0.2, "passband below %.2fdB", g_lo);
+    CHECK(fabs(g_hi) < 0.5, "passband above %.2fdB", g_hi);
+    CHECK(fabs(g_dc) < 0.05, "DC gain %.2fdB", g_dc);
+    /*-3dB edges at f0 * (sqrt(1 + 1/4Q^2) -+ 1/2Q)*/
+    double bw = 1.0 / (2.0 * 2.0);
+    double f_lo = f0 * (sqrt(1.0 + bw * bw) - bw);
+    double g_edge = _gain_db(f_lo);
+    printf("notch lower edge %.0fHz: %.2fdB\n", f_lo, g_edge);
+    CHECK(fabs(g_edge + 3.01) < 0.3, "lower -3dB edge %.2fdB", g_edge);
+}
+
+static void test_lowpass(void)
+{
+    int32_t _coef[OUT_FILTER_COEF_NUM];
+    const double fc = 1000.0;
+
+    _bank_clear();
+    _lowpass(_coef, fc, M_SQRT1_2);
+    out_filter_set(2, _coef, true);
+
+    double g_c = _gain_db(fc);
+    double g_pass = _gain_db(fc / 10);
+    double g_stop = _gain_db(fc * 5);
+
+    printf("low-pass %.0fHz: corner %.2fdB, fc/10 %.3fdB, 5fc %.1fdB\n",
+        fc, g_c, g_pass, g_stop);
+    CHECK(fabs(g_c + 3.01) < 0.2, "corner %.2fdB", g_c);
+    CHECK(fabs(g_pass) < 0.05, "passband %.3fdB", g_pass);
+    /*Second order, bilinear zero at fs/2 adds to the roll-off*/
+    CHECK(g_stop < -26.0, "stopband %.1fdB", g_stop);
+
+    /*A low corner needs the Q8 signal between sections*/
+    _lowpass(_coef, 20.0, M_SQRT1_2);
+    out_filter_set(2, _coef, true);
+    g_c = _gain_db(20.0);
+    printf("low-pass 20Hz: corner %.2fdB\n", g_c);
+    CHECK(fabs(g_c + 3.01) < 0.3, "corner %.2fdB", g_c);
+}
+
+static void test_series(void)
+{
+    int32_t _n[OUT_FILTER_COEF_NUM], _l[OUT_FILTER_COEF_NUM];
+
+    _bank_clear();
+    _notch(_n, 600.0, 3.0);
+    _lowpass(_l, 2000.0, M_SQRT1_2);
+    out_filter_set(1, _n, true);
+    out_filter_set(3, _l, true);
+
+    double g_n = _gain_amp_db(600.0, AMP_DEEP);
+    double g_l = _gain_db(2000.0);
+    double g_p = _gain_db(100.0);
+
+    printf("series: 600Hz %.1fdB, 2kHz %.2fdB, 100Hz %.2fdB\n", g_n, g_l, g_p);
+    CHECK(g_n < -40.0, "notch in series %.1fdB", g_n);
+    /*Notch at 2kHz adds about -0.1dB*/
+    CHECK(fabs(g_l + 3.1) < 0.3, "corner in series %.2fdB", g_l);
+    CHECK(fabs(g_p) < 0.1, "passband in series %.2fdB", g_p);
+}
+
+static void test_preload(void)
+{
+    int32_t _n[OUT_FILTER_COEF_NUM], _l[OUT_FILTER_COEF_NUM];
+    int32_t _dev = 0;
+
+    _bank_clear();
+    _notch(_n, 600.0, 3.0);
+    _lowpass(_l, 200.0, M_SQRT1_2);
+    out_filter_set(0, _n, true);
+    out_filter_set(1, _l, true);
+
+    /*Steady output at once, no step from zero*/
+    out_filter_preload(-650);
+    for (uint32_t k = 0; k < 2000; k++) {
+        int32_t d = abs(out_filter_apply(-650) + 650);
+        if (d > _dev) _dev = d;
+    }
+    CHECK(_dev <= 1, "preloaded output deviates by %dmA", _dev);
+
+    /*Without the preload the low-pass has to rise*/
+    out_filter_reset();
+    CHECK(abs(out_filter_apply(-650)) < 10, "history not cleared");
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(void)
+{
+    test_bypass();
+    test_notch();
+    test_lowpass();
+    test_series();
+    test_preload();
+    return TEST_END();
+}
@@ -0,0 +1,440 @@
+/**
+ * @file test_pos_journal.c
+ *
+ * Multi-turn position journal on the fake flash: the power-up
+ * reconcile with the single-turn angle, records torn by a power
+ * failure, the wrap of the two pages and of the sequence number,
+ * the power-fail trip and the erase gated on standstill.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "fake_flash.h"
+#include "pos_journal.h"
+#include "motor_control.h"
+#include "romf103cb.h"
+#include "supply.h"
+#include <string.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define P Move_Pulse_NUM
+#define SUPPLY_RAW 2000U /*About 24V on the divider*/
+#define MOVING (QStop_Rest_Speed * 4)
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static uint16_t supply_raw = SUPPLY_RAW;
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+Motor_Control_Typedef motor_control;
+extern _pos_journal_t pos_journal;
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+uint16_t _supply()
+{
+    return supply_raw;
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Power-up, the RAM state is lost, the flash is kept.
+ */
+static void _power_up(bool _en)
+{
+    fake_flash_power_on();
+    memset(&pos_journal, 0, sizeof(pos_journal));
+    supply_raw = SUPPLY_RAW;
+    motor_control.est_speed = 0;
+    pos_journal_init(_en);
+}
+
+/**
+ * Control ticks with the main loop between them.
+ */
+static void _tick(uint32_t _n)
+{
+    for (uint32_t i = 0; i < _n; i++) {
+        pos_journal_tick_work();
+        pos_journal_solve();
+    }
+}
+
+/**
+ * Supply average settled, about 5 time constants.
+ */
+static void _settle(void)
+{
+    _tick(5U << JR_AVG_SHIFT);
+}
+
+/**
+ * Record a location through the enable path.
+ */
+static bool _record(int32_t _loc)
+{
+    motor_control.real_location = _loc;
+    pos_journal.dirty = true;
+    _tick(1);
+    return !pos_journal.dirty;
+}
+
+/**
+ * Location restored at power-up for a record and
+ * a single-turn angle.
+ */
+static int32_t _restore(int32_t _saved, int32_t _lap)
+{
+    fake_flash_init();
+    _power_up(true);
+    _record(_saved);
+    _power_up(true);
+    return pos_journal_reconcile(_lap);
+}
+
+static void test_reconcile(void)
+{
+    static const int32_t cases[][3] = {
+        /*Record, single-turn angle, restored*/
+        {3 * P + 100, 150, 3 * P + 150},
+        {3 * P + P - 10, 20, 4 * P + 20},
+        {3 * P + 20, P - 10, 3 * P - 10},
+        {-2 * P + 10, P - 5, -2 * P - 5},
+        {-1, 0, 0},
+        {5 * P, P / 2 - 1, 5 * P + P / 2 - 1},
+        {5 * P, P / 2, 5 * P - P / 2},
+        {0x7FFF0000, 0x7FFF0000 % P, 0x7FFF0000},
+    };
+
+    for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int32_t _loc = _restore(cases[i][0], cases[i][1]);
+        CHECK(_loc == cases[i][2], "case %u: %d restored %d", i,
+            cases[i][2], _loc);
+        CHECK(pos_journal.restored, "case %u not restored", i);
+    }
+
+    /*Without a record or disabled the angle is kept*/
+    fake_flash_init();
+    _power_up(true);
+    CHECK(!pos_journal.valid, "record in an erased flash");
+    CHECK(pos_journal_reconcile(1234) == 1234, "no record");
+    CHECK(!pos_journal.restored, "restored without a record");
+
+    _restore(7 * P, 0);
+    _power_up(false);
+    CHECK(pos_journal_reconcile(1234) == 1234, "disabled");
+}
+
+/**
+ * Enabling records the location at once, a disabled
+ * journal never writes.
+ */
+static void test_enable(void)
+{
+    fake_flash_init();
+    _power_up(false);
+    motor_control.real_location = 9 * P + 7;
+    _settle();
+    supply_raw = SUPPLY_RAW / 2;
+    _tick(10);
+    CHECK(fake_flash.programs == 0, "disabled journal wrote");
+
+    supply_raw = SUPPLY_RAW;
+    pos_journal_set_enable(true);
+    _tick(1);
+    _power_up(true);
+    CHECK(pos_journal.valid && pos_journal.saved == 9 * P + 7,
+        "saved %d", pos_journal.saved);
+}
+
+/**
+ * A power failure cut after each halfword of the record,
+ * the torn record is ignored and its slot skipped.
+ */
+static void test_torn(void)
+{
+    const int32_t _old = 2 * P + 300, _new = -4 * P - 200;
+
+    for (int32_t k = 0; k <= 4; k++) {
+        fake_flash_init();
+        _power_up(true);
+        _record(_old);
+        uint16_t _slot = pos_journal.slot;
+
+        /*Power failure while moving*/
+        _settle();
+        motor_control.est_speed = MOVING;
+        motor_control.real_location = _new;
+        fake_flash_cut(k);
+        supply_raw = SUPPLY_RAW / 2;
+        _tick(JR_PF_TICK);
+        CHECK(pos_journal.pf_num == 1, "cut %d: pf_num %u", k, pos_journal.pf_num);
+
+        _power_up(true);
+        int32_t _want = (k < 4) ? _old : _new;
+        CHECK(pos_journal.saved == _want, "cut %d: saved %d", k, pos_journal.saved);
+        CHECK(pos_journal.slot == ((k == 0) ? _slot : _slot + 1),
+            "cut %d: next slot %u", k, pos_journal.slot);
+
+        /*The journal goes on after the torn slot*/
+        CHECK(_record(_new + 5), "cut %d: not written", k);
+        _power_up(true);
+        CHECK(pos_journal.saved == _new + 5, "cut %d: saved %d", k, pos_journal.saved);
+        CHECK(fake_flash.prog_errs == 0, "cut %d: programmed over data", k);
+    }
+}
+
+/**
+ * Torn record in the last slot of a page, the next
+ * power-up moves on to the other page.
+ */
+static void test_torn_page_end(void)
+{
+    fake_flash_init();
+    _power_up(true);
+    for (uint16_t i = 0; i < JR_PAGE_SLOT - 1; i++) {
+        _record(i);
+        if (pos_journal.erase) {
+            motor_control.est_speed = 0;
+            _tick(JR_REST_TICK);
+        }
+    }
+    CHECK(pos_journal.page == 0 && pos_journal.slot == JR_PAGE_SLOT - 1,
+        "page %u slot %u", pos_journal.page, pos_journal.slot);
+
+    fake_flash_cut(2);
+    _record(5000);
+    _power_up(true);
+    CHECK(pos_journal.saved == JR_PAGE_SLOT - 2, "saved %d", pos_journal.saved);
+    CHECK(pos_journal.page == 1 && pos_journal.slot == 0,
+        "page %u slot %u", pos_journal.page, pos_journal.slot);
+    CHECK(_record(6000), "not written");
+    _power_up(true);
+    CHECK(pos_journal.saved == 6000, "saved %d", pos_journal.saved);
+}
+
+/**
+ * Many records through both pages several times and across
+ * the sequence number wrap, each power-up finds the newest.
+ */
+static void test_wrap(void)
+{
+    const uint32_t _num = 4 * 2 * JR_PAGE_SLOT + 3;
+    uint32_t _bad = 0;
+
+    fake_flash_init();
+    _power_up(true);
+    pos_journal.seq = 0xFF80; /*Crosses 0xFFFF on the way*/
+
+    for (uint32_t i = 0; i < _num; i++) {
+        int32_t _loc = (int32_t)(i * 1000U) - 100 * P;
+        if (!_record(_loc)) _bad++;
+        /*Stop a while, the pending erase is done*/
+        if (pos_journal.erase) {
+            motor_control.est_speed = 0;
+            _tick(JR_REST_TICK);
+        }
+        if (i % 7 == 0) {
+            uint16_t _seq = pos_journal.seq;
+            _power_up(true);
+            if ((pos_journal.saved != _loc) || (pos_journal.seq != _seq)) {
+                _bad++;
+                printf("record %u: saved %d seq %04x\n", i,
+                    pos_journal.saved, pos_journal.seq);
+            }
+        }
+    }
+    CHECK(_bad == 0, "%u records lost", _bad);
+    CHECK(fake_flash.prog_errs == 0, "programmed over data");
+    CHECK(fake_flash.erases <= _num / JR_PAGE_SLOT + 1, "%u erases", fake_flash.erases);
+}
+
+/**
+ * The page erase waits for 1s at standstill, a moving
+ * axis never stalls for it.
+ */
+static void test_erase_rest(void)
+{
+    fake_flash_init();
+    _power_up(true);
+    /*Old records in the other page*/
+    memset(&pos_journal, 0, sizeof(pos_journal));
+    pos_journal.enable = true;
+    pos_journal.page = 1;
+    _record(1);
+    _power_up(true);
+
+    motor_control.est_speed = MOVING;
+    for (uint16_t i = 0; i < JR_ERASE_SLOT; i++) _record(i);
+    CHECK(pos_journal.erase, "no erase pending");
+
+    uint32_t _erases = fake_flash.erases;
+    _tick(10 * JR_REST_TICK);
+    CHECK(fake_flash.erases == _erases, "erased while moving");
+    motor_control.est_speed = 0;
+    _tick(JR_REST_TICK - 1);
+    CHECK(fake_flash.erases == _erases, "erased before 1s at rest");
+    _tick(2);
+    CHECK(fake_flash.erases == _erases + 1 && !pos_journal.erase, "not erased");
+}
+
+/**
+ * A power failure while moving just after the page switch,
+ * the erase of the other page was done earlier so the
+ * record has a free slot.
+ */
+static void test_pf_after_switch(void)
+{
+    fake_flash_init();
+    _power_up(true);
+    motor_control.est_speed = MOVING;
+    /*Half a page while moving, one stop, the rest while moving*/
+    for (uint16_t i = 0; i < JR_ERASE_SLOT; i++) _record(i);
+    motor_control.est_speed = 0;
+    _tick(JR_REST_TICK + 1);
+    motor_control.est_speed = MOVING;
+    for (uint16_t i = JR_ERASE_SLOT; i < JR_PAGE_SLOT; i++) _record(i);
+    CHECK(pos_journal.slot == JR_PAGE_SLOT, "slot %u", pos_journal.slot);
+
+    _settle();
+    motor_control.real_location = 33 * P + 33;
+    supply_raw = SUPPLY_RAW / 2;
+    _tick(JR_PF_TICK);
+    _power_up(true);
+    CHECK(pos_journal.saved == 33 * P + 33, "saved %d", pos_journal.saved);
+    CHECK(pos_journal.page == 1, "page %u", pos_journal.page);
+}
+
+/**
+ * The supply below 3/4 of its average for JR_PF_TICK
+ * ticks trips, a shallower dip, a short one or a supply
+ * monitor that is not wired does not.
+ */
+static void test_pf_detect(void)
+{
+    fake_flash_init();
+    _power_up(true);
+    motor_control.real_location = 100;
+    motor_control.est_speed = MOVING;
+    _settle();
+
+    supply_raw = SUPPLY_RAW * 8 / 10;
+    _tick(100);
+    supply_raw = SUPPLY_RAW;
+    _settle();
+    CHECK(pos_journal.pf_num == 0, "tripped at 80%%");
+
+    supply_raw = SUPPLY_RAW * 7 / 10;
+    _tick(JR_PF_TICK - 1);
+    supply_raw = SUPPLY_RAW;
+    _tick(1);
+    CHECK(pos_journal.pf_num == 0, "tripped on a short dip");
+
+    supply_raw = SUPPLY_RAW * 7 / 10;
+    _tick(JR_PF_TICK);
+    CHECK(pos_journal.pf && pos_journal.pf_num == 1, "not tripped at 70%%");
+    uint32_t _programs = fake_flash.programs;
+    _tick(1000);
+    CHECK(fake_flash.programs == _programs, "wrote again during the failure");
+
+    /*Brownout, the supply comes back*/
+    supply_raw = SUPPLY_RAW;
+    _tick(1);
+    CHECK(!pos_journal.pf, "supply back");
+
+    fake_flash_init();
+    _power_up(true);
+    supply_raw = 100;
+    _settle();
+    supply_raw = 0;
+    _tick(100);
+    CHECK(pos_journal.pf_num == 0, "tripped without a supply monitor");
+}
+
+/**
+ * Flash wear over a cycling profile: 2 turns out and back,
+ * 0.5s moving and 1.5s at rest, with a power cycle every
+ * hour. The erases per page over 12 hours, scaled to the
+ * 10k cycle endurance, must last more than 20 years.
+ */
+static void test_wear(void)
+{
+    const uint32_t _hours = 12;
+    const uint32_t _cycle = 2 * CONTROL_FREQ_HZ;
+    uint32_t _programs = 0;
+    int32_t _loc = 0;
+
+    fake_flash_init();
+    _power_up(true);
+    _settle();
+    uint32_t _erases = fake_flash.erases;
+
+    for (uint32_t h = 0; h < _hours; h++) {
+        for (uint32_t c = 0; c < 3600U * CONTROL_FREQ_HZ / _cycle; c++) {
+            _loc = _loc ? 0 : 2 * P;
+            motor_control.est_speed = MOVING;
+            motor_control.real_location = _loc;
+            _tick(_cycle / 4);
+            motor_control.est_speed = 0;
+            _tick(_cycle - _cycle / 4);
+        }
+        /*Power cut while at rest, the power-fail record*/
+        supply_raw = SUPPLY_RAW / 2;
+        _tick(JR_PF_TICK);
+        _programs += fake_flash.programs;
+        _power_up(true);
+        _settle();
+        _programs -= fake_flash.programs;
+        CHECK(pos_journal.saved == _loc, "hour %u saved %d", h, pos_journal.saved);
+    }
+
+    uint32_t _records = (fake_flash.programs + _programs) /
+        (sizeof(_jr_rec_t) / 2);
+    uint32_t _rest = _hours * 3600U * CONTROL_FREQ_HZ / JR_REST_GAP;
+    double _years = 10000.0 * 2 * JR_PAGE_SLOT / (_records * 24.0 / _hours) / 365;
+    printf("%u hours: %u records, %u erases, endurance %.0f years\n",
+        _hours, _records, fake_flash.erases - _erases, _years);
+    CHECK(_records <= _rest + 2 * _hours, "%u records", _records);
+    CHECK(fake_flash.erases - _erases <= _records / JR_PAGE_SLOT + 1,
+        "%u erases", fake_flash.erases - _erases);
+    CHECK(_years > 20, "endurance %.0f years", _years);
+    CHECK(fake_flash.prog_errs == 0, "programmed over data");
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(void)
+{
+    if (!fake_flash_init()) {
+        printf("flash address range not free\n");
+        return 1;
+    }
+    test_reconcile();
+    test_enable();
+    test_torn();
+    test_torn_page_end();
+    test_wrap();
+    test_erase_rest();
+    test_pf_after_switch();
+    test_pf_detect();
+    test_wear();
+    return TEST_END();
+}
@@ -0,0 +1,189 @@
+/**
+ * @file test_qstop.c
+ *
+ * Quick stop on the simulated axis: disable, a switch to stop
+ * mode and an overtemperature trip while running must brake at
+ * the quick-stop deceleration, cover v^2 / (2 * qstop_acc), then
+ * let the driver sleep.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "plant.h"
+#include "Speed_Tracker.h"
+#include <math.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define P Move_Pulse_NUM
+#define M_AXIS 2e-5 /*mA per pulse/s^2, as quoted in the README*/
+#define VISC 1e-4 /*mA per pulse/s, 51mA at 10r/s*/
+#define FRIC 20 /*Coulomb friction and detent (mA)*/
+#define RUN_SPEED (10 * P)
+#define DIST_TOL 0.15 /*Of the ideal stopping distance*/
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef struct {
+    double dist; /*Travel from the request to rest (pulse)*/
+    double v0; /*Speed at the request (pulse/s)*/
+    double back; /*Largest travel against the motion after rest*/
+    uint32_t sleep_ticks; /*Ticks from the request to sleep*/
+} _stop_t;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+static void _run_at(double _load)
+{
+    plant_init(M_AXIS, _load, 0);
+    plant.visc = VISC;
+    plant.fric = FRIC;
+    plant_mode(Motor_Mode_Digital_Speed);
+    Motor_Control_Write_Goal_Speed(RUN_SPEED);
+    plant_run(CONTROL_FREQ_HZ / 5 + CONTROL_FREQ_HZ / 2); /*0.1s ramp, settle*/
+}
+
+/**
+ * Follow the stop requested just before, until the driver
+ * sleeps (or 2s), the rest point is where the rotor first
+ * stops moving forwards.
+ */
+static void _follow(_stop_t * st_p, double _p0)
+{
+    double _rest = NAN;
+
+    st_p->back = 0;
+    st_p->sleep_ticks = 0;
+    for (uint32_t i = 0; i < 2 * CONTROL_FREQ_HZ; i++) {
+        plant_run(1);
+        if (isnan(_rest) && (plant.vel <= 0)) _rest = plant.pos;
+        if (!isnan(_rest) && (_rest - plant.pos > st_p->back))
+            st_p->back = _rest - plant.pos;
+        if (!plant.on) {
+            st_p->sleep_ticks = i + 1;
+            break;
+        }
+    }
+    st_p->dist = (isnan(_rest) ? plant.pos : _rest) - _p0;
+}
+
+static double _ideal(double _v0)
+{
+    return _v0 * _v0 / (2.0 * DE_QSTOP_ACC);
+}
+
+static void _check(const char * _name, const _stop_t * st_p)
+{
+    double _d = _ideal(st_p->v0);
+
+    printf("%s: v0 %.2fr/s, stop %.3fr (ideal %.3fr), sleep %.1fms\n", _name,
+        st_p->v0 / P, st_p->dist / P, _d / P, st_p->sleep_ticks * 1e3 / CONTROL_FREQ_HZ);
+    CHECK(fabs(st_p->dist - _d) < DIST_TOL * _d,
+        "%s stopping distance %.3fr, ideal %.3fr", _name, st_p->dist / P, _d / P);
+    CHECK(st_p->back < P / 200, "%s rolled back %.0f", _name, st_p->back);
+    CHECK(st_p->sleep_ticks > 0, "%s driver still on", _name);
+}
+
+static void test_disable(void)
+{
+    _stop_t _st;
+
+    _run_at(0);
+    _st.v0 = plant.vel;
+    double _p0 = plant.pos;
+    Motor_Control_Write_Goal_Disable(1);
+    _follow(&_st, _p0);
+    _check("disable", &_st);
+    CHECK(motor_control.qstop_done, "quick stop not done");
+    CHECK(motor_control.soft_disable, "not disabled after the stop");
+
+    /*Asleep at rest, it does not roll on*/
+    _p0 = plant.pos;
+    plant_run(CONTROL_FREQ_HZ / 5);
+    CHECK(!plant.on, "driver woke up");
+    CHECK(fabs(plant.pos - _p0) < P / 100, "rolled %.0f after sleep", plant.pos - _p0);
+
+    /*Enable again, a new curve from rest*/
+    Motor_Control_Write_Goal_Disable(0);
+    plant_run(CONTROL_FREQ_HZ / 2);
+    CHECK(plant.on, "driver off after enable");
+    CHECK(fabs(plant.vel - RUN_SPEED) < P / 10, "speed %.0f after enable", plant.vel);
+}
+
+/**
+ * A moving load is held on the way down and the quick stop
+ * completes at rest, the rotor does not fall while braking.
+ */
+static void test_disable_gravity(void)
+{
+    _stop_t _st;
+
+    _run_at(300);
+    _st.v0 = plant.vel;
+    double _p0 = plant.pos;
+    Motor_Control_Write_Goal_Disable(1);
+    _follow(&_st, _p0);
+    _check("disable, 300mA load", &_st);
+}
+
+static void test_stop_mode(void)
+{
+    _stop_t _st;
+
+    plant_init(M_AXIS, 0, 0);
+    plant.visc = VISC;
+    plant.fric = FRIC;
+    plant_mode(Motor_Mode_Digital_Location);
+    Motor_Control_Write_Goal_Location(50 * P);
+    /*Mid ramp, 15r/s*/
+    plant_run(3 * CONTROL_FREQ_HZ / 20);
+    _st.v0 = plant.vel;
+    double _p0 = plant.pos;
+    plant_mode(Control_Mode_Stop);
+    _follow(&_st, _p0);
+    _check("stop mode", &_st);
+    plant_run(2);
+    CHECK(motor_control.mode_run == Control_Mode_Stop, "mode %u", motor_control.mode_run);
+}
+
+static void test_overtemp(void)
+{
+    _stop_t _st;
+
+    _run_at(0);
+    _st.v0 = plant.vel;
+    double _p0 = plant.pos;
+    plant.temp_raw = 3300;
+    _follow(&_st, _p0);
+    _check("overtemp", &_st);
+
+    /*Cooled below the hysteresis, runs again*/
+    plant.temp_raw = 3100;
+    plant_run(CONTROL_FREQ_HZ / 10);
+    CHECK(!plant.on, "restarted inside the hysteresis");
+    plant.temp_raw = 2900;
+    plant_run(CONTROL_FREQ_HZ / 2);
+    CHECK(fabs(plant.vel - RUN_SPEED) < P / 10, "speed %.0f after cooling", plant.vel);
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+int main(void)
+{
+    test_disable();
+    test_disable_gravity();
+    test_stop_mode();
+    test_overtemp();
+    return TEST_END();
+}
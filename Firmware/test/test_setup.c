@@ -0,0 +1,195 @@
+/**
+ * @file test_setup.c
+ *
+ * Settings record on the fake flash: a record of the original
+ * layout, written before the appended fields existed, keeps its
+ * node ID, home offset and gains and takes the defaults for the
+ * rest, a record of the current layout is read unchanged, an
+ * invalid one falls back to the defaults.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "test.h"
+#include "fake_flash.h"
+#include "romf103cb.h"
+#include "rom_conf.h"
+#include "setup.h"
+#include <stddef.h>
+#include <string.h>
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * The original record, layout 0.
+ */
+typedef struct {
+    uint8_t head[5 + 1];
+    int32_t current_down_acc;
+    int32_t current_up_acc;
+    int32_t current_rated;
+    int32_t speed_down_acc;
+    int32_t speed_up_acc;
+    int32_t speed_rated;
+    int32_t dce_kp;
+    int32_t dce_kv;
+    int32_t dce_ki;
+    int32_t dce_kd;
+    int32_t cali_current;
+    uint32_t can_id;
+    uint32_t modedef;
+    int32_t home_ofs;
+    bool motor_onboot;
+    bool stall_protect;
+    uint8_t ssid[8 + 1];
+} _setup0_t;
+
+extern const _setup_t _setup_def;
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+void sleep_ms(uint32_t ms)
+{
+    (void)ms;
+}
+
+void HAL_NVIC_SystemReset(void)
+{
+}
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/**
+ * Program a record into the erased data page.
+ */
+static void _write(const void * _p, uint32_t _n)
+{
+    rom_data_clear(&stockpile_data);
+    rom_data_begin(&stockpile_data);
+    rom_write_data16(&stockpile_data, (uint16_t *)_p, _n / 2);
+    rom_data_end(&stockpile_data);
+}
+
+static void _test_layout(void)
+{
+    CHECK(sizeof(_setup_t) <= APP_DATA_SIZE,
+        "record %u bytes", (unsigned)sizeof(_setup_t));
+    CHECK(offsetof(_setup_t, layout) == sizeof(_setup0_t),
+        "original record moved, layout at %u",
+        (unsigned)offsetof(_setup_t, layout));
+    CHECK(offsetof(_setup_t, can_id) == offsetof(_setup0_t, can_id) &&
+        offsetof(_setup_t, home_ofs) == offsetof(_setup0_t, home_ofs) &&
+        offsetof(_setup_t, ssid) == offsetof(_setup0_t, ssid),
+        "original fields moved");
+}
+
+static void _test_migrate(void)
+{
+    _setup0_t _old = {
+        .head = {".X42."},
+        .current_down_acc = 3000,
+        .current_up_acc = 4000,
+        .current_rated = 1500,
+        .speed_down_acc = 123456,
+        .speed_up_acc = 234567,
+        .speed_rated = 34567,
+        .dce_kp = 210,
+        .dce_kv = 90,
+        .dce_ki = 310,
+        .dce_kd = 260,
+        .cali_current = 1800,
+        .can_id = 0x17,
+        .modedef = 2,
+        .home_ofs = -98765,
+        .motor_onboot = true,
+        .stall_protect = true,
+        .ssid = {".Bin-X42"},
+    };
+
+    _write(&_old, sizeof(_old));
+    uint32_t _erases = fake_flash.erases;
+
+    read_file();
+
+    CHECK(_setup.can_id == 0x17, "can_id %u", (unsigned)_setup.can_id);
+    CHECK(_setup.home_ofs == -98765, "home_ofs %d", (int)_setup.home_ofs);
+    CHECK(_setup.modedef == 2, "modedef %u", (unsigned)_setup.modedef);
+    CHECK(_setup.dce_kp == 210 && _setup.dce_kv == 90 &&
+        _setup.dce_ki == 310 && _setup.dce_kd == 260, "gains %d %d %d %d",
+        (int)_setup.dce_kp, (int)_setup.dce_kv,
+        (int)_setup.dce_ki, (int)_setup.dce_kd);
+    CHECK(_setup.current_rated == 1500 && _setup.cali_current == 1800 &&
+        _setup.speed_rated == 34567 && _setup.speed_up_acc == 234567,
+        "user settings lost");
+    CHECK(_setup.motor_onboot && _setup.stall_protect, "flags lost");
+    CHECK(_setup.layout == SETUP_LAYOUT, "layout %u", (unsigned)_setup.layout);
+    /*Appended fields, the erased flash must not leak in*/
+    CHECK(!memcmp((uint8_t *)&_setup + offsetof(_setup_t, layout) + 2,
+        (uint8_t *)&_setup_def + offsetof(_setup_t, layout) + 2,
+        sizeof(_setup_t) - offsetof(_setup_t, layout) - 2),
+        "appended fields not defaults");
+    CHECK(fake_flash.erases == _erases + 1, "%u erases",
+        (unsigned)(fake_flash.erases - _erases));
+
+    /*Stored in the new layout, read again as it is*/
+    CHECK(!memcmp((void *)APP_DATA_ADDR, &_setup, sizeof(_setup_t)),
+        "migrated record not stored");
+    _erases = fake_flash.erases;
+    memset(&_setup, 0, sizeof(_setup));
+    read_file();
+    CHECK(_setup.can_id == 0x17 && _setup.home_ofs == -98765,
+        "migrated record not read back");
+    CHECK(fake_flash.erases == _erases, "current layout rewritten");
+}
+
+static void _test_current(void)
+{
+    _setup_t _rec = _setup_def;
+
+    _rec.can_id = 0x2A;
+    _rec.pos_keep = true;
+    _rec.ferr_window = 500;
+    _write(&_rec, sizeof(_rec));
+
+    read_file();
+    CHECK(!memcmp(&_setup, &_rec, sizeof(_setup_t)),
+        "current record changed");
+}
+
+static void _test_invalid(void)
+{
+    _setup_t _rec = _setup_def;
+
+    _rec.can_id = 0x2A;
+    _rec.ssid[1] = 'C';
+    _write(&_rec, sizeof(_rec));
+
+    read_file();
+    CHECK(!memcmp(&_setup, &_setup_def, sizeof(_setup_t)),
+        "invalid record not reset");
+    CHECK(!memcmp((void *)APP_DATA_ADDR, &_setup_def, sizeof(_setup_t)),
+        "defaults not stored");
+}
+
+int main(void)
+{
+    if (!fake_flash_init()) {
+        printf("fake flash not mapped\n");
+        return 1;
+    }
+
+    _test_layout();
+    _test_migrate();
+    _test_current();
+    _test_invalid();
+
+    return TEST_END();
+}
@@ -0,0 +1,84 @@
+/**
+ * @file can_ring.c
+ *
+ * Lock-free frame ring between the CAN receive interrupt and
+ * the main loop. The producer copies the frame into the slot
+ * before it publishes the new head, the consumer copies it out
+ * before it releases the slot with the new tail, each index is
+ * written by one side only.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "can_ring.h"
+#include <string.h>
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Empty the ring and clear the counters,
+ * called before the producer is started.
+ */
+void can_ring_init(_can_ring_t * ring_p)
+{
+    ring_p->head = 0;
+    ring_p->tail = 0;
+    ring_p->depth_max = 0;
+    ring_p->drops = 0;
+}
+
+/**
+ * Append a frame, called by the producer only.
+ * @param frame_p Frame to copy into the ring.
+ * @return Whether the frame was queued, a full
+ * ring drops it and counts the drop.
+ */
+bool can_ring_push(_can_ring_t * ring_p, const _can_frame_t * frame_p)
+{
+    uint16_t _head = ring_p->head;
+    uint16_t _next = (_head + 1) & CAN_RING_MASK;
+
+    if (_next == ring_p->tail) {
+        ring_p->drops++;
+        return false;
+    }
+
+    memcpy(&ring_p->frame[_head], frame_p, sizeof(_can_frame_t));
+    CAN_RING_BARRIER();
+    ring_p->head = _next;
+
+    uint16_t _depth = can_ring_depth(ring_p);
+    if (_depth > ring_p->depth_max) ring_p->depth_max = _depth;
+    return true;
+}
+
+/**
+ * Take the oldest frame, called by the consumer only.
+ * @param frame_p Frame copied out of the ring.
+ * @return Whether a frame was taken.
+ */
+bool can_ring_pop(_can_ring_t * ring_p, _can_frame_t * frame_p)
+{
+    uint16_t _tail = ring_p->tail;
+
+    if (_tail == ring_p->head) return false;
+    CAN_RING_BARRIER();
+
+    memcpy(frame_p, &ring_p->frame[_tail], sizeof(_can_frame_t));
+    CAN_RING_BARRIER();
+    ring_p->tail = (_tail + 1) & CAN_RING_MASK;
+    return true;
+}
+
+/**
+ * Frames waiting in the ring, exact from either side,
+ * may be one stale seen from the other side.
+ */
+uint16_t can_ring_depth(const _can_ring_t * ring_p)
+{
+    return (ring_p->head - ring_p->tail) & CAN_RING_MASK;
+}
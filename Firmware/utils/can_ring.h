@@ -0,0 +1,71 @@
+/**
+ * @file can_ring.h
+ *
+ */
+
+#ifndef __CAN_RING_H__
+#define __CAN_RING_H__
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+
+#define CAN_RING_NUM 16U /*Frames, a power of two*/
+#define CAN_RING_MASK (CAN_RING_NUM - 1U)
+
+/*Keeps the compiler from moving the frame copy
+across the index update, the core does not
+reorder its own memory accesses*/
+#define CAN_RING_BARRIER() __asm volatile ("" ::: "memory")
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * One received frame, the payload is first
+ * so that it is word aligned for the command
+ * parser.
+ */
+typedef struct {
+    uint8_t data[8];
+    uint32_t std_id;
+    uint8_t dlc;
+} _can_frame_t;
+
+/**
+ * Describes a single-producer single-consumer frame ring,
+ * the head is only written by the producer (receive
+ * interrupt) and the tail only by the consumer (main
+ * loop), no lock is needed. One slot is left free to
+ * tell a full ring from an empty one.
+ */
+typedef struct {
+    _can_frame_t frame[CAN_RING_NUM];
+    /**< Next slot to write, producer only*/
+    volatile uint16_t head;
+    /**< Next slot to read, consumer only*/
+    volatile uint16_t tail;
+    /**< Deepest fill seen (frames)*/
+    volatile uint16_t depth_max;
+    /**< Frames dropped on a full ring*/
+    volatile uint32_t drops;
+} _can_ring_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+void can_ring_init(_can_ring_t * ring_p);
+bool can_ring_push(_can_ring_t * ring_p, const _can_frame_t * frame_p);
+bool can_ring_pop(_can_ring_t * ring_p, _can_frame_t * frame_p);
+uint16_t can_ring_depth(const _can_ring_t * ring_p);
+
+#endif /*__CAN_RING_H__*/
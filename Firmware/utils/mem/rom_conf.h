@@ -30,6 +30,10 @@
 #define APP_FIRMWARE_ADDR    (0x08000000) /*(0x0800C000) 起始地址*/
 #define APP_FIRMWARE_SIZE    (0x0000BC00) /*Flash容量 47K XDrive(APP_FIRMWARE)*/
 
+/*APP_JOURNAL*/
+#define APP_JOURNAL_ADDR     (0x08017400) /*起始地址(固件结束地址,链接时由 rom_conf.ld 检查)*/
+#define APP_JOURNAL_SIZE     (0x00000800) /*Flash 容量 2K 多圈位置日志(APP_JOURNAL)(两页轮换写入)*/
+
 /*APP_CALI*/
 #define APP_CALI_ADDR        (0x08017C00) /*起始地址*/
 #define APP_CALI_SIZE        (0x00008000) /*Flash 容量 32K XDrive(APP_CALI)(可容纳16K-2byte校准数据-即最大支持14位编码器的校准数据)*/
@@ -37,6 +37,11 @@ _f103_rom_t _quick_cali = {APP_CALI_ADDR, APP_CALI_SIZE,
     (APP_CALI_SIZE / ROM_PAGE_SIZE), 0};
 _f103_rom_t stockpile_data = {APP_DATA_ADDR, APP_DATA_SIZE, 
     (APP_DATA_SIZE / ROM_PAGE_SIZE), 0};
+/*多圈位置日志每页一个实例，按页擦除*/
+_f103_rom_t _journal[2] = {
+    {APP_JOURNAL_ADDR, ROM_PAGE_SIZE, 1, 0},
+    {APP_JOURNAL_ADDR + ROM_PAGE_SIZE, ROM_PAGE_SIZE, 1, 0},
+};
 
 /**********************
  *   GLOBAL FUNCTIONS
@@ -64,6 +64,7 @@ void rom_write_data64(_f103_rom_t * rom_p, uint64_t *data, uint32_t num);
 extern _f103_rom_t _appfw;
 extern _f103_rom_t _quick_cali;
 extern _f103_rom_t stockpile_data;
+extern _f103_rom_t _journal[2];
 
 /********************** FLASH_End *******************************/
 /********************** FLASH_End *******************************/